@@ -0,0 +1,612 @@
+// Generational garbage collector behind coolalloc. The runtime text is built with
+//     gcc -O2 -S coolalloc.c -o - | sed 's/\.L\([A-Z]*[0-9]\)/.Lgc\1/g' > ../src/coolalloc.txt
+// The sed keeps its local labels apart from the ones in the other runtime files.
+//
+// Objects are [vtable, attributes...], the class tag and size in words are the two words in front of the
+// vtable. Int, Bool and String (tags -1, -2 and -3) keep raw data after the vtable, every other
+// attribute is an object or 0.
+//
+// Each thread bump allocates new objects from its own buffer, claimed a chunk at a time from the shared
+// nursery. When the nursery runs out, the objects reachable from the stack maps the compiler emits are
+// copied into the old space, which gets mark-compacted once it
+// grows past a threshold. Generated code marks the card of every object it stores an attribute
+// into, so a minor collection only scans the dirty parts of the old space. Allocation is safe from any
+// number of threads, a collection still expects the thread running it to be the only one in COOL code.
+//
+// Environment variables:
+//     COOL_GC_STATS    print allocation and pause time statistics at exit
+//     COOL_GC_NURSERY  nursery size in bytes
+//     COOL_GC_STRESS   collect everything on every allocation and check the heap afterwards
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#define HEAP_RESERVATION 100000000000ull
+#define NURSERY_BYTES (4ull << 20)
+#define TLAB_BYTES (32ull << 10) // How much of the nursery a thread claims at a time
+#define COMMIT_BYTES (32ull << 20) // The old space is made accessible this much at a time
+#define FULL_COLLECTION_BYTES (64ull << 20) // Old space size that triggers the first full collection
+#define CARD_SHIFT 9 // Has to match the write barrier x86_asm_list emits
+#define CARD_WORDS ((1ull << CARD_SHIFT) / 8)
+
+// Has to match ASM_STACK_MAP_* in assembly.h
+#define STACK_MAP_VERSION 1
+#define STACK_MAP_RBX_LIVE 1
+#define STACK_MAP_R15_LIVE 2
+#define STACK_MAP_R12_LIVE 4
+#define STACK_MAP_BOTTOM 8
+
+#define FORWARDED 1 // Set in the vtable word of a nursery object that was copied, the rest is the copy
+
+// Emitted by x86_stack_maps, one per call the collector can run under
+typedef struct CoolStackMap
+{
+    uint64_t return_address;
+    uint32_t flags;
+    uint16_t rbx_slot; // Words below RBP the frame saved its caller's rbx and r15 at, 0 if it didn't
+    uint16_t r15_slot;
+    uint32_t first_offset; // Slots below RBP holding objects, then words above the callee's RBP
+    uint16_t slot_count;
+    uint16_t outgoing_count;
+} CoolStackMap;
+
+extern const uint64_t coolgc_stack_map_version;
+extern const uint64_t coolgc_stack_map_count;
+extern const CoolStackMap coolgc_stack_maps[];
+extern const uint16_t coolgc_stack_map_offsets[];
+
+// Read by the allocation fast path and the write barrier
+__thread uint64_t* coolgc_tlab_top;
+__thread uint64_t* coolgc_tlab_limit;
+uint64_t coolgc_card_bias; // Card table address minus the heap address shifted by CARD_SHIFT
+
+static __thread uint64_t* tlab_start;
+static uint64_t* nursery_top; // Start of the nursery no thread has claimed yet, may run past nursery_end
+static uint64_t tlab_words;
+static int old_lock; // Held by threads putting large objects straight into the old space
+
+static uint64_t* heap_start; // The nursery comes first
+static uint64_t* nursery_end;
+static uint64_t* old_start;
+static uint64_t* old_top;
+static uint64_t* old_committed;
+static uint64_t* heap_end;
+static uint8_t* cards;
+static uint64_t** card_objects; // The old object covering the first word of each card
+static uint64_t full_threshold;
+static int stress;
+
+// Open addressing table from return address to stack map, filled in by coolalloc_init
+static const CoolStackMap** map_table;
+static uint64_t map_table_mask;
+
+static uint64_t** roots;
+static uint64_t root_count;
+static uint64_t root_capacity;
+static uint64_t* live_words; // One bit per old space word covered by a reachable object
+static uint64_t* live_prefix; // Live words in front of each word of live_words
+static uint64_t** mark_stack;
+static uint64_t mark_count;
+static uint64_t mark_capacity;
+
+static struct
+{
+    uint64_t allocated;
+    uint64_t tlab_count;
+    uint64_t promoted;
+    uint64_t minor_count;
+    uint64_t minor_ns;
+    uint64_t minor_max_ns;
+    uint64_t full_count;
+    uint64_t full_ns;
+    uint64_t full_max_ns;
+    uint64_t old_peak;
+} stats;
+
+// Generated code calls coolalloc with the size in words in rdi on an aligned stack. The slow path saves
+// the registers a stack map can name and gives the collector the frame to start walking from.
+__asm__(
+    "    .text\n"
+    "    .p2align 4\n"
+    "    .globl coolalloc\n"
+    "    .type coolalloc, @function\n"
+    "coolalloc:\n"
+    "    movq %fs:coolgc_tlab_top@tpoff, %rax\n"
+    "    leaq (%rax,%rdi,8), %rdx\n"
+    "    cmpq %fs:coolgc_tlab_limit@tpoff, %rdx\n"
+    "    ja 1f\n"
+    "    movq %rdx, %fs:coolgc_tlab_top@tpoff\n"
+    "    ret\n"
+    "1:\n"
+    "    pushq %rbp\n"
+    "    movq %rsp, %rbp\n"
+    "    pushq %r15\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %rdi\n"
+    "    movq %rsp, %rsi\n"
+    "    movq %rbp, %rdx\n"
+    "    call coolgc_alloc_slow\n"
+    "    popq %rdi\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %r15\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    "    .size coolalloc, .-coolalloc\n");
+
+static uint64_t now_ns(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000000ull + time.tv_nsec;
+}
+
+static void out_of_memory(void)
+{
+    fprintf(stderr, "ERROR: 0: Exception: out of memory\n");
+    exit(1);
+}
+
+static uint64_t object_size(const uint64_t* obj)
+{
+    return ((const uint64_t*)obj[0])[-1];
+}
+
+static int has_pointers(const uint64_t* obj)
+{
+    return (int64_t)((const uint64_t*)obj[0])[-2] >= 0;
+}
+
+static int in_nursery(const uint64_t value)
+{
+    return value >= (uint64_t)heap_start && value < (uint64_t)nursery_end;
+}
+
+static int in_old(const uint64_t value)
+{
+    return value >= (uint64_t)old_start && value < (uint64_t)old_top;
+}
+
+static uint64_t card_index(const uint64_t* address)
+{
+    return ((uint64_t)address - (uint64_t)heap_start) >> CARD_SHIFT;
+}
+
+// Remembers obj as the object covering every card that starts inside it
+static void note_object(uint64_t* obj, const uint64_t words)
+{
+    const uint64_t first = card_index(obj) + (card_index(obj) * CARD_WORDS != (uint64_t)(obj - heap_start));
+    const uint64_t last = card_index(obj + words - 1);
+    for (uint64_t c = first; c <= last; c++)
+    {
+        card_objects[c] = obj;
+    }
+}
+
+static uint64_t* old_alloc(const uint64_t words)
+{
+    uint64_t* obj = old_top;
+    if (obj + words > old_committed)
+    {
+        const uint64_t bytes = ((obj + words - old_committed) * 8 + COMMIT_BYTES - 1) / COMMIT_BYTES * COMMIT_BYTES;
+        if (old_committed + bytes / 8 > heap_end) out_of_memory();
+        mprotect(old_committed, bytes, PROT_READ | PROT_WRITE);
+        old_committed += bytes / 8;
+    }
+    old_top = obj + words;
+    note_object(obj, words);
+    return obj;
+}
+
+static void push_root(uint64_t* root)
+{
+    if (root_count == root_capacity)
+    {
+        root_capacity = root_capacity ? root_capacity * 2 : 256;
+        roots = realloc(roots, root_capacity * sizeof(uint64_t*));
+        if (!roots) out_of_memory();
+    }
+    roots[root_count++] = root;
+}
+
+static uint64_t map_table_index(const uint64_t return_address)
+{
+    return (return_address * 0x9E3779B97F4A7C15ull >> 32) & map_table_mask;
+}
+
+static void build_map_table(void)
+{
+    if (coolgc_stack_map_version != STACK_MAP_VERSION)
+    {
+        fprintf(stderr, "coolgc: stack maps are version %llu, the runtime expects %d\n", (unsigned long long)coolgc_stack_map_version, STACK_MAP_VERSION);
+        exit(1);
+    }
+    uint64_t capacity = 16;
+    while (capacity < coolgc_stack_map_count * 2) capacity *= 2;
+    map_table = calloc(capacity, sizeof(CoolStackMap*));
+    if (!map_table) out_of_memory();
+    map_table_mask = capacity - 1;
+    for (uint64_t i = 0; i < coolgc_stack_map_count; i++)
+    {
+        uint64_t idx = map_table_index(coolgc_stack_maps[i].return_address);
+        while (map_table[idx]) idx = (idx + 1) & map_table_mask;
+        map_table[idx] = &coolgc_stack_maps[i];
+    }
+}
+
+static const CoolStackMap* find_stack_map(const uint64_t return_address)
+{
+    for (uint64_t idx = map_table_index(return_address); map_table[idx]; idx = (idx + 1) & map_table_mask)
+    {
+        if (map_table[idx]->return_address == return_address) return map_table[idx];
+    }
+    return NULL;
+}
+
+// Walks the rbp chain from coolalloc's frame. Each return address names the call a frame is stopped at,
+// frames without a map (the comparison handlers) hold nothing the collector needs. rbx and r15 live in
+// the registers saved by coolalloc until a frame further up saved them in its prologue.
+static void find_roots(uint64_t* registers, uint64_t* frame)
+{
+    uint64_t* rbx = &registers[2];
+    uint64_t* r15 = &registers[3];
+    root_count = 0;
+    for (uint64_t* callee = frame; callee; callee = (uint64_t*)callee[0])
+    {
+        uint64_t* caller = (uint64_t*)callee[0];
+        const CoolStackMap* map = find_stack_map(callee[1]);
+        if (!map) continue;
+
+        const uint16_t* offsets = &coolgc_stack_map_offsets[map->first_offset];
+        if (callee == frame && (map->flags & STACK_MAP_R12_LIVE)) push_root(&registers[1]);
+        if (map->flags & STACK_MAP_RBX_LIVE) push_root(rbx);
+        if (map->flags & STACK_MAP_R15_LIVE) push_root(r15);
+        for (uint64_t i = 0; i < map->outgoing_count; i++)
+        {
+            push_root(callee + offsets[map->slot_count + i]);
+        }
+        if (map->flags & STACK_MAP_BOTTOM) break;
+
+        for (uint64_t i = 0; i < map->slot_count; i++)
+        {
+            push_root(caller - offsets[i]);
+        }
+        if (map->rbx_slot) rbx = caller - map->rbx_slot;
+        if (map->r15_slot) r15 = caller - map->r15_slot;
+    }
+}
+
+#pragma region Minor collection
+
+static uint64_t forward(const uint64_t value)
+{
+    if (!in_nursery(value)) return value;
+    uint64_t* obj = (uint64_t*)value;
+    if (obj[0] & FORWARDED) return obj[0] & ~FORWARDED;
+
+    const uint64_t size = object_size(obj);
+    uint64_t* copy = old_alloc(size);
+    memcpy(copy, obj, size * 8);
+    obj[0] = (uint64_t)copy | FORWARDED;
+    stats.promoted += size * 8;
+    return (uint64_t)copy;
+}
+
+static void forward_range(uint64_t* from, const uint64_t* to)
+{
+    for (uint64_t* field = from; field < to; field++)
+    {
+        *field = forward(*field);
+    }
+}
+
+// The write barrier marks the card holding an object's header, so every object starting on a dirty card
+// below end gets all of its attributes forwarded
+static void scan_cards(const uint64_t* end)
+{
+    if (end == old_start) return;
+    const uint64_t last = card_index(end - 1);
+    for (uint64_t c = card_index(old_start); c <= last; c++)
+    {
+        if (!cards[c])
+        {
+            // Skip clean cards a word at a time
+            while (c + 8 <= last && (c & 7) == 0 && *(uint64_t*)&cards[c] == 0) c += 8;
+            if (!cards[c]) continue;
+        }
+        cards[c] = 0;
+
+        const uint64_t* card_start = heap_start + c * CARD_WORDS;
+        const uint64_t* card_end = card_start + CARD_WORDS < end ? card_start + CARD_WORDS : end;
+        uint64_t* obj = card_objects[c];
+        if (obj < card_start) obj += object_size(obj);
+        for (; obj < card_end; obj += object_size(obj))
+        {
+            if (has_pointers(obj)) forward_range(obj + 1, obj + object_size(obj));
+        }
+    }
+}
+
+static void collect_minor(void)
+{
+    uint64_t* promoted = old_top;
+    for (uint64_t i = 0; i < root_count; i++)
+    {
+        *roots[i] = forward(*roots[i]);
+    }
+    scan_cards(promoted);
+    for (uint64_t* obj = promoted; obj < old_top; obj += object_size(obj))
+    {
+        if (has_pointers(obj)) forward_range(obj + 1, obj + object_size(obj));
+    }
+
+    nursery_top = heap_start;
+}
+
+#pragma endregion
+
+#pragma region Full collection
+
+static int is_live(const uint64_t* obj)
+{
+    const uint64_t word = obj - old_start;
+    return live_words[word / 64] >> (word % 64) & 1;
+}
+
+static void set_live(const uint64_t* obj, const uint64_t size)
+{
+    for (uint64_t word = obj - old_start, end = word + size; word < end;)
+    {
+        const uint64_t bits = end - word < 64 - word % 64 ? end - word : 64 - word % 64;
+        live_words[word / 64] |= (bits == 64 ? ~0ull : (1ull << bits) - 1) << (word % 64);
+        word += bits;
+    }
+}
+
+// Where a live object ends up once everything live in front of it has slid down
+static uint64_t compacted_address(const uint64_t value)
+{
+    const uint64_t word = (uint64_t*)value - old_start;
+    const uint64_t below = live_words[word / 64] & ((1ull << (word % 64)) - 1);
+    return (uint64_t)(old_start + live_prefix[word / 64] + __builtin_popcountll(below));
+}
+
+static void mark(const uint64_t value)
+{
+    if (!in_old(value)) return;
+    uint64_t* obj = (uint64_t*)value;
+    if (is_live(obj)) return;
+    set_live(obj, object_size(obj));
+    if (mark_count == mark_capacity)
+    {
+        mark_capacity = mark_capacity ? mark_capacity * 2 : 1024;
+        mark_stack = realloc(mark_stack, mark_capacity * sizeof(uint64_t*));
+        if (!mark_stack) out_of_memory();
+    }
+    mark_stack[mark_count++] = obj;
+}
+
+// Sliding compaction without touching object headers. Marking sets a bit for every word a reachable
+// object covers, so an object's new address is old_start plus the set bits in front of it. Pointers
+// are updated first, then the objects are moved down in address order. The old space is empty of
+// nursery pointers at this point.
+static void collect_full(void)
+{
+    for (uint64_t i = 0; i < root_count; i++)
+    {
+        mark(*roots[i]);
+    }
+    while (mark_count > 0)
+    {
+        const uint64_t* obj = mark_stack[--mark_count];
+        if (!has_pointers(obj)) continue;
+        const uint64_t size = object_size(obj);
+        for (uint64_t i = 1; i < size; i++)
+        {
+            mark(obj[i]);
+        }
+    }
+
+    const uint64_t bitmap_words = (old_top - old_start + 63) / 64;
+    uint64_t live = 0;
+    for (uint64_t i = 0; i < bitmap_words; i++)
+    {
+        live_prefix[i] = live;
+        live += __builtin_popcountll(live_words[i]);
+    }
+    uint64_t* free = old_start + live;
+
+    for (uint64_t i = 0; i < root_count; i++)
+    {
+        if (in_old(*roots[i])) *roots[i] = compacted_address(*roots[i]);
+    }
+    for (uint64_t* obj = old_start; obj < old_top; obj += object_size(obj))
+    {
+        if (!is_live(obj) || !has_pointers(obj)) continue;
+        for (uint64_t i = 1; i < object_size(obj); i++)
+        {
+            if (in_old(obj[i])) obj[i] = compacted_address(obj[i]);
+        }
+    }
+
+    // An object only ever moves over itself or space already vacated, so the walk can read each size
+    // before the object is moved
+    for (uint64_t* obj = old_start; obj < old_top;)
+    {
+        const uint64_t size = object_size(obj);
+        if (is_live(obj)) memmove((uint64_t*)compacted_address((uint64_t)obj), obj, size * 8);
+        obj += size;
+    }
+    memset(live_words, 0, bitmap_words * 8);
+
+    // Nothing old points into the nursery, so every card is clean
+    if (old_top > old_start) memset(&cards[card_index(old_start)], 0, card_index(old_top - 1) - card_index(old_start) + 1);
+    for (uint64_t* obj = old_start; obj < free; obj += object_size(obj))
+    {
+        note_object(obj, object_size(obj));
+    }
+
+    // Hand the pages nothing lives on anymore back to the kernel
+    uint64_t* released = (uint64_t*)(((uint64_t)free + 4095) & ~4095ull);
+    if (released < old_top) madvise(released, (old_top - released) * 8, MADV_DONTNEED);
+    old_top = free;
+
+    const uint64_t live_bytes = live * 8;
+    full_threshold = live_bytes * 2 > FULL_COLLECTION_BYTES ? live_bytes * 2 : FULL_COLLECTION_BYTES;
+}
+
+#pragma endregion
+
+// Interned Ints and Bools and other constants the compiler emits live outside the heap
+static int valid_reference(const uint64_t value)
+{
+    return in_old(value) || value < (uint64_t)heap_start || value >= (uint64_t)heap_end;
+}
+
+// Every root and attribute has to be 0, a constant or point at an old object header
+static void verify_heap(void)
+{
+    for (uint64_t i = 0; i < root_count; i++)
+    {
+        const uint64_t value = *roots[i];
+        if (!valid_reference(value))
+        {
+            fprintf(stderr, "coolgc: root %p holds %p, which is not an old object\n", (void*)roots[i], (void*)value);
+            abort();
+        }
+    }
+    for (uint64_t* obj = old_start; obj < old_top; obj += object_size(obj))
+    {
+        if (!obj[0] || obj[0] & FORWARDED || object_size(obj) < 1 || obj + object_size(obj) > old_top)
+        {
+            fprintf(stderr, "coolgc: object %p has a bad vtable or size\n", (void*)obj);
+            abort();
+        }
+        if (!has_pointers(obj)) continue;
+        for (uint64_t i = 1; i < object_size(obj); i++)
+        {
+            if (!valid_reference(obj[i]))
+            {
+                fprintf(stderr, "coolgc: attribute %llu of %p holds %p\n", (unsigned long long)i, (void*)obj, (void*)obj[i]);
+                abort();
+            }
+        }
+    }
+}
+
+static void collect(uint64_t* registers, uint64_t* frame)
+{
+    const uint64_t start = now_ns();
+    find_roots(registers, frame);
+    collect_minor();
+    const uint64_t minor_end = now_ns();
+    stats.minor_count++;
+    stats.minor_ns += minor_end - start;
+    if (minor_end - start > stats.minor_max_ns) stats.minor_max_ns = minor_end - start;
+    if ((uint64_t)(old_top - old_start) * 8 > stats.old_peak) stats.old_peak = (old_top - old_start) * 8;
+
+    if (stress || (uint64_t)(old_top - old_start) * 8 > full_threshold)
+    {
+        collect_full();
+        const uint64_t full_end = now_ns();
+        stats.full_count++;
+        stats.full_ns += full_end - minor_end;
+        if (full_end - minor_end > stats.full_max_ns) stats.full_max_ns = full_end - minor_end;
+    }
+    if (stress) verify_heap();
+}
+
+static void tlab_retire(void)
+{
+    __atomic_fetch_add(&stats.allocated, (coolgc_tlab_top - tlab_start) * 8, __ATOMIC_RELAXED);
+    tlab_start = coolgc_tlab_top = coolgc_tlab_limit = NULL;
+}
+
+// Claims the next buffer from the nursery, the last one can come up short. False once the nursery
+// can't fit words anymore.
+static int tlab_refill(const uint64_t words)
+{
+    const uint64_t claim = words > tlab_words ? words : tlab_words;
+    uint64_t* start = __atomic_fetch_add(&nursery_top, claim * 8, __ATOMIC_RELAXED);
+    if (start >= nursery_end || (uint64_t)(nursery_end - start) < words) return 0;
+    tlab_start = coolgc_tlab_top = start;
+    coolgc_tlab_limit = start + claim < nursery_end ? start + claim : nursery_end;
+    __atomic_fetch_add(&stats.tlab_count, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void* coolgc_alloc_slow(const uint64_t words, uint64_t* registers, uint64_t* frame)
+{
+    // Objects too big for the nursery go straight to the old space, their card starts out dirty since
+    // they're filled in without write barriers
+    if (words > (uint64_t)(nursery_end - heap_start) / 2)
+    {
+        while (__atomic_exchange_n(&old_lock, 1, __ATOMIC_ACQUIRE));
+        uint64_t* obj = old_alloc(words);
+        cards[card_index(obj)] = 1;
+        __atomic_store_n(&old_lock, 0, __ATOMIC_RELEASE);
+        __atomic_fetch_add(&stats.allocated, words * 8, __ATOMIC_RELAXED);
+        return obj;
+    }
+
+    tlab_retire();
+    if (stress || !tlab_refill(words))
+    {
+        collect(registers, frame);
+        tlab_refill(words);
+    }
+    uint64_t* obj = coolgc_tlab_top;
+    coolgc_tlab_top += words;
+    if (stress) coolgc_tlab_limit = coolgc_tlab_top;
+    return obj;
+}
+
+static void print_stats(void)
+{
+    tlab_retire();
+    fprintf(stderr, "GC statistics\n");
+    fprintf(stderr, "  allocated          %llu bytes in %llu nursery buffers\n",
+        (unsigned long long)stats.allocated, (unsigned long long)stats.tlab_count);
+    fprintf(stderr, "  promoted           %llu bytes\n", (unsigned long long)stats.promoted);
+    fprintf(stderr, "  old space          %llu bytes, peak %llu bytes\n",
+        (unsigned long long)((old_top - old_start) * 8), (unsigned long long)stats.old_peak);
+    fprintf(stderr, "  minor collections  %llu, %.3f ms total, %.3f ms max pause\n",
+        (unsigned long long)stats.minor_count, stats.minor_ns / 1e6, stats.minor_max_ns / 1e6);
+    fprintf(stderr, "  full collections   %llu, %.3f ms total, %.3f ms max pause\n",
+        (unsigned long long)stats.full_count, stats.full_ns / 1e6, stats.full_max_ns / 1e6);
+}
+
+void coolalloc_init(void)
+{
+    const char* nursery_env = getenv("COOL_GC_NURSERY");
+    uint64_t nursery_bytes = nursery_env ? strtoull(nursery_env, NULL, 10) : NURSERY_BYTES;
+    nursery_bytes = (nursery_bytes + 4095) & ~4095ull;
+    if (nursery_bytes == 0) nursery_bytes = 4096;
+
+    heap_start = mmap(NULL, HEAP_RESERVATION, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    cards = mmap(NULL, HEAP_RESERVATION >> CARD_SHIFT, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    card_objects = mmap(NULL, (HEAP_RESERVATION >> CARD_SHIFT) * sizeof(uint64_t*), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    live_words = mmap(NULL, HEAP_RESERVATION / 64, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    live_prefix = mmap(NULL, HEAP_RESERVATION / 64, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (heap_start == MAP_FAILED || cards == MAP_FAILED || card_objects == MAP_FAILED || live_words == MAP_FAILED || live_prefix == MAP_FAILED) out_of_memory();
+    mprotect(heap_start, nursery_bytes, PROT_READ | PROT_WRITE);
+
+    nursery_end = heap_start + nursery_bytes / 8;
+    old_start = nursery_end;
+    old_top = old_start;
+    old_committed = old_start;
+    heap_end = heap_start + HEAP_RESERVATION / 8;
+    nursery_top = heap_start;
+    tlab_words = TLAB_BYTES / 8 < nursery_bytes / 16 ? TLAB_BYTES / 8 : nursery_bytes / 16;
+    coolgc_card_bias = (uint64_t)cards - ((uint64_t)heap_start >> CARD_SHIFT);
+    full_threshold = FULL_COLLECTION_BYTES;
+    build_map_table();
+
+    stress = getenv("COOL_GC_STRESS") != NULL;
+    if (getenv("COOL_GC_STATS")) atexit(print_stats);
+}
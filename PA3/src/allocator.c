@@ -132,79 +132,118 @@ void arena_deinit(bh_allocator allocator)
     free(data);
 }
 
+// Each buffer starts with a pointer to the one before it, so growing never moves an allocation
+#define RESIZABLE_ARENA_HEADER 16
+#define RESIZABLE_ARENA_ALIGNMENT 16
+
+static void resizable_arena_grow(bh_resizable_arena_data* data, const uint32_t min_capacity)
+{
+    uint32_t new_capacity = data->capacity * 2;
+    if (new_capacity < min_capacity)
+        new_capacity = min_capacity;
+    void* new_buffer = bh_alloc(data->backing, new_capacity);
+    *(void**)new_buffer = data->buffer;
+    data->buffer = new_buffer;
+    data->capacity = new_capacity;
+    data->used = RESIZABLE_ARENA_HEADER;
+}
+
 void* resizable_arena_proc(bh_allocator* this_allocator, bh_allocator_mode mode, bh_allocator_args args)
 {
     bh_resizable_arena_data* data = this_allocator->data;
     switch (mode)
     {
-        case bh_allocator_mode_alloc:
+        case bh_allocator_mode_realloc:
         {
-            // Check if there is enough space; if not, expand.
-            if (data->used + args.size > data->capacity)
+            if (args.ptr == NULL) break;
+            // Only support realloc on the most recent allocation.
+            assert(args.ptr == (char*)data->buffer + data->prev_offset);
+            if (data->prev_offset + args.size <= data->capacity)
             {
-                uint32_t new_capacity = data->capacity * 2;
-                if (new_capacity < data->used + args.size)
-                    new_capacity = data->used + args.size;
-                // Allocate new buffer via the backing allocator.
-                void* new_buffer = bh_alloc(data->backing, new_capacity);
-                // Copy old data.
-                memcpy(new_buffer, data->buffer, data->used);
-                // Free old buffer.
-                bh_free(data->backing, data->buffer);
-                // Update arena buffer and capacity.
-                data->buffer = new_buffer;
-                data->capacity = new_capacity;
+                data->used = data->prev_offset + args.size;
+                return args.ptr;
             }
+            // The old buffer stays alive until the arena is reset, so it can be copied from after growing
+            const uint32_t old_size = data->used - data->prev_offset;
+            resizable_arena_grow(data, RESIZABLE_ARENA_HEADER + args.size);
             void* ptr = (char*)data->buffer + data->used;
+            memcpy(ptr, args.ptr, old_size < args.size ? old_size : args.size);
             data->prev_offset = data->used;
             data->used += args.size;
             return ptr;
         }
-        case bh_allocator_mode_realloc:
-        {
-            // Only support realloc on the most recent allocation.
-            if (args.ptr == (char*)data->buffer + data->prev_offset)
-            {
-                if (data->prev_offset + args.size > data->capacity)
-                {
-                    uint32_t new_capacity = data->capacity * 2;
-                    if (new_capacity < data->prev_offset + args.size)
-                        new_capacity = data->prev_offset + args.size;
-                    void* new_buffer = bh_alloc(data->backing, new_capacity);
-                    memcpy(new_buffer, data->buffer, data->prev_offset);
-                    bh_free(data->backing, data->buffer);
-                    data->buffer = new_buffer;
-                    data->capacity = new_capacity;
-                }
-                data->used = data->prev_offset + args.size;
-                return (char*)data->buffer + data->prev_offset;
-            }
-            break;
-        }
         case bh_allocator_mode_free:
             return NULL;
-        default: break;
+        case bh_allocator_mode_alloc:
+            break;
+        default:
+            assert(0);
+            return NULL;
     }
-    assert(0);
-    return NULL;
+
+    uint32_t offset = (data->used + RESIZABLE_ARENA_ALIGNMENT - 1) & ~(RESIZABLE_ARENA_ALIGNMENT - 1);
+    if (offset + args.size > data->capacity)
+    {
+        resizable_arena_grow(data, RESIZABLE_ARENA_HEADER + args.size);
+        offset = data->used;
+    }
+    void* ptr = (char*)data->buffer + offset;
+    // Match the GPA, which hands out zeroed memory
+    memset(ptr, 0, args.size);
+    data->prev_offset = offset;
+    data->used = offset + args.size;
+    return ptr;
 }
 
 bh_allocator resizable_arena_init(bh_allocator backing, uint32_t initial_size)
 {
     bh_resizable_arena_data* data = calloc(1, sizeof(bh_resizable_arena_data));
     data->backing = backing;
+    if (initial_size < 2 * RESIZABLE_ARENA_HEADER)
+        initial_size = 2 * RESIZABLE_ARENA_HEADER;
     // Allocate initial buffer using the backing allocator.
-    data->used = 0;
+    data->used = RESIZABLE_ARENA_HEADER;
     data->capacity = initial_size;
     data->buffer = bh_alloc(backing, initial_size);
+    *(void**)data->buffer = NULL;
     bh_allocator allocator = { .data = data, .proc = resizable_arena_proc };
     return allocator;
 }
 
+// Keeps the newest buffer, which is also the largest, for whatever gets allocated next
 void resizable_arena_free_all(bh_allocator allocator)
 {
     bh_resizable_arena_data* data = allocator.data;
-    data->used = 0;
+    void* retired = *(void**)data->buffer;
+    while (retired)
+    {
+        void* prev = *(void**)retired;
+        bh_free(data->backing, retired);
+        retired = prev;
+    }
+    *(void**)data->buffer = NULL;
+    data->used = RESIZABLE_ARENA_HEADER;
+    data->prev_offset = 0;
+}
+
+void resizable_arena_deinit(bh_allocator allocator)
+{
+    bh_resizable_arena_data* data = allocator.data;
+    resizable_arena_free_all(allocator);
+    bh_free(data->backing, data->buffer);
+    free(data);
+}
+
+static _Thread_local bh_allocator current_thread_allocator = { .data = NULL, .proc = &gpa_proc };
+
+bh_allocator current_allocator(void)
+{
+    return current_thread_allocator;
+}
+
+void set_current_allocator(bh_allocator allocator)
+{
+    current_thread_allocator = allocator;
 }
 
 // Procedure for an arena allocator
@@ -81,6 +81,11 @@ typedef struct bh_resizable_arena_data {
 
 bh_allocator resizable_arena_init(bh_allocator backing, uint32_t initial_size);
 void resizable_arena_free_all(bh_allocator allocator);
+void resizable_arena_deinit(bh_allocator allocator);
+
+// Where the calling thread puts what it builds for the method it's working on, the GPA unless it sets one
+bh_allocator current_allocator(void);
+void set_current_allocator(bh_allocator allocator);
 
 typedef struct bh_pool_free_node {
     struct bh_pool_free_node *next;
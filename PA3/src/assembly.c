@@ -8,9 +8,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
 
 #include "optimizer_tac.h"
+#include "register_allocator.h"
+#include "unboxing.h"
 
 #pragma region Assembly operations
 
@@ -19,7 +20,7 @@ ASMInstr* asm_list_append(ASMList* asm_list, const ASMInstr instr)
     if (asm_list->instruction_count + 1 >= asm_list->instruction_capacity)
     {
         asm_list->instruction_capacity *= 2;
-        mprotect(asm_list->instructions, asm_list->instruction_capacity * sizeof(ASMInstr), PROT_READ | PROT_WRITE);
+        asm_list->instructions = bh_realloc(GPA, asm_list->instructions, asm_list->instruction_capacity * sizeof(ASMInstr));
     }
     asm_list->instructions[asm_list->instruction_count] = instr;
     asm_list->instruction_count += 1;
@@ -99,8 +100,16 @@ void asm_list_append_mov(ASMList* asm_list, const ASMRegister dest, const ASMReg
     });
 }
 
-void asm_list_append_push(ASMList* asm_list, const ASMRegister reg)
+// Pushes a register, remembering whether it holds an object for the stack maps of the calls made before it's popped
+void asm_list_append_push_value(ASMList* asm_list, const ASMRegister reg, const bool is_object)
 {
+    if (asm_list->pushed_count + 1 >= asm_list->pushed_capacity)
+    {
+        asm_list->pushed_capacity *= 2;
+        asm_list->pushed_objects = bh_realloc(GPA, asm_list->pushed_objects, asm_list->pushed_capacity * sizeof(bool));
+    }
+    asm_list->pushed_objects[asm_list->pushed_count++] = is_object;
+
     asm_list_append(asm_list, (ASMInstr){
         .op = ASM_OP_PUSH,
         .params = {
@@ -109,8 +118,16 @@ void asm_list_append_push(ASMList* asm_list, const ASMRegister reg)
     });
 }
 
+// r12 always holds self or the object being constructed when it gets saved around a call
+void asm_list_append_push(ASMList* asm_list, const ASMRegister reg)
+{
+    asm_list_append_push_value(asm_list, reg, reg == R12);
+}
+
 void asm_list_append_pop(ASMList* asm_list, const ASMRegister reg)
 {
+    // The rbp saved by the prologue isn't tracked
+    if (asm_list->pushed_count > 0) asm_list->pushed_count--;
     asm_list_append(asm_list, (ASMInstr){
         .op = ASM_OP_POP,
         .params = {
@@ -230,6 +247,18 @@ void asm_list_append_ble(ASMList* asm_list, const ASMRegister arg1, const ASMReg
     });
 }
 
+void asm_list_append_bne(ASMList* asm_list, const ASMRegister arg1, const ASMRegister arg2, const bh_str label)
+{
+    asm_list_append(asm_list, (ASMInstr){
+        .op = ASM_OP_BNE,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = arg1 },
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = arg2 },
+            (ASMParam){ .type = ASM_PARAM_LABEL, .label = label },
+        }
+    });
+}
+
 void asm_list_append_bz(ASMList* asm_list, const ASMRegister arg1, const bh_str label)
 {
     asm_list_append(asm_list, (ASMInstr){
@@ -285,6 +314,19 @@ void asm_list_append_arith(ASMList* asm_list, const ASMOpType operation, const A
     });
 }
 
+// Sets dest to 1 if the comparison between arg1 and arg2 holds and 0 otherwise
+void asm_list_append_set(ASMList* asm_list, const ASMOpType operation, const ASMRegister dest, const ASMRegister arg1, const ASMRegister arg2)
+{
+    asm_list_append(asm_list, (ASMInstr){
+        .op = operation,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = dest },
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = arg1 },
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = arg2 },
+        }
+    });
+}
+
 void asm_list_append_and(ASMList* asm_list, const ASMRegister dest, const int64_t input)
 {
     asm_list_append(asm_list, (ASMInstr){
@@ -296,17 +338,238 @@ void asm_list_append_and(ASMList* asm_list, const ASMRegister dest, const int64_
     });
 }
 
+void asm_list_append_shift(ASMList* asm_list, const ASMOpType op, const ASMRegister dest, const int64_t amount)
+{
+    asm_list_append(asm_list, (ASMInstr){
+        .op = op,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = dest },
+            (ASMParam){ .type = ASM_PARAM_IMMEDIATE, .immediate = { .val = amount, .units = ASMImmediateUnitsBase } },
+        }
+    });
+}
+
+// Words below RBP that asm_list_append_callee_saved keeps reg in, 0 if it isn't saved
+int64_t asm_callee_saved_slot(const uint32_t callee_saved, const int64_t stack_slot_count, const ASMRegister reg)
+{
+    if (!(callee_saved & REGISTER_MASK(reg))) return 0;
+    return stack_slot_count + 1 + __builtin_popcount(callee_saved & (REGISTER_MASK(reg) - 1));
+}
+
+// Called once the frame is set up, the stack maps of its calls describe it
+void asm_list_begin_frame(ASMList* asm_list, const uint32_t callee_saved, const int64_t stack_slot_count)
+{
+    asm_list->frame_callee_saved = callee_saved;
+    asm_list->frame_stack_slot_count = stack_slot_count;
+    asm_list->pushed_count = 0;
+}
+
 void asm_list_append_align_sp(ASMList* asm_list)
 {
+    assert(asm_list->pushed_count == 0 && "Words pushed before aligning the stack can't be found by the collector");
     asm_list_append_and(asm_list, RSP, 0xFFFFFFFFFFFFFFF0);
 }
 
+// Pops words pushed for a call without reading them
+void asm_list_append_drop(ASMList* asm_list, const int64_t words)
+{
+    assert(words <= asm_list->pushed_count && "Dropping more words than were pushed");
+    asm_list->pushed_count -= words;
+    asm_list_append(asm_list, (ASMInstr){
+        .op = ASM_OP_ADD,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = RSP },
+            (ASMParam){ .type = ASM_PARAM_IMMEDIATE, .immediate = { .val = words, .units = ASMImmediateUnitsWord } }
+        }
+    });
+}
+
+// Marks the card of the object in reg after one of its attributes was written, so a minor collection
+// finds old objects pointing into the nursery
+void asm_list_append_write_barrier(ASMList* asm_list, const ASMRegister reg)
+{
+    asm_list_append(asm_list, (ASMInstr){
+        .op = ASM_OP_BARRIER,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = reg },
+        }
+    });
+}
+
+// Every numbered label is made here, so the prefix of a method's own list is never left out
+static bh_str asm_list_numbered_label(ASMList* asm_list, const char* kind, const int64_t number)
+{
+    bh_str_buf label_buf = bh_str_buf_init(asm_list->string_allocator, asm_list->label_prefix.len + (int64_t)strlen(kind) + 24);
+    bh_str_buf_append(&label_buf, asm_list->label_prefix);
+    bh_str_buf_append_format(&label_buf, "%s%lld", kind, (long long)number);
+    return (bh_str){ .buf = label_buf.buf, .len = label_buf.len };
+}
+
+// Labels the return address of the call that was just emitted and records where the collector finds
+// every object the frame still needs while that call runs
+void asm_list_append_safepoint(ASMList* asm_list, const uint32_t flags)
+{
+    const bh_str label = asm_list_numbered_label(asm_list, "safepoint", ++asm_list->_safepoint_label);
+    asm_list_append_label(asm_list, label);
+
+    int64_t outgoing_count = 0;
+    for (int64_t j = 0; j < asm_list->pushed_count; j++)
+    {
+        outgoing_count += asm_list->pushed_objects[j];
+    }
+    while (asm_list->stack_map_offset_count + asm_list->live_slot_count + outgoing_count >= asm_list->stack_map_offset_capacity)
+    {
+        asm_list->stack_map_offset_capacity *= 2;
+        asm_list->stack_map_offsets = bh_realloc(GPA, asm_list->stack_map_offsets, asm_list->stack_map_offset_capacity * sizeof(int64_t));
+    }
+    if (asm_list->stack_map_count + 1 >= asm_list->stack_map_capacity)
+    {
+        asm_list->stack_map_capacity *= 2;
+        asm_list->stack_maps = bh_realloc(GPA, asm_list->stack_maps, asm_list->stack_map_capacity * sizeof(ASMStackMap));
+    }
+
+    ASMStackMap map = (ASMStackMap){
+        .label = label,
+        .flags = flags,
+        .rbx_slot = asm_callee_saved_slot(asm_list->frame_callee_saved, asm_list->frame_stack_slot_count, RBX),
+        .r15_slot = asm_callee_saved_slot(asm_list->frame_callee_saved, asm_list->frame_stack_slot_count, R15),
+        .first_offset = asm_list->stack_map_offset_count,
+        .slot_count = asm_list->live_slot_count,
+        .outgoing_count = outgoing_count,
+    };
+    if (asm_list->live_registers & REGISTER_MASK(RBX)) map.flags |= ASM_STACK_MAP_RBX_LIVE;
+    if (asm_list->live_registers & REGISTER_MASK(R15)) map.flags |= ASM_STACK_MAP_R15_LIVE;
+    for (int64_t j = 0; j < asm_list->live_slot_count; j++)
+    {
+        assert(asm_list->live_slots[j] <= UINT16_MAX && "Stack map offsets are emitted as shorts");
+        asm_list->stack_map_offsets[asm_list->stack_map_offset_count++] = asm_list->live_slots[j];
+    }
+    // The last word pushed sits just above the callee's saved rbp and return address
+    for (int64_t j = 0; j < asm_list->pushed_count; j++)
+    {
+        if (!asm_list->pushed_objects[j]) continue;
+        asm_list->stack_map_offsets[asm_list->stack_map_offset_count++] = asm_list->pushed_count - 1 - j + 2;
+    }
+    asm_list->stack_maps[asm_list->stack_map_count++] = map;
+}
+
+// Calls coolalloc for size words and puts the new object in dest
+void asm_list_append_alloc(ASMList* asm_list, const ASMRegister dest, const ASMRegister size, const uint32_t flags)
+{
+    assert(asm_list->pushed_count == 0 && "Words pushed before aligning the stack can't be found by the collector");
+    asm_list_append(asm_list, (ASMInstr){
+        .op = ASM_OP_ALLOC,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = dest },
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = size },
+        }
+    });
+    asm_list_append_safepoint(asm_list, flags);
+    asm_list_append_mov(asm_list, dest, RAX);
+}
+
+// Takes words straight from the thread's allocation buffer and only jumps to slow_label when it's full.
+// asm_list_append_bump_alloc_slow_path has to emit slow_label somewhere off the hot path later.
+void asm_list_append_bump_alloc(ASMList* asm_list, const ASMRegister dest, const int64_t words, const bh_str slow_label, const bh_str resume_label)
+{
+    asm_list_append(asm_list, (ASMInstr){
+        .op = ASM_OP_BUMP_ALLOC,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_IMMEDIATE, .immediate = { words, ASMImmediateUnitsBase } },
+            (ASMParam){ .type = ASM_PARAM_LABEL, .label = slow_label },
+        }
+    });
+    asm_list_append_label(asm_list, resume_label);
+    asm_list_append_mov(asm_list, dest, RAX);
+}
+
+void asm_list_append_bump_alloc_slow_path(ASMList* asm_list, const int64_t words, const bh_str slow_label, const bh_str resume_label)
+{
+    asm_list_append_label(asm_list, slow_label);
+    asm_list_append_li(asm_list, R14, words, ASMImmediateUnitsBase);
+    asm_list_append_alloc(asm_list, RAX, R14, 0);
+    asm_list_append_jmp(asm_list, resume_label);
+}
+
+void asm_list_append_st_temporary(ASMList* asm_list, const int64_t symbol, const ASMRegister source)
+{
+    const RegisterAllocation* allocation = asm_list->register_allocation;
+    assert(allocation && symbol < allocation->symbol_count && "Temporary was not allocated");
+    if (allocation->registers[symbol] != INVALID_REGISTER)
+    {
+        asm_list_append_mov(asm_list, allocation->registers[symbol], source);
+    }
+    else
+    {
+        assert(allocation->stack_slots[symbol] > 0 && "Temporary has no location");
+        asm_list_append_st(asm_list, RBP, -allocation->stack_slots[symbol], source);
+    }
+}
+
+void asm_list_append_ld_temporary(ASMList* asm_list, const ASMRegister dest, const int64_t symbol)
+{
+    const RegisterAllocation* allocation = asm_list->register_allocation;
+    assert(allocation && symbol < allocation->symbol_count && "Temporary was not allocated");
+    if (allocation->registers[symbol] != INVALID_REGISTER)
+    {
+        if (allocation->registers[symbol] != dest) asm_list_append_mov(asm_list, dest, allocation->registers[symbol]);
+    }
+    else
+    {
+        assert(allocation->stack_slots[symbol] > 0 && "Temporary has no location");
+        asm_list_append_ld(asm_list, dest, RBP, -allocation->stack_slots[symbol]);
+    }
+}
+
+// Frame words needed for the spill slots plus a slot per saved callee-saved register
+int64_t asm_frame_size(const int64_t stack_slot_count, const uint32_t callee_saved)
+{
+    const int64_t frame_size = stack_slot_count + __builtin_popcount(callee_saved);
+    return frame_size + (frame_size & 1);
+}
+
+// Saves or restores the callee-saved registers in the slots that follow the spill slots
+void asm_list_append_callee_saved(ASMList* asm_list, const uint32_t callee_saved, const int64_t stack_slot_count, const bool restore)
+{
+    if (!restore) asm_list_begin_frame(asm_list, callee_saved, stack_slot_count);
+    int64_t slot = stack_slot_count + 1;
+    for (ASMRegister reg = RAX; reg <= R15; reg++)
+    {
+        if (!(callee_saved & REGISTER_MASK(reg))) continue;
+        if (restore)
+        {
+            asm_list_append_ld(asm_list, reg, RBP, -slot);
+        }
+        else
+        {
+            asm_list_append_st(asm_list, RBP, -slot, reg);
+        }
+        slot++;
+    }
+}
+
+// Some temporaries get read on a path before they're written, which the program never notices but
+// would hand the collector whatever the slot or register held before
+void asm_list_append_clear_temporaries(ASMList* asm_list, const uint32_t callee_saved, const int64_t stack_slot_count)
+{
+    if (stack_slot_count == 0 && callee_saved == 0) return;
+    asm_list_append_li(asm_list, R14, 0, ASMImmediateUnitsBase);
+    for (int64_t slot = 1; slot <= stack_slot_count; slot++)
+    {
+        asm_list_append_st(asm_list, RBP, -slot, R14);
+    }
+    for (ASMRegister reg = RAX; reg <= R15; reg++)
+    {
+        if (callee_saved & REGISTER_MASK(reg)) asm_list_append_mov(asm_list, reg, R14);
+    }
+}
+
 void asm_list_append_st_tac_symbol(ASMList* asm_list, const ClassNode class_node, const ClassMethod method, const TACSymbol symbol)
 {
     switch (symbol.type)
     {
     case TAC_SYMBOL_TYPE_SYMBOL:
-        asm_list_append_st(asm_list, RBP, -symbol.symbol, R13);
+        asm_list_append_st_temporary(asm_list, symbol.symbol, R13);
         break;
     case TAC_SYMBOL_TYPE_VARIABLE:
         {
@@ -314,7 +577,7 @@ void asm_list_append_st_tac_symbol(ASMList* asm_list, const ClassNode class_node
             int64_t attribute_idx = -1;
             for (int j = 0; j < method.parameter_count; j++)
             {
-                if (bh_str_equal(method.parameters[j].name, symbol.variable.data))
+                if (method.parameters[j].name_atom == symbol.variable.atom)
                 {
                     attribute_idx = j;
                     break;
@@ -331,15 +594,15 @@ void asm_list_append_st_tac_symbol(ASMList* asm_list, const ClassNode class_node
                 // Look up the variable name from attributes
                 for (int j = 0; j < class_node.attribute_count; j++)
                 {
-                    if (bh_str_equal(class_node.attributes[j].name, symbol.variable.data))
+                    if (class_node.attributes[j].name_atom == symbol.variable.atom)
                     {
                         attribute_idx = j;
                         break;
                     }
                 }
                 assert(attribute_idx != -1 && "Could not find attribute for LHS");
-                // asm_list_append_ld(asm_list, R13, R12, attribute_idx + 3);
-                asm_list_append_st(asm_list, R12, attribute_idx + 3, R13);
+                asm_list_append_st(asm_list, R12, attribute_idx + OBJECT_ATTRIBUTES, R13);
+                asm_list_append_write_barrier(asm_list, R12);
             }
             break;
         }
@@ -353,7 +616,7 @@ void asm_list_append_ld_tac_symbol(ASMList* asm_list, const ClassNode class_node
     switch (symbol.type)
     {
     case TAC_SYMBOL_TYPE_SYMBOL:
-        asm_list_append_ld(asm_list, dest, RBP, -symbol.symbol);
+        asm_list_append_ld_temporary(asm_list, dest, symbol.symbol);
         break;
     case TAC_SYMBOL_TYPE_VARIABLE:
         {
@@ -374,14 +637,14 @@ void asm_list_append_ld_tac_symbol(ASMList* asm_list, const ClassNode class_node
             }
             if (attribute_idx > -1)
             {
-                asm_list_append_ld(asm_list, dest, RBP, -attribute_idx);
+                asm_list_append_ld_temporary(asm_list, dest, attribute_idx);
                 break;
             }
 
             // Look up the variable name from parameters
             for (int j = 0; j < method.parameter_count; j++)
             {
-                if (bh_str_equal(method.parameters[j].name, symbol.variable.data))
+                if (method.parameters[j].name_atom == symbol.variable.atom)
                 {
                     attribute_idx = j;
                     break;
@@ -397,14 +660,14 @@ void asm_list_append_ld_tac_symbol(ASMList* asm_list, const ClassNode class_node
             // Look up the variable name from attributes
             for (int j = 0; j < class_node.attribute_count; j++)
             {
-                if (bh_str_equal(class_node.attributes[j].name, symbol.variable.data))
+                if (class_node.attributes[j].name_atom == symbol.variable.atom)
                 {
                     attribute_idx = j;
                     break;
                 }
             }
             assert(attribute_idx != -1 && "Could not find attribute for LHS");
-            asm_list_append_ld(asm_list, dest, R12, attribute_idx + 3);
+            asm_list_append_ld(asm_list, dest, R12, attribute_idx + OBJECT_ATTRIBUTES);
             break;
         }
     default:
@@ -414,20 +677,89 @@ void asm_list_append_ld_tac_symbol(ASMList* asm_list, const ClassNode class_node
 
 bh_str asm_list_create_label(ASMList* asm_list)
 {
-    bh_str_buf label_buf = bh_str_buf_init(asm_list->string_allocator, 5);
-    bh_str_buf_append_format(&label_buf, "l%i", ++asm_list->_global_label);
-    bh_str label_str = (bh_str){ .buf = label_buf.buf, .len = label_buf.len };
+    return asm_list_numbered_label(asm_list, "l", ++asm_list->_global_label);
+}
 
-    return label_str;
+// Loads the preallocated object for a Bool or an Int asm_int_is_interned accepts
+void asm_list_append_la_interned(ASMList* asm_list, const ASMRegister dest, const TACRepresentation representation, const int64_t value)
+{
+    bh_str_buf label_buf = bh_str_buf_init(asm_list->string_allocator, 24);
+    if (representation == TAC_REPRESENTATION_BOOL)
+    {
+        bh_str_buf_append_format(&label_buf, "bool_constants+%i", (int)(value ? 16 : 0));
+    }
+    else
+    {
+        assert(asm_int_is_interned(value) && "Int has no preallocated object");
+        bh_str_buf_append_format(&label_buf, "int_constants+%i", (int)((value - INTERNED_INT_MIN) * 16));
+    }
+    asm_list_append_la_label(asm_list, dest, (bh_str){ .buf = label_buf.buf, .len = label_buf.len });
 }
 
-bh_str asm_list_create_error_label(ASMList* asm_list)
+// Turns the raw Int or Bool in r13 into an object in r13, only Ints outside the interned range get a fresh one
+void asm_list_append_box(ASMList* asm_list, const TACRepresentation representation)
 {
-    bh_str_buf label_buf = bh_str_buf_init(asm_list->string_allocator, 9);
-    bh_str_buf_append_format(&label_buf, "error%i", ++asm_list->_error_label);
-    bh_str label_str = (bh_str){ .buf = label_buf.buf, .len = label_buf.len };
+    assert(representation != TAC_REPRESENTATION_BOXED && "Value is already boxed");
+    if (representation == TAC_REPRESENTATION_BOOL)
+    {
+        asm_list_append(asm_list, (ASMInstr){
+            .op = ASM_OP_INTERN_BOOL,
+            .params = {
+                (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = R13 },
+            }
+        });
+        return;
+    }
 
-    return label_str;
+    const bh_str new_label = asm_list_create_label(asm_list);
+    const bh_str done_label = asm_list_create_label(asm_list);
+    asm_list_append(asm_list, (ASMInstr){
+        .op = ASM_OP_INTERN_INT,
+        .params = {
+            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = R13 },
+            (ASMParam){ .type = ASM_PARAM_LABEL, .label = new_label },
+        }
+    });
+    asm_list_append_jmp(asm_list, done_label);
+    asm_list_append_label(asm_list, new_label);
+    asm_list_append_push(asm_list, R13);
+    asm_list_append_call_method(asm_list, asm_list->int_class_idx, CONSTRUCTOR_METHOD);
+    asm_list_append_pop(asm_list, R14);
+    asm_list_append_st(asm_list, R13, OBJECT_ATTRIBUTES, R14);
+    asm_list_append_label(asm_list, done_label);
+}
+
+// Loads a symbol as a raw word or as an object. Boxing on a read is never done here since it would
+// call out while other operands are still in registers, unbox_tac_list inserts a box op instead.
+void asm_list_append_ld_tac_value(ASMList* asm_list, const TACList* tac_list, const ClassNode class_node, const ClassMethod method, const ASMRegister dest, const TACSymbol symbol, const bool raw)
+{
+    const bool is_raw = tac_symbol_representation(tac_list, symbol) != TAC_REPRESENTATION_BOXED;
+    assert((raw || !is_raw) && "Raw value read as an object");
+    asm_list_append_ld_tac_symbol(asm_list, class_node, method, dest, symbol);
+    if (raw && !is_raw)
+    {
+        asm_list_append_ld(asm_list, dest, dest, OBJECT_ATTRIBUTES);
+    }
+}
+
+// Stores the value in r13 into a symbol, converting it from the given representation
+void asm_list_append_st_tac_value(ASMList* asm_list, const TACList* tac_list, const ClassNode class_node, const ClassMethod method, const TACSymbol symbol, const TACRepresentation representation)
+{
+    const TACRepresentation destination = tac_symbol_representation(tac_list, symbol);
+    if (representation != TAC_REPRESENTATION_BOXED && destination == TAC_REPRESENTATION_BOXED)
+    {
+        asm_list_append_box(asm_list, representation);
+    }
+    else if (representation == TAC_REPRESENTATION_BOXED && destination != TAC_REPRESENTATION_BOXED)
+    {
+        asm_list_append_ld(asm_list, R13, R13, OBJECT_ATTRIBUTES);
+    }
+    asm_list_append_st_tac_symbol(asm_list, class_node, method, symbol);
+}
+
+bh_str asm_list_create_error_label(ASMList* asm_list)
+{
+    return asm_list_numbered_label(asm_list, "error", ++asm_list->_error_label);
 }
 
 void asm_list_append_error_str(ASMList* asm_list, const bh_str label, const bh_str message)
@@ -435,7 +767,7 @@ void asm_list_append_error_str(ASMList* asm_list, const bh_str label, const bh_s
     if (asm_list->error_str_count + 1 >= asm_list->error_str_capacity)
     {
         asm_list->error_str_capacity *= 2;
-        mprotect(asm_list->error_strs, asm_list->error_str_capacity * sizeof(ASMInstr), PROT_READ | PROT_WRITE);
+        asm_list->error_strs = bh_realloc(GPA, asm_list->error_strs, asm_list->error_str_capacity * sizeof(ASMErrorStr));
     }
     asm_list->error_strs[asm_list->error_str_count].label = label;
     asm_list->error_strs[asm_list->error_str_count].message = message;
@@ -484,7 +816,7 @@ void asm_list_push_case_binding(ASMList* asm_list, const bh_str label, const int
     if (asm_list->case_binding_count + 1 >= asm_list->case_binding_capacity)
     {
         asm_list->case_binding_capacity *= 2;
-        mprotect(asm_list->case_bindings, asm_list->case_binding_capacity * sizeof(ASMCaseBinding), PROT_READ | PROT_WRITE);
+        asm_list->case_bindings = bh_realloc(GPA, asm_list->case_bindings, asm_list->case_binding_capacity * sizeof(ASMCaseBinding));
     }
     asm_list->case_bindings[asm_list->case_binding_count].name = label;
     asm_list->case_bindings[asm_list->case_binding_count].symbol = symbol;
@@ -500,12 +832,37 @@ void asm_list_pop_case_binding(ASMList* asm_list)
 
 #pragma region TAC to assembly
 
+static int64_t asm_class_tag(const ClassNode class_node, const int64_t class_idx)
+{
+    if (bh_str_equal_lit(class_node.name, "Bool")) return -1;
+    if (bh_str_equal_lit(class_node.name, "Int")) return -2;
+    if (bh_str_equal_lit(class_node.name, "String")) return -3;
+    return class_idx;
+}
+
+static int64_t asm_object_size(const ClassNode class_node)
+{
+    const bool is_builtin = bh_str_equal_lit(class_node.name, "Bool") ||
+        bh_str_equal_lit(class_node.name, "Int") ||
+        bh_str_equal_lit(class_node.name, "String");
+    return OBJECT_ATTRIBUTES + (is_builtin ? 1 : class_node.attribute_count);
+}
+
 void asm_from_vtable(ASMList* asm_list)
 {
     asm_list_append_comment(asm_list, "vtable definitions");
     for (int i = 0; i < asm_list->class_list->class_count; i++)
     {
         const ClassNode class_node = asm_list->class_list->class_nodes[i];
+
+        // Class tag and object size sit in front of the label so method offsets don't move
+        bh_str_buf header_buf = bh_str_buf_init(asm_list->string_allocator, 48);
+        bh_str_buf_append_format(&header_buf, "%lli", (long long)asm_class_tag(class_node, i));
+        asm_list_append_constant(asm_list, (bh_str){ .buf = header_buf.buf, .len = header_buf.len });
+        header_buf = bh_str_buf_init(asm_list->string_allocator, 48);
+        bh_str_buf_append_format(&header_buf, "%lli", (long long)asm_object_size(class_node));
+        asm_list_append_constant(asm_list, (bh_str){ .buf = header_buf.buf, .len = header_buf.len });
+
         char* label_buf = bh_alloc(asm_list->string_allocator, class_node.name.len + 8);
         strncpy(label_buf, class_node.name.buf, class_node.name.len);
         strncpy(label_buf + class_node.name.len, "..vtable", 8);
@@ -534,6 +891,32 @@ void asm_from_vtable(ASMList* asm_list)
     }
 }
 
+bool asm_int_is_interned(const int64_t value)
+{
+    return value >= INTERNED_INT_MIN && value <= INTERNED_INT_MAX;
+}
+
+// Has to directly follow the vtables so the objects stay word aligned
+void asm_from_interned_constants(ASMList* asm_list)
+{
+    asm_list_append_comment(asm_list, "interned Int and Bool objects");
+    const bh_str int_vtable = bh_str_alloc_cstr(asm_list->string_allocator, "Int..vtable");
+    const bh_str bool_vtable = bh_str_alloc_cstr(asm_list->string_allocator, "Bool..vtable");
+    asm_list_append_label(asm_list, bh_str_alloc_cstr(asm_list->string_allocator, "int_constants"));
+    for (int64_t value = INTERNED_INT_MIN; value <= INTERNED_INT_MAX; value++)
+    {
+        bh_str_buf value_buf = bh_str_buf_init(asm_list->string_allocator, 8);
+        bh_str_buf_append_format(&value_buf, "%i", (int)value);
+        asm_list_append_constant(asm_list, int_vtable);
+        asm_list_append_constant(asm_list, (bh_str){ .buf = value_buf.buf, .len = value_buf.len });
+    }
+    asm_list_append_label(asm_list, bh_str_alloc_cstr(asm_list->string_allocator, "bool_constants"));
+    asm_list_append_constant(asm_list, bool_vtable);
+    asm_list_append_constant(asm_list, bh_str_alloc_cstr(asm_list->string_allocator, "0"));
+    asm_list_append_constant(asm_list, bool_vtable);
+    asm_list_append_constant(asm_list, bh_str_alloc_cstr(asm_list->string_allocator, "1"));
+}
+
 // TODO: refactor how CallData is handled (put it in ASMList?)
 void asm_from_constructor(ASMList* asm_list, const ClassNode class_node, const int64_t class_idx, CallData* call_data, int64_t total_method_count)
 {
@@ -542,49 +925,69 @@ void asm_from_constructor(ASMList* asm_list, const ClassNode class_node, const i
     strncpy(constructor_buf + class_node.name.len, "..new", 5);
     asm_list_append_label(asm_list, (bh_str){ .buf = constructor_buf, .len = class_node.name.len + 5 });
 
+    bool is_builtin = bh_str_equal_lit(class_node.name, "Bool") ||
+        bh_str_equal_lit(class_node.name, "Int") ||
+        bh_str_equal_lit(class_node.name, "String");
+
+    // Lower the attribute initializers first so the frame can be sized before the prologue
+    TACList* init_lists = NULL;
+    RegisterAllocation* init_allocations = NULL;
+    int64_t stack_slot_count = 0;
+    uint32_t callee_saved = 0;
+    if (!is_builtin && class_node.attribute_count > 0)
+    {
+        init_lists = bh_alloc(GPA, sizeof(TACList) * class_node.attribute_count);
+        init_allocations = bh_alloc(GPA, sizeof(RegisterAllocation) * class_node.attribute_count);
+        int64_t label = 0;
+        for (int i = 0; i < class_node.attribute_count; i++)
+        {
+            const ClassAttribute attribute = class_node.attributes[i];
+            if (!attribute.expr.type) continue;
+
+            TACList list = TAC_list_init(1000, asm_list->tac_allocator);
+            list.class_list = *asm_list->class_list;
+            list.class_idx = class_idx;
+            list.method_idx = CONSTRUCTOR_METHOD;
+            list._curr_label = label;
+
+            TACSymbol result = tac_list_from_expression(&attribute.expr, &list, (TACSymbol){ 0 });
+            TAC_list_append(&list, (TACExpr){ .operation = TAC_OP_RETURN, .rhs1 = result });
+            optimize_tac_list(&list);
+            unbox_tac_list(&list);
+            init_allocations[i] = allocate_registers(&list, list.allocator);
+            init_lists[i] = list;
+
+            label = list._curr_label;
+            if (init_allocations[i].stack_slot_count > stack_slot_count)
+            {
+                stack_slot_count = init_allocations[i].stack_slot_count;
+            }
+            callee_saved |= init_allocations[i].callee_saved;
+
+            fill_call_data_from_list(list, call_data, total_method_count);
+        }
+    }
+
     // initialization stuff
     asm_list_append_push(asm_list, RBP);
     asm_list_append_mov(asm_list, RBP, RSP);
     asm_list_append_comment(asm_list, "stack room for temporaries");
-    int64_t temp_count = 2;
-    int64_t extra_temps = 0;
-    ASMInstr* li_instr = asm_list_append_li(asm_list, R14, temp_count, ASMImmediateUnitsWord);
-    asm_list_append_arith(asm_list, ASM_OP_SUB, RSP, R14);
-
-    // call malloc
-    int64_t attribute_count = class_node.attribute_count;
-    if (bh_str_equal_lit(class_node.name, "Bool") ||
-        bh_str_equal_lit(class_node.name, "Int") ||
-        bh_str_equal_lit(class_node.name, "String"))
+    const int64_t temp_count = asm_frame_size(stack_slot_count, callee_saved);
+    if (temp_count > 0)
     {
-        attribute_count += 1;
+        asm_list_append_li(asm_list, R14, temp_count, ASMImmediateUnitsWord);
+        asm_list_append_arith(asm_list, ASM_OP_SUB, RSP, R14);
     }
-    int object_size = 3 + attribute_count;
-    asm_list_append_li(asm_list, R12, object_size, ASMImmediateUnitsBase);
-    asm_list_append_align_sp(asm_list);
-    asm_list_append(asm_list, (ASMInstr){
-        .op = ASM_OP_ALLOC,
-        .params = {
-            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = R12 },
-            (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = R12 },
-        }
-    });
+    asm_list_append_callee_saved(asm_list, callee_saved, stack_slot_count, false);
+    asm_list_append_clear_temporaries(asm_list, callee_saved, stack_slot_count);
 
-    // store class tag
-    int64_t class_tag = class_idx;
-    if (bh_str_equal_lit(class_node.name, "Bool")) class_tag = -1;
-    if (bh_str_equal_lit(class_node.name, "Int")) class_tag = -2;
-    if (bh_str_equal_lit(class_node.name, "String")) class_tag = -3;
-    asm_list_append_comment(asm_list, "store class tag");
-    asm_list_append_li(asm_list, R14, class_tag, ASMImmediateUnitsBase);
-    asm_list_append_st(asm_list, R12, 0, R14);
-
-    // store object size
-    asm_list_append_comment(asm_list, "store object size");
-    asm_list_append_li(asm_list, R14, object_size, ASMImmediateUnitsBase);
-    asm_list_append_st(asm_list, R12, 1, R14);
-
-    // store vtable pointer
+    // call malloc
+    const int64_t object_size = asm_object_size(class_node);
+    const bh_str alloc_slow_label = asm_list_create_label(asm_list);
+    const bh_str alloc_resume_label = asm_list_create_label(asm_list);
+    asm_list_append_bump_alloc(asm_list, R12, object_size, alloc_slow_label, alloc_resume_label);
+
+    // store vtable pointer, the class tag and object size are read through it
     asm_list_append_comment(asm_list, "store vtable pointer");
     asm_list_append(asm_list, (ASMInstr){
         .op = ASM_OP_LA,
@@ -593,48 +996,49 @@ void asm_from_constructor(ASMList* asm_list, const ClassNode class_node, const i
             (ASMParam){ .type = ASM_PARAM_METHOD, .method = { .class_idx = class_idx, .method_idx = -2 } }
         }
     });
-    asm_list_append_st(asm_list, R12, 2, R14);
+    asm_list_append_st(asm_list, R12, OBJECT_VTABLE, R14);
 
     if (bh_str_equal_lit(class_node.name, "Int") || bh_str_equal_lit(class_node.name, "Bool"))
     {
         asm_list_append_comment(asm_list, "define built-in attributes");
         asm_list_append_li(asm_list, R13, 0, ASMImmediateUnitsBase);
-        asm_list_append_st(asm_list, R12, 3, R13);
+        asm_list_append_st(asm_list, R12, OBJECT_ATTRIBUTES, R13);
     }
     else if (bh_str_equal_lit(class_node.name, "String"))
     {
         asm_list_append_comment(asm_list, "define built-in attributes");
         asm_list_append_la(asm_list, R13, INTERNAL_STRINGS, INTERNAL_EMPTY_STR);
-        asm_list_append_st(asm_list, R12, 3, R13);
+        asm_list_append_st(asm_list, R12, OBJECT_ATTRIBUTES, R13);
     }
     else
     {
+        // Nursery memory is reused, so clear every attribute before a collection can look at the object
+        asm_list_append_comment(asm_list, "clear attributes");
+        asm_list_append_li(asm_list, R13, 0, ASMImmediateUnitsBase);
+        for (int i = 0; i < class_node.attribute_count; i++)
+        {
+            asm_list_append_st(asm_list, R12, OBJECT_ATTRIBUTES + i, R13);
+        }
+
         asm_list_append_comment(asm_list, "define attributes");
         for (int i = 0; i < class_node.attribute_count; i++) // define attributes
         {
             const ClassAttribute attribute = class_node.attributes[i];
-            if (bh_str_equal_lit(attribute.type, "Int"))
-            {
-                asm_list_append_call_method(asm_list, asm_list->int_class_idx, CONSTRUCTOR_METHOD);
-            }
-            else if (bh_str_equal_lit(attribute.type, "String"))
-            {
-                asm_list_append_call_method(asm_list, asm_list->string_class_idx, CONSTRUCTOR_METHOD);
-            }
-            else if (bh_str_equal_lit(attribute.type, "Bool"))
+            if (bh_str_equal_lit(attribute.type, "Int") || bh_str_equal_lit(attribute.type, "Bool"))
             {
-                asm_list_append_call_method(asm_list, asm_list->bool_class_idx, CONSTRUCTOR_METHOD);
-            }
-            else
-            {
-                asm_list_append_li(asm_list, R13, 0, ASMImmediateUnitsBase);
+                // Interned objects live outside the heap, so the store needs no barrier
+                asm_list_append_la_interned(asm_list, R13, tac_representation_from_type(attribute.type_atom), 0);
+                asm_list_append_st(asm_list, R12, OBJECT_ATTRIBUTES + i, R13);
+                continue;
             }
+            if (!bh_str_equal_lit(attribute.type, "String")) continue;
 
-            asm_list_append_st(asm_list, R12, 3 + i, R13);
+            asm_list_append_call_method(asm_list, asm_list->string_class_idx, CONSTRUCTOR_METHOD);
+            asm_list_append_st(asm_list, R12, OBJECT_ATTRIBUTES + i, R13);
+            asm_list_append_write_barrier(asm_list, R12);
         }
 
         asm_list_append_comment(asm_list, "initialize attributes");
-        int64_t label = 0;
         for (int i = 0; i < class_node.attribute_count; i++) // initialize attributes
         {
             const ClassAttribute attribute = class_node.attributes[i];
@@ -642,48 +1046,26 @@ void asm_from_constructor(ASMList* asm_list, const ClassNode class_node, const i
             // attribute initializer
             if (attribute.expr.type)
             {
-                TACList list = TAC_list_init(1000, asm_list->tac_allocator);
-                list.class_list = *asm_list->class_list;
-                list.class_idx = class_idx;
-                list._curr_label = label;
-
-                tac_list_from_expression(&attribute.expr, &list, (TACSymbol){ 0 }, false);
-                optimize_tac_list(&list);
-                asm_from_tac_list(asm_list, list);
-                asm_list_append_st(asm_list, R12, i + 3, R13);
-                // arena_free_all(asm_list->tac_allocator);
-
-                label = list._curr_label;
-                if (list._curr_symbol > extra_temps)
-                {
-                    extra_temps = list._curr_symbol;
-                }
-
-                fill_call_data_from_list(list, call_data, total_method_count);
-            }
-            else if (bh_str_equal_lit(attribute.type, "Int"))
-            {
-                asm_list_append_call_method(asm_list, asm_list->int_class_idx, -1);
-                asm_list_append_st(asm_list, R12, i + 3, R13);
+                asm_list->register_allocation = &init_allocations[i];
+                asm_from_tac_list(asm_list, init_lists[i]);
+                asm_list->register_allocation = NULL;
+                asm_list_append_st(asm_list, R12, OBJECT_ATTRIBUTES + i, R13);
+                asm_list_append_write_barrier(asm_list, R12);
+                register_allocation_deinit(&init_allocations[i], init_lists[i].allocator);
             }
             else if (bh_str_equal_lit(attribute.type, "String"))
             {
                 asm_list_append_call_method(asm_list, asm_list->string_class_idx, -1);
-                asm_list_append_st(asm_list, R12, i + 3, R13);
-            }
-            else if (bh_str_equal_lit(attribute.type, "Bool"))
-            {
-                asm_list_append_call_method(asm_list, asm_list->bool_class_idx, -1);
-                asm_list_append_st(asm_list, R12, i + 3, R13);
+                asm_list_append_st(asm_list, R12, OBJECT_ATTRIBUTES + i, R13);
+                asm_list_append_write_barrier(asm_list, R12);
             }
         }
-
-        li_instr->params[1].immediate.val = extra_temps + (extra_temps & 1);
     }
 
     asm_list_append_comment(asm_list, "return from constructor");
 
     // restore stack
+    asm_list_append_callee_saved(asm_list, callee_saved, stack_slot_count, true);
     asm_list_append_mov(asm_list, R13, R12);
     asm_list_append_mov(asm_list, RSP, RBP);
     asm_list_append_pop(asm_list, RBP);
@@ -691,6 +1073,20 @@ void asm_from_constructor(ASMList* asm_list, const ClassNode class_node, const i
     // asm_list_append_li(asm_list, R14, 2, ASMImmediateUnitsWord);
     // asm_list_append_arith(asm_list, ASM_OP_ADD, RSP, R14);
     asm_list_append_return(asm_list);
+
+    asm_list_append_comment(asm_list, "allocation buffer is full");
+    asm_list_append_bump_alloc_slow_path(asm_list, object_size, alloc_slow_label, alloc_resume_label);
+
+    if (init_lists)
+    {
+        for (int i = 0; i < class_node.attribute_count; i++)
+        {
+            if (init_lists[i].items) TAC_list_deinit(init_lists[i]);
+        }
+        resizable_arena_free_all(asm_list->tac_allocator);
+        bh_free(GPA, init_allocations);
+        bh_free(GPA, init_lists);
+    }
 }
 
 void asm_list_append_call_method(ASMList* asm_list, const int64_t class_idx, const int64_t method_idx)
@@ -738,18 +1134,14 @@ void asm_list_append_call_method(ASMList* asm_list, const int64_t class_idx, con
     }
     else if (is_comparison)
     {
-        asm_list_append(asm_list, (ASMInstr){
-            .op = ASM_OP_ADD,
-            .params = {
-                (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = RSP },
-                (ASMParam){ .type = ASM_PARAM_IMMEDIATE, .immediate = { .val = 3, .units = ASMImmediateUnitsWord} }
-            }
-        });
+        asm_list_append_safepoint(asm_list, 0);
+        asm_list_append_drop(asm_list, 3);
         asm_list_append_pop(asm_list, RBP);
         asm_list_append_pop(asm_list, R12);
     }
     else
     {
+        asm_list_append_safepoint(asm_list, 0);
         asm_list_append_pop(asm_list, R12);
         asm_list_append_pop(asm_list, RBP);
     }
@@ -760,27 +1152,25 @@ void asm_from_tac_symbol(ASMList* asm_list, const TACSymbol symbol)
     switch (symbol.type)
     {
     case TAC_SYMBOL_TYPE_INTEGER:
+        if (asm_int_is_interned(symbol.integer))
+        {
+            asm_list_append_la_interned(asm_list, R13, TAC_REPRESENTATION_INT, symbol.integer);
+            break;
+        }
         asm_list_append_call_method(asm_list, asm_list->int_class_idx, CONSTRUCTOR_METHOD);
         asm_list_append_li(asm_list, R14, symbol.integer, ASMImmediateUnitsBase);
-        asm_list_append_st(asm_list, R13, 3, R14);
+        asm_list_append_st(asm_list, R13, OBJECT_ATTRIBUTES, R14);
         break;
     case TAC_SYMBOL_TYPE_BOOL:
-        asm_list_append_call_method(asm_list, asm_list->bool_class_idx, CONSTRUCTOR_METHOD);
-        if (symbol.integer > 0)
-        {
-            asm_list_append_li(asm_list, R14, symbol.integer, ASMImmediateUnitsBase);
-            asm_list_append_st(asm_list, R13, 3, R14);
-        }
+        asm_list_append_la_interned(asm_list, R13, TAC_REPRESENTATION_BOOL, symbol.integer);
         break;
     case TAC_SYMBOL_TYPE_STRING:
         asm_list_append_call_method(asm_list, asm_list->string_class_idx, CONSTRUCTOR_METHOD);
-        bh_str_buf label_buf = bh_str_buf_init(asm_list->string_allocator, 8);
-        bh_str_buf_append_format(&label_buf, "string%i", asm_list->_string_counter++);
-        bh_str label = (bh_str){ .buf = label_buf.buf, .len = label_buf.len };
+        bh_str label = asm_list_numbered_label(asm_list, "string", asm_list->_string_counter++);
         asm_list_append_error_str(asm_list, label, symbol.string.data);
         asm_list_append_la_label(asm_list, R14, label);
         // asm_list_append_la(asm_list, R14, INTERNAL_CUSTOM_STRINGS, asm_list->_string_counter++);
-        asm_list_append_st(asm_list, R13, 3, R14);
+        asm_list_append_st(asm_list, R13, OBJECT_ATTRIBUTES, R14);
         break;
     case TAC_SYMBOL_TYPE_SYMBOL:
         break;
@@ -792,32 +1182,126 @@ void asm_from_tac_symbol(ASMList* asm_list, const TACSymbol symbol)
     }
 }
 
+static bh_str asm_bt_label(const ASMList* asm_list, const bh_str class_name, const TACList* tac_list, const int64_t target)
+{
+    bh_str_buf str_buf = bh_str_buf_init(asm_list->string_allocator, class_name.len + tac_list->method_name.len + 6);
+    bh_str_buf_append(&str_buf, class_name);
+    bh_str_buf_append_lit(&str_buf, "_");
+    bh_str_buf_append(&str_buf, tac_list->method_name);
+    bh_str_buf_append_format(&str_buf, "_%i", target);
+    return (bh_str){ .buf = str_buf.buf, .len = str_buf.len };
+}
+
+// Finds the bt that an inline comparison or a not at idx feeds into, going through at most one not. The
+// value has to be used by nothing else so it never has to exist outside the flags. Returns -1 if there is none.
+static int64_t tac_fused_branch_index(const TACList* list, const int64_t* use_counts, const int64_t idx, bool* negated)
+{
+    const TACExpr expr = list->items[idx];
+    if (!tac_expr_is_primitive_comparison(list, expr) && expr.operation != TAC_OP_NOT) return -1;
+
+    TACSymbol condition = expr.lhs;
+    int64_t j = idx + 1;
+    *negated = expr.operation == TAC_OP_NOT;
+    if (j < list->count && list->items[j].operation == TAC_OP_NOT && condition.type == TAC_SYMBOL_TYPE_SYMBOL &&
+        tac_symbol_equal(list->items[j].rhs1, condition) && use_counts[condition.symbol] == 1)
+    {
+        condition = list->items[j].lhs;
+        *negated = !*negated;
+        j++;
+    }
+    if (j >= list->count || list->items[j].operation != TAC_OP_BT || condition.type != TAC_SYMBOL_TYPE_SYMBOL) return -1;
+    if (!tac_symbol_equal(list->items[j].rhs1, condition) || use_counts[condition.symbol] != 1) return -1;
+    return j;
+}
+
+// Points the stack maps at the boxed temporaries that expression idx keeps across its calls
+static void asm_list_set_live_roots(ASMList* asm_list, const TACList* tac_list, const RegisterAllocation* allocation, const int64_t idx)
+{
+    asm_list->live_slot_count = 0;
+    asm_list->live_registers = 0;
+    for (int64_t k = 0; k < allocation->live_across_count[idx]; k++)
+    {
+        const int64_t symbol = allocation->live_across[allocation->live_across_start[idx] + k];
+        const TACSymbol temporary = (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = symbol };
+        if (tac_symbol_representation(tac_list, temporary) != TAC_REPRESENTATION_BOXED) continue;
+        if (allocation->registers[symbol] != INVALID_REGISTER)
+        {
+            assert((REGISTER_MASK(allocation->registers[symbol]) & CALLEE_SAVED_REGISTERS) && "Object kept across a call in a caller-saved register");
+            asm_list->live_registers |= REGISTER_MASK(allocation->registers[symbol]);
+        }
+        else
+        {
+            asm_list->live_slots[asm_list->live_slot_count++] = allocation->stack_slots[symbol];
+        }
+    }
+}
+
 int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
 {
     int64_t extra_symbols = 0;
     ClassNode curr_class_node = tac_list.class_list.class_nodes[tac_list.class_idx];
-    ClassMethod curr_method = curr_class_node.methods[tac_list.method_idx];
+    const ClassMethod* method = tac_list_current_method(&tac_list);
+    ClassMethod curr_method = method ? *method : (ClassMethod){ 0 };
     const bh_str class_name = curr_class_node.name;
+
+    const int64_t symbol_count = tac_list_symbol_count(&tac_list);
+    int64_t* use_counts = bh_alloc(GPA, sizeof(int64_t) * symbol_count);
+    int64_t* uses = bh_alloc(GPA, sizeof(int64_t) * tac_list_max_use_count(&tac_list));
+    memset(use_counts, 0, sizeof(int64_t) * symbol_count);
+    for (int64_t i = 0; i < tac_list.count; i++)
+    {
+        const int64_t use_count = tac_expr_used_symbols(&tac_list, i, uses);
+        for (int64_t u = 0; u < use_count; u++) use_counts[uses[u]] += 1;
+    }
+
+    const RegisterAllocation* allocation = asm_list->register_allocation;
+    asm_list->live_slots = bh_alloc(GPA, sizeof(int64_t) * (symbol_count + 1));
     for (int i = 0; i < tac_list.count; i++)
     {
         const TACExpr expr = tac_list.items[i];
+        asm_list_set_live_roots(asm_list, &tac_list, allocation, i);
+
+        bool negated;
+        const int64_t branch_idx = tac_fused_branch_index(&tac_list, use_counts, i, &negated);
+        if (branch_idx >= 0)
+        {
+            const bh_str label = asm_bt_label(asm_list, class_name, &tac_list, tac_list.items[branch_idx].rhs2.integer);
+            if (expr.operation == TAC_OP_NOT)
+            {
+                asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+                if (negated) asm_list_append_bz(asm_list, R13, label);
+                else asm_list_append_bnz(asm_list, R13, label);
+            }
+            else
+            {
+                asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+                asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R14, expr.rhs2, true);
+                // !(a < b) is b <= a and !(a <= b) is b < a
+                if (expr.operation == TAC_OP_EQ && !negated) asm_list_append_beq(asm_list, R13, R14, label);
+                if (expr.operation == TAC_OP_EQ && negated) asm_list_append_bne(asm_list, R13, R14, label);
+                if (expr.operation == TAC_OP_LT && !negated) asm_list_append_blt(asm_list, R13, R14, label);
+                if (expr.operation == TAC_OP_LT && negated) asm_list_append_ble(asm_list, R14, R13, label);
+                if (expr.operation == TAC_OP_LTE && !negated) asm_list_append_ble(asm_list, R13, R14, label);
+                if (expr.operation == TAC_OP_LTE && negated) asm_list_append_blt(asm_list, R14, R13, label);
+            }
+            i = branch_idx;
+            continue;
+        }
 
         switch (expr.operation)
         {
         case TAC_OP_ASSIGN:
         {
             asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, tac_symbol_representation(&tac_list, expr.rhs1));
             break;
         }
         case TAC_OP_PLUS:
         case TAC_OP_MINUS:
         case TAC_OP_TIMES:
         case TAC_OP_DIVIDE:
-            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
-            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R14, expr.rhs2);
-            asm_list_append_ld(asm_list, R13, R13, 3);
-            asm_list_append_ld(asm_list, R14, R14, 3);
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R14, expr.rhs2, true);
             if (expr.operation == TAC_OP_DIVIDE)
             {
                 bh_str label = asm_list_create_label(asm_list);
@@ -833,27 +1317,58 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
                     (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = R13 },
                 }
             });
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
-            asm_list_append_call_method(asm_list, asm_list->int_class_idx, -1);
-            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R14, expr.lhs);
-            asm_list_append_st(asm_list, R13, 3, R14);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_INT);
+            break;
+        case TAC_OP_SHL:
+        case TAC_OP_SHR:
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+            asm_list_append_shift(asm_list, expr.operation == TAC_OP_SHL ? ASM_OP_SHL : ASM_OP_SHR, R13, expr.rhs2.integer);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_INT);
+            break;
+        case TAC_OP_LOAD_ATTRIBUTE:
+            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
+            asm_list_append_ld(asm_list, R13, R13, expr.rhs2.integer + OBJECT_ATTRIBUTES);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_BOXED);
+            break;
+        case TAC_OP_STORE_ATTRIBUTE:
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs2, false);
+            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R14, expr.rhs1);
+            asm_list_append_st(asm_list, R14, expr.lhs.integer + OBJECT_ATTRIBUTES, R13);
+            asm_list_append_write_barrier(asm_list, R14);
             break;
         case TAC_OP_LT:
         case TAC_OP_LTE:
         case TAC_OP_EQ:
-            asm_list_append_ld(asm_list, R13, RBP, -0 - expr.rhs1.symbol);
-            asm_list_append_ld(asm_list, R14, RBP, -0 - expr.rhs2.symbol);
-            asm_list_append_push(asm_list, R13);
-            asm_list_append_push(asm_list, R14);
+            if (tac_expr_is_primitive_comparison(&tac_list, expr))
+            {
+                asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+                asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R14, expr.rhs2, true);
+                asm_list_append_set(asm_list, expr.operation == TAC_OP_EQ ? ASM_OP_SEQ : expr.operation == TAC_OP_LT ? ASM_OP_SLT : ASM_OP_SLE, R13, R13, R14);
+                asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_BOOL);
+                break;
+            }
+            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
+            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R14, expr.rhs2);
+            asm_list_append_push(asm_list, R12);
+            asm_list_append_push(asm_list, RBP);
+            asm_list_append_push_value(asm_list, R13, true);
+            asm_list_append_push_value(asm_list, R14, true);
             if (expr.operation == TAC_OP_LTE) asm_list_append_call_method(asm_list, INTERNAL_CLASS, INTERNAL_LE_HANDLER);
             if (expr.operation == TAC_OP_LT) asm_list_append_call_method(asm_list, INTERNAL_CLASS, INTERNAL_LT_HANDLER);
             if (expr.operation == TAC_OP_EQ) asm_list_append_call_method(asm_list, INTERNAL_CLASS, INTERNAL_EQ_HANDLER);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_BOXED);
             break;
         case TAC_OP_INT:
-            asm_list_append_comment(asm_list, "new Int");
-            asm_from_tac_symbol(asm_list, expr.rhs1);
+        case TAC_OP_BOOL:
+            if (tac_symbol_representation(&tac_list, expr.lhs) != TAC_REPRESENTATION_BOXED)
+            {
+                asm_list_append_li(asm_list, R13, expr.rhs1.integer, ASMImmediateUnitsBase);
+            }
+            else
+            {
+                asm_list_append_comment(asm_list, expr.operation == TAC_OP_INT ? "new Int" : "new Bool");
+                asm_from_tac_symbol(asm_list, expr.rhs1);
+            }
             asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
             break;
         case TAC_OP_STRING:
@@ -861,46 +1376,19 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
             asm_from_tac_symbol(asm_list, expr.rhs1);
             asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
             break;
-        case TAC_OP_BOOL:
-            asm_list_append_comment(asm_list, "new Bool");
-            asm_from_tac_symbol(asm_list, expr.rhs1);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
-            break;
         case TAC_OP_NOT:
-        {
-            bh_str label_str_1 = asm_list_create_label(asm_list);
-            bh_str label_str_2 = asm_list_create_label(asm_list);
-            bh_str label_str_3 = asm_list_create_label(asm_list);
-
-            asm_list_append_ld(asm_list, R13, RBP, -0 - expr.rhs1.symbol);
-            asm_list_append_ld(asm_list, R13, R13, 3);
-            asm_list_append_bnz(asm_list, R13, label_str_1);
-
-            asm_list_append_label(asm_list, label_str_2);
-            asm_list_append_comment(asm_list, "false branch");
-            asm_list_append_call_method(asm_list, asm_list->bool_class_idx, -1);
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
             asm_list_append_li(asm_list, R14, 1, ASMImmediateUnitsBase);
-            asm_list_append_st(asm_list, R13, 3, R14);
-            asm_list_append_jmp(asm_list, label_str_3);
-
-            asm_list_append_label(asm_list, label_str_1);
-            asm_list_append_comment(asm_list, "true branch");
-            asm_list_append_call_method(asm_list, asm_list->bool_class_idx, -1);
-
-            asm_list_append_label(asm_list, label_str_3);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            asm_list_append_arith(asm_list, ASM_OP_SUB, R14, R13);
+            asm_list_append_mov(asm_list, R13, R14);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_BOOL);
             break;
-        }
         case TAC_OP_NEG:
-            asm_list_append_call_method(asm_list, asm_list->int_class_idx, -1);
-            asm_list_append_push(asm_list, R13);
-            asm_list_append_ld(asm_list, R14, R13, 3);
-            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
-            asm_list_append_ld(asm_list, R13, R13, 3);
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+            asm_list_append_li(asm_list, R14, 0, ASMImmediateUnitsBase);
             asm_list_append_arith(asm_list, ASM_OP_SUB, R14, R13);
-            asm_list_append_pop(asm_list, R13);
-            asm_list_append_st(asm_list, R13, 3, R14);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            asm_list_append_mov(asm_list, R13, R14);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_INT);
             break;
         case TAC_OP_NEW:
             {
@@ -908,34 +1396,34 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
                 {
                     asm_list_append_push(asm_list, RBP);
                     asm_list_append_push(asm_list, R12);
-                    asm_list_append_ld(asm_list, R14, R12, 2);
+                    asm_list_append_ld(asm_list, R14, R12, OBJECT_VTABLE);
                     asm_list_append_ld(asm_list, R14, R14, 1);
                     asm_list_append_call(asm_list, R14);
+                    asm_list_append_safepoint(asm_list, 0);
                     asm_list_append_pop(asm_list, R12);
                     asm_list_append_pop(asm_list, RBP);
                 }
                 else
                 {
-                    int64_t class_idx = -1;
-                    for (int64_t j = 0; j < asm_list->class_list->class_count; j++)
-                    {
-                        if (bh_str_equal(asm_list->class_list->class_nodes[j].name, expr.rhs1.variable.data))
-                        {
-                            class_idx = j;
-                        }
-                    }
+                    const int64_t class_idx = class_idx_from_atom(*asm_list->class_list, expr.rhs1.variable.atom);
                     assert(class_idx != -1 && "TAC new expression did not match class");
                     asm_list_append_call_method(asm_list, class_idx, CONSTRUCTOR_METHOD);
                 }
-                asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+                asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_BOXED);
             }
             break;
         case TAC_OP_DEFAULT:
         {
-            if (bh_str_equal_lit(expr.rhs1.variable.data, "Int"))
+            if (tac_representation_from_type(expr.rhs1.variable.atom) != TAC_REPRESENTATION_BOXED &&
+                tac_symbol_representation(&tac_list, expr.lhs) != TAC_REPRESENTATION_BOXED)
+            {
+                asm_list_append_li(asm_list, R13, 0, ASMImmediateUnitsBase);
+                asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            }
+            else if (bh_str_equal_lit(expr.rhs1.variable.data, "Int"))
             {
                 asm_list_append_comment(asm_list, "default constructor");
-                asm_list_append_call_method(asm_list, asm_list->int_class_idx, -1);
+                asm_list_append_la_interned(asm_list, R13, TAC_REPRESENTATION_INT, 0);
                 asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
             }
             else if (bh_str_equal_lit(expr.rhs1.variable.data, "String"))
@@ -947,7 +1435,7 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
             else if (bh_str_equal_lit(expr.rhs1.variable.data, "Bool"))
             {
                 asm_list_append_comment(asm_list, "default constructor");
-                asm_list_append_call_method(asm_list, asm_list->bool_class_idx, -1);
+                asm_list_append_la_interned(asm_list, R13, TAC_REPRESENTATION_BOOL, 0);
                 asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
             }
             else
@@ -960,39 +1448,31 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
         }
         case TAC_OP_ISVOID:
         {
-            bh_str label_str_1 = asm_list_create_label(asm_list);
-            bh_str label_str_2 = asm_list_create_label(asm_list);
-            bh_str label_str_3 = asm_list_create_label(asm_list);
-
-            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
-            asm_list_append_bz(asm_list, R13, label_str_1);
-
-            asm_list_append_label(asm_list, label_str_2);
-            asm_list_append_comment(asm_list, "false branch");
-            asm_list_append_call_method(asm_list, asm_list->bool_class_idx, -1);
-            asm_list_append_jmp(asm_list, label_str_3);
-
-            asm_list_append_label(asm_list, label_str_1);
-            asm_list_append_comment(asm_list, "true branch");
-            asm_list_append_call_method(asm_list, asm_list->bool_class_idx, -1);
-            asm_list_append_li(asm_list, R14, 1, ASMImmediateUnitsBase);
-            asm_list_append_st(asm_list, R13, 3, R14);
-
-            asm_list_append_label(asm_list, label_str_3);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            if (tac_symbol_representation(&tac_list, expr.rhs1) != TAC_REPRESENTATION_BOXED)
+            {
+                // Ints and Bools are never void
+                asm_list_append_li(asm_list, R13, 0, ASMImmediateUnitsBase);
+            }
+            else
+            {
+                bh_str label_str = asm_list_create_label(asm_list);
+                asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R14, expr.rhs1);
+                asm_list_append_li(asm_list, R13, 1, ASMImmediateUnitsBase);
+                asm_list_append_bz(asm_list, R14, label_str);
+                asm_list_append_li(asm_list, R13, 0, ASMImmediateUnitsBase);
+                asm_list_append_label(asm_list, label_str);
+            }
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, TAC_REPRESENTATION_BOOL);
             break;
         }
+        case TAC_OP_BOX:
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+            asm_list_append_box(asm_list, tac_symbol_representation(&tac_list, expr.rhs1));
+            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            break;
         case TAC_OP_IGNORE:
-            switch (expr.rhs1.integer)
-            {
-                case -1:
-                    asm_list_append_push(asm_list, R12);
-                    asm_list_append_push(asm_list, RBP);
-                    break;
-                default:
-                    assert(0 && "Unhandled tac ignore");
-                    break;
-            }
+            // Calls save r12 and rbp right before they happen, so every call site knows exactly what's on the stack
+            assert(expr.rhs1.integer == -1 && "Unhandled tac ignore");
             break;
         case TAC_OP_PHI:
             assert(0 && "Cannot generate asm for phi nodes");
@@ -1011,6 +1491,8 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
             }
 
             // Push all the params onto the stack
+            asm_list_append_push(asm_list, R12);
+            asm_list_append_push(asm_list, RBP);
             for (int j = 0; j < expr.arg_count; j++)
             {
                 if (j == expr.arg_count - 1 && is_self_dispatch)
@@ -1019,15 +1501,24 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
                 }
                 else
                 {
-                    asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.args[j]);
-                    asm_list_append_push(asm_list, R13);
+                    const bool raw = tac_call_argument_representation(&tac_list, expr, j) != TAC_REPRESENTATION_BOXED;
+                    asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.args[j], raw);
+                    asm_list_append_push_value(asm_list, R13, !raw);
                 }
             }
 
-            // Perform the call
-            if (is_self_dispatch)
+            // Perform the call, directly when every receiver it can have runs the same implementation
+            const int64_t target_class = class_hierarchy_call_target(&asm_list->class_hierarchy, expr.rhs1);
+            if (target_class != -1)
             {
-                asm_list_append_ld(asm_list, R14, R12, 2);
+                asm_list_append(asm_list, (ASMInstr){
+                    .op = ASM_OP_CALL,
+                    .params = (ASMParam){ .type = ASM_PARAM_METHOD, .method = { .class_idx = target_class, .method_idx = expr.rhs1.method.method_idx } }
+                });
+            }
+            else if (is_self_dispatch)
+            {
+                asm_list_append_ld(asm_list, R14, R12, OBJECT_VTABLE);
             }
             else if (expr.rhs1.method.class_idx < 0) // Static dispatch
             {
@@ -1035,20 +1526,18 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
             }
             else
             {
-                asm_list_append_ld(asm_list, R14, R13, 2);
+                asm_list_append_ld(asm_list, R14, R13, OBJECT_VTABLE);
             }
-            asm_list_append_ld(asm_list, R14, R14, expr.rhs1.method.method_idx + 2);
-            asm_list_append_call(asm_list, R14);
-            asm_list_append(asm_list, (ASMInstr){
-                .op = ASM_OP_ADD,
-                .params = {
-                    (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = RSP },
-                    (ASMParam){ .type = ASM_PARAM_IMMEDIATE, .immediate = { .val = expr.arg_count, .units = ASMImmediateUnitsWord }}
-                }
-            });
+            if (target_class == -1)
+            {
+                asm_list_append_ld(asm_list, R14, R14, expr.rhs1.method.method_idx + 2);
+                asm_list_append_call(asm_list, R14);
+            }
+            asm_list_append_safepoint(asm_list, 0);
+            asm_list_append_drop(asm_list, expr.arg_count);
             asm_list_append_pop(asm_list, RBP);
             asm_list_append_pop(asm_list, R12);
-            asm_list_append_st_tac_symbol(asm_list, curr_class_node, curr_method, expr.lhs);
+            asm_list_append_st_tac_value(asm_list, &tac_list, curr_class_node, curr_method, expr.lhs, tac_call_result_representation(&tac_list, expr));
             break;
         }
         case TAC_OP_JMP:
@@ -1070,27 +1559,20 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
             break;
         }
         case TAC_OP_RETURN:
-            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, tac_return_representation(&tac_list) != TAC_REPRESENTATION_BOXED);
             break;
         case TAC_OP_COMMENT:
             asm_list_append_comment_str(asm_list, expr.rhs1.string.data);
             break;
         case TAC_OP_BT:
-        {
-            bh_str_buf str_buf = bh_str_buf_init(asm_list->string_allocator, class_name.len + tac_list.method_name.len + 6);
-            bh_str_buf_append(&str_buf, class_name);
-            bh_str_buf_append_lit(&str_buf, "_");
-            bh_str_buf_append(&str_buf, tac_list.method_name);
-            bh_str_buf_append_format(&str_buf, "_%i", expr.rhs2.integer);
-            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
-            asm_list_append_ld(asm_list, R13, R13, 3);
-            asm_list_append_bnz(asm_list, R13, (bh_str){ .buf = str_buf.buf, .len = str_buf.len });
+            asm_list_append_ld_tac_value(asm_list, &tac_list, curr_class_node, curr_method, R13, expr.rhs1, true);
+            asm_list_append_bnz(asm_list, R13, asm_bt_label(asm_list, class_name, &tac_list, expr.rhs2.integer));
             break;
-        }
         case TAC_OP_IS_CLASS:
             // NOTE: This relies on the fact that an isclass op will always be succeeded by a bt op
-            asm_list_append_ld(asm_list, R13, RBP, -0 - expr.rhs1.symbol);
-            asm_list_append_ld(asm_list, R15, R13, 0);
+            asm_list_append_ld_tac_symbol(asm_list, curr_class_node, curr_method, R13, expr.rhs1);
+            asm_list_append_ld(asm_list, R13, R13, OBJECT_VTABLE);
+            asm_list_append_ld(asm_list, R13, R13, VTABLE_CLASS_TAG);
             asm_list_append_li(asm_list, R14, expr.rhs2.integer, ASMImmediateUnitsBase);
 
             i++; // Now we handle the bt instruction
@@ -1101,7 +1583,7 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
             bh_str_buf_append(&str_buf, tac_list.method_name);
             bh_str_buf_append_format(&str_buf, "_%i", tac_list.items[i].rhs2.integer);
             asm_from_tac_symbol(asm_list, expr.rhs1);
-            asm_list_append_beq(asm_list, R14, R15, (bh_str){ .buf = str_buf.buf, .len = str_buf.len });
+            asm_list_append_beq(asm_list, R14, R13, (bh_str){ .buf = str_buf.buf, .len = str_buf.len });
             break;
         case TAC_OP_RUNTIME_ERROR:
             asm_list_append_runtime_error_bh_str(asm_list, expr.line_num, expr.rhs1.string.data);
@@ -1112,6 +1594,12 @@ int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list)
         }
     }
 
+    bh_free(GPA, asm_list->live_slots);
+    asm_list->live_slots = NULL;
+    asm_list->live_slot_count = 0;
+    asm_list->live_registers = 0;
+    bh_free(GPA, uses);
+    bh_free(GPA, use_counts);
     return extra_symbols;
 }
 
@@ -1131,34 +1619,12 @@ void asm_from_method_stub(ASMList* asm_list, TACList tac_list)
     asm_list_append_return(asm_list);
 }
 
-void asm_from_method(ASMList* asm_list, const TACList tac_list)
+// Built in methods are written by hand
+static void asm_from_builtin_method(ASMList* asm_list, const bh_str class_name, const bh_str method_name)
 {
-    const bh_str class_name = tac_list.class_list.class_nodes[tac_list.class_idx].name;
-
-    // Construct method name
-    int64_t label_len = class_name.len + tac_list.method_name.len + 1;
-    char* label_buf = bh_alloc(asm_list->string_allocator, label_len + 4);
-    strncpy(label_buf, class_name.buf, class_name.len);
-    label_buf[class_name.len] = '.';
-    strncpy(label_buf + class_name.len + 1, tac_list.method_name.buf, tac_list.method_name.len);
-    strncpy(label_buf + class_name.len + tac_list.method_name.len + 1, ".end", 4);
-    asm_list_append_label(asm_list, (bh_str){ .buf = label_buf, .len = label_len });
-    asm_list_append_comment(asm_list, "method definition");
-
-    // Setup stack and stuff
-    // asm_list_append_push(asm_list, RA);
-    asm_list_append_push(asm_list, RBP);
-    asm_list_append_mov(asm_list, RBP, RSP);
-    asm_list_append_ld(asm_list, R12, RBP, 2);
-    asm_list_append_comment(asm_list, "stack room for temporaries");
-    int64_t temp_count = tac_list._curr_symbol + (tac_list._curr_symbol & 1);
-    ASMInstr* temp_space_instr = asm_list_append_li(asm_list, R14, temp_count, ASMImmediateUnitsWord);
-    asm_list_append_arith(asm_list, ASM_OP_SUB, RSP, R14);
-
-    asm_list_append_comment(asm_list, "method body begins");
     if (bh_str_equal_lit(class_name, "Object"))
     {
-        if (bh_str_equal_lit(tac_list.method_name, "abort"))
+        if (bh_str_equal_lit(method_name, "abort"))
         {
             asm_list_append_la(asm_list, R13, INTERNAL_CLASS, INTERNAL_ABORT_STR); // Fix this jawn
             asm_list_append_align_sp(asm_list);
@@ -1166,20 +1632,14 @@ void asm_from_method(ASMList* asm_list, const TACList tac_list)
             asm_list_append_align_sp(asm_list);
             asm_list_append_syscall(asm_list, -1, 0); // Exit
         }
-        if (bh_str_equal_lit(tac_list.method_name, "copy"))
+        if (bh_str_equal_lit(method_name, "copy"))
         {
             bh_str label_str_1 = asm_list_create_label(asm_list);
             bh_str label_str_2 = asm_list_create_label(asm_list);
 
-            asm_list_append_ld(asm_list, R14, R12, 1);
-            asm_list_append_align_sp(asm_list);
-            asm_list_append(asm_list, (ASMInstr){
-                .op = ASM_OP_ALLOC,
-                .params = {
-                    (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = R13 },
-                    (ASMParam){ .type = ASM_PARAM_REGISTER, .reg = R14 },
-                }
-            });
+            asm_list_append_ld(asm_list, R14, R12, OBJECT_VTABLE);
+            asm_list_append_ld(asm_list, R14, R14, VTABLE_OBJECT_SIZE);
+            asm_list_append_alloc(asm_list, R13, R14, ASM_STACK_MAP_R12_LIVE);
             asm_list_append_push(asm_list, R13);
 
             asm_list_append_label(asm_list, label_str_1);
@@ -1196,45 +1656,40 @@ void asm_from_method(ASMList* asm_list, const TACList tac_list)
             asm_list_append_label(asm_list, label_str_2);
             asm_list_append_pop(asm_list, R13);
         }
-        if (bh_str_equal_lit(tac_list.method_name, "type_name"))
+        if (bh_str_equal_lit(method_name, "type_name"))
         {
             asm_list_append_call_method(asm_list, asm_list->string_class_idx, CONSTRUCTOR_METHOD);
-            asm_list_append_ld(asm_list, R14, R12, 2);
+            asm_list_append_ld(asm_list, R14, R12, OBJECT_VTABLE);
             asm_list_append_ld(asm_list, R14, R14, 0);
-            asm_list_append_st(asm_list, R13, 3, R14);
+            asm_list_append_st(asm_list, R13, OBJECT_ATTRIBUTES, R14);
         }
     }
     else if (bh_str_equal_lit(class_name, "IO"))
     {
-        if (bh_str_equal_lit(tac_list.method_name, "in_int"))
+        if (bh_str_equal_lit(method_name, "in_int"))
         {
-            asm_list_append_call_method(asm_list, asm_list->int_class_idx, CONSTRUCTOR_METHOD);
-            asm_list_append_mov(asm_list, R14, R13);
             asm_list_append_syscall(asm_list, asm_list->io_class_idx, 3);
-            asm_list_append_st(asm_list, R14, 3, R13);
-            asm_list_append_mov(asm_list, R13, R14);
         }
-        if (bh_str_equal_lit(tac_list.method_name, "in_string"))
+        if (bh_str_equal_lit(method_name, "in_string"))
         {
             asm_list_append_call_method(asm_list, asm_list->string_class_idx, CONSTRUCTOR_METHOD);
             asm_list_append_mov(asm_list, R14, R13);
             asm_list_append_align_sp(asm_list);
             asm_list_append_syscall(asm_list, asm_list->io_class_idx, 4);
-            asm_list_append_st(asm_list, R14, 3, R13);
+            asm_list_append_st(asm_list, R14, OBJECT_ATTRIBUTES, R13);
             asm_list_append_mov(asm_list, R13, R14);
         }
-        if (bh_str_equal_lit(tac_list.method_name, "out_int"))
+        if (bh_str_equal_lit(method_name, "out_int"))
         {
-            asm_list_append_ld(asm_list, R14, RBP, 3);
-            asm_list_append_ld(asm_list, R13, R14, 3);
+            asm_list_append_ld(asm_list, R13, RBP, 3);
             asm_list_append_align_sp(asm_list);
             asm_list_append_syscall(asm_list, asm_list->io_class_idx, 5);
             asm_list_append_mov(asm_list, R13, R12);
         }
-        if (bh_str_equal_lit(tac_list.method_name, "out_string"))
+        if (bh_str_equal_lit(method_name, "out_string"))
         {
             asm_list_append_ld(asm_list, R14, RBP, 3);
-            asm_list_append_ld(asm_list, R13, R14, 3);
+            asm_list_append_ld(asm_list, R13, R14, OBJECT_ATTRIBUTES);
             asm_list_append_align_sp(asm_list);
             asm_list_append_syscall(asm_list, asm_list->io_class_idx, 6);
             asm_list_append_mov(asm_list, R13, R12);
@@ -1242,45 +1697,39 @@ void asm_from_method(ASMList* asm_list, const TACList tac_list)
     }
     else if (bh_str_equal_lit(class_name, "String"))
     {
-        if (bh_str_equal_lit(tac_list.method_name, "concat"))
+        if (bh_str_equal_lit(method_name, "concat"))
         {
             asm_list_append_call_method(asm_list, asm_list->string_class_idx, CONSTRUCTOR_METHOD);
             asm_list_append_mov(asm_list, R15, R13);
             asm_list_append_ld(asm_list, R14, RBP, 3);
-            asm_list_append_ld(asm_list, R14, R14, 3);
-            asm_list_append_ld(asm_list, R13, R12, 3);
+            asm_list_append_ld(asm_list, R14, R14, OBJECT_ATTRIBUTES);
+            asm_list_append_ld(asm_list, R13, R12, OBJECT_ATTRIBUTES);
             asm_list_append_mov(asm_list, RDI, R13);
             asm_list_append_mov(asm_list, RSI, R14);
             asm_list_append_align_sp(asm_list);
             asm_list_append_call_method(asm_list, INTERNAL_CLASS, INTERNAL_STRCAT_HANDLER);
             asm_list_append_mov(asm_list, R13, RAX);
-            asm_list_append_st(asm_list, R15, 3, R13);
+            asm_list_append_st(asm_list, R15, OBJECT_ATTRIBUTES, R13);
             asm_list_append_mov(asm_list, R13, R15);
         }
-        if (bh_str_equal_lit(tac_list.method_name, "length"))
+        if (bh_str_equal_lit(method_name, "length"))
         {
-            asm_list_append_call_method(asm_list, asm_list->int_class_idx, CONSTRUCTOR_METHOD);
-            asm_list_append_mov(asm_list, R14, R13);
-            asm_list_append_ld(asm_list, R13, R12, 3);
+            asm_list_append_ld(asm_list, R13, R12, OBJECT_ATTRIBUTES);
             asm_list_append_mov(asm_list, RDI, R13);
             asm_list_append_li(asm_list, RAX, 0, ASMImmediateUnitsBase);
             asm_list_append_align_sp(asm_list);
             asm_list_append_call_method(asm_list, INTERNAL_CLASS, INTERNAL_STRLEN_HANDLER);
             asm_list_append_mov(asm_list, R13, RAX);
-            asm_list_append_st(asm_list, R14, 3, R13);
-            asm_list_append_mov(asm_list, R13, R14);
         }
-        if (bh_str_equal_lit(tac_list.method_name, "substr"))
+        if (bh_str_equal_lit(method_name, "substr"))
         {
             bh_str label_str = asm_list_create_label(asm_list);
 
             asm_list_append_call_method(asm_list, asm_list->string_class_idx, CONSTRUCTOR_METHOD);
             asm_list_append_mov(asm_list, R15, R13);
             asm_list_append_ld(asm_list, R14, RBP, 3);
-            asm_list_append_ld(asm_list, R14, R14, 3);
             asm_list_append_ld(asm_list, R13, RBP, 4);
-            asm_list_append_ld(asm_list, R13, R13, 3);
-            asm_list_append_ld(asm_list, R12, R12, 3);
+            asm_list_append_ld(asm_list, R12, R12, OBJECT_ATTRIBUTES);
             asm_list_append_mov(asm_list, RDI, R12);
             asm_list_append_mov(asm_list, RSI, R13);
             asm_list_append_mov(asm_list, RDX, R14);
@@ -1296,27 +1745,99 @@ void asm_from_method(ASMList* asm_list, const TACList tac_list)
             asm_list_append_syscall(asm_list, INTERNAL_CLASS, 0); // exit
 
             asm_list_append_label(asm_list, label_str);
-            asm_list_append_st(asm_list, R15, 3, R13);
+            asm_list_append_st(asm_list, R15, OBJECT_ATTRIBUTES, R13);
             asm_list_append_mov(asm_list, R13, R15);
         }
     }
-    else
+}
+
+// The callee saved registers a built in method's body names, found by lowering it into a list that's thrown
+// away. The prologue saves whatever this finds, so no body can use one without it being saved.
+static uint32_t asm_builtin_callee_saved(const ASMList* asm_list, const bh_str class_name, const bh_str method_name)
+{
+    ASMList scratch = asm_list_init_method(asm_list, -1);
+    asm_from_builtin_method(&scratch, class_name, method_name);
+    uint32_t callee_saved = 0;
+    for (int64_t i = 0; i < scratch.instruction_count; i++)
     {
-        int64_t extra_symbols = asm_from_tac_list(asm_list, tac_list);
-        if (extra_symbols > 0)
+        for (int p = 0; p < 3; p++)
         {
-            temp_count += extra_symbols;
-            temp_count = temp_count + (temp_count & 1);
+            const ASMParam param = scratch.instructions[i].params[p];
+            if (param.type == ASM_PARAM_REGISTER) callee_saved |= REGISTER_MASK(param.reg.name) & CALLEE_SAVED_REGISTERS;
         }
-        temp_space_instr->params[1].immediate.val = temp_count;
+    }
+    asm_list_deinit_method(&scratch);
+    resizable_arena_deinit(scratch.string_allocator);
+    return callee_saved;
+}
+
+void asm_from_method(ASMList* asm_list, TACList* tac_list)
+{
+    const bh_str class_name = tac_list->class_list.class_nodes[tac_list->class_idx].name;
+
+    // Construct method name
+    int64_t label_len = class_name.len + tac_list->method_name.len + 1;
+    char* label_buf = bh_alloc(asm_list->string_allocator, label_len + 4);
+    strncpy(label_buf, class_name.buf, class_name.len);
+    label_buf[class_name.len] = '.';
+    strncpy(label_buf + class_name.len + 1, tac_list->method_name.buf, tac_list->method_name.len);
+    strncpy(label_buf + class_name.len + tac_list->method_name.len + 1, ".end", 4);
+    asm_list_append_label(asm_list, (bh_str){ .buf = label_buf, .len = label_len });
+    asm_list_append_comment(asm_list, "method definition");
+
+    bool is_builtin = bh_str_equal_lit(class_name, "Object") ||
+        bh_str_equal_lit(class_name, "IO") ||
+        bh_str_equal_lit(class_name, "String");
+    RegisterAllocation allocation = (RegisterAllocation){ 0 };
+    if (!is_builtin)
+    {
+        unbox_tac_list(tac_list);
+        allocation = allocate_registers(tac_list, tac_list->allocator);
+    }
+    else
+    {
+        allocation.callee_saved = asm_builtin_callee_saved(asm_list, class_name, tac_list->method_name);
+    }
+
+    // Setup stack and stuff
+    // asm_list_append_push(asm_list, RA);
+    asm_list_append_push(asm_list, RBP);
+    asm_list_append_mov(asm_list, RBP, RSP);
+    asm_list_append_ld(asm_list, R12, RBP, 2);
+    asm_list_append_comment(asm_list, "stack room for temporaries");
+    const int64_t temp_count = asm_frame_size(allocation.stack_slot_count, allocation.callee_saved);
+    if (temp_count > 0)
+    {
+        asm_list_append_li(asm_list, R14, temp_count, ASMImmediateUnitsWord);
+        asm_list_append_arith(asm_list, ASM_OP_SUB, RSP, R14);
+    }
+    asm_list_append_callee_saved(asm_list, allocation.callee_saved, allocation.stack_slot_count, false);
+    asm_list_append_clear_temporaries(asm_list, allocation.callee_saved, allocation.stack_slot_count);
+
+    asm_list_append_comment(asm_list, "method body begins");
+    if (is_builtin)
+    {
+        asm_from_builtin_method(asm_list, class_name, tac_list->method_name);
+    }
+    else
+    {
+        asm_list->register_allocation = &allocation;
+        asm_from_tac_list(asm_list, *tac_list);
+        asm_list->register_allocation = NULL;
     }
 
     asm_list_append_label(asm_list, (bh_str){ .buf = label_buf, .len = label_len + 4 });
+    asm_list_append_callee_saved(asm_list, allocation.callee_saved, allocation.stack_slot_count, true);
     asm_list_append_mov(asm_list, RSP, RBP);
     asm_list_append_pop(asm_list, RBP);
     asm_list_append_return(asm_list);
 
     asm_list_append_comment(asm_list, ";;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;"); // Spacer
+
+    if (!is_builtin)
+    {
+        register_allocation_deinit(&allocation, tac_list->allocator);
+    }
 }
 
 #pragma endregion
@@ -1381,14 +1902,7 @@ MainData find_maindata(ASMList* asm_list)
             {
                 if (bh_str_equal_lit(class_node.methods[j].name, "main"))
                 {
-                    for (int k = 0; k < asm_list->class_list->class_count; k++)
-                    {
-                        if (bh_str_equal(asm_list->class_list->class_nodes[k].name, class_node.methods[j].inherited_from))
-                        {
-                            main_class_idx = k;
-                            break;
-                        }
-                    }
+                    main_class_idx = class_idx_from_atom(*asm_list->class_list, class_node.methods[j].inherited_from_atom);
                     main_method_idx = j;
                     break;
                 }
@@ -1411,13 +1925,16 @@ void builtin_append_start(ASMList* asm_list)
     asm_list_append_comment(asm_list, "program begins here");
     asm_list_append_label(asm_list, start_str);
     asm_list_append_syscall(asm_list, INTERNAL_CLASS, INTERNAL_COOLALLOC_INIT_HANDLER);
+    asm_list_begin_frame(asm_list, 0, 0);
     asm_list_append_la(asm_list, R14, main_data.main_ctor_idx, -1);
     asm_list_append_push(asm_list, RBP);
     asm_list_append_call(asm_list, R14);
+    asm_list_append_safepoint(asm_list, ASM_STACK_MAP_BOTTOM);
     asm_list_append_push(asm_list, RBP);
-    asm_list_append_push(asm_list, R13);
+    asm_list_append_push_value(asm_list, R13, true);
     asm_list_append_la(asm_list, R14, main_data.main_class_idx, main_data.main_method_idx);
     asm_list_append_call(asm_list, R14);
+    asm_list_append_safepoint(asm_list, ASM_STACK_MAP_BOTTOM);
     asm_list_append_syscall(asm_list, INTERNAL_CLASS, INTERNAL_COOLOUT_FLUSH_HANDLER);
     asm_list_append_syscall(asm_list, -1, 0);
 }
@@ -1649,12 +2166,28 @@ void display_asm_list(bh_str_buf* str_buf, const ASMList asm_list)
             bh_str_buf_append_lit(str_buf, " ");
             display_asm_param(str_buf, class_list, instr.params[2]);
             break;
+        case ASM_OP_BNE:
+            bh_str_buf_append_lit(str_buf, "bne");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            display_asm_param(str_buf, class_list, instr.params[1]);
+            bh_str_buf_append_lit(str_buf, " ");
+            display_asm_param(str_buf, class_list, instr.params[2]);
+            break;
         case ASM_OP_BNZ:
             bh_str_buf_append_lit(str_buf, "bnz");
             display_asm_param(str_buf, class_list, instr.params[0]);
             bh_str_buf_append_lit(str_buf, " ");
             display_asm_param(str_buf, class_list, instr.params[1]);
             break;
+        case ASM_OP_SEQ:
+        case ASM_OP_SLT:
+        case ASM_OP_SLE:
+            bh_str_buf_append_lit(str_buf, instr.op == ASM_OP_SEQ ? "seq" : instr.op == ASM_OP_SLT ? "slt" : "sle");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_lit(str_buf, " <-");
+            display_asm_param(str_buf, class_list, instr.params[1]);
+            display_asm_param(str_buf, class_list, instr.params[2]);
+            break;
         case ASM_OP_ADD:
             bh_str_buf_append_lit(str_buf, "add");
             display_asm_param(str_buf, class_list, instr.params[0]);
@@ -1689,11 +2222,37 @@ void display_asm_list(bh_str_buf* str_buf, const ASMList asm_list)
             bh_str_buf_append_lit(str_buf, " <-");
             display_asm_param(str_buf, class_list, instr.params[1]);
             break;
+        case ASM_OP_SHL:
+        case ASM_OP_SHR:
+            bh_str_buf_append_lit(str_buf, instr.op == ASM_OP_SHL ? "shl" : "shr");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_lit(str_buf, " <-");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            display_asm_param(str_buf, class_list, instr.params[1]);
+            break;
         case ASM_OP_ALLOC:
             bh_str_buf_append_lit(str_buf, "alloc");
             display_asm_param(str_buf, class_list, instr.params[0]);
             display_asm_param(str_buf, class_list, instr.params[1]);
             break;
+        case ASM_OP_BUMP_ALLOC:
+            bh_str_buf_append_lit(str_buf, "bump_alloc");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            display_asm_param(str_buf, class_list, instr.params[1]);
+            break;
+        case ASM_OP_INTERN_INT:
+            bh_str_buf_append_lit(str_buf, "intern_int");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            display_asm_param(str_buf, class_list, instr.params[1]);
+            break;
+        case ASM_OP_INTERN_BOOL:
+            bh_str_buf_append_lit(str_buf, "intern_bool");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            break;
+        case ASM_OP_BARRIER:
+            bh_str_buf_append_lit(str_buf, "barrier");
+            display_asm_param(str_buf, class_list, instr.params[0]);
+            break;
         case ASM_OP_RETURN:
             bh_str_buf_append_lit(str_buf, "return");
             break;
@@ -1968,30 +2527,38 @@ void x86_asm_list(bh_str_buf* str_buf, const ASMList asm_list)
             break;
         case ASM_OP_CALL:
             bh_str_buf_append_lit(str_buf, "call");
+            if (instr.params[0].type == ASM_PARAM_METHOD && instr.params[0].method.class_idx >= 0) // Direct call to a method
+            {
+                const ClassNode class_node = class_list.class_nodes[instr.params[0].method.class_idx];
+                bh_str_buf_append_lit(str_buf, " ");
+                bh_str_buf_append(str_buf, class_node.name);
+                bh_str_buf_append_lit(str_buf, ".");
+                bh_str_buf_append(str_buf, class_node.methods[instr.params[0].method.method_idx].name);
+                break;
+            }
             x86_asm_param(str_buf, class_list, instr.params[0]);
             break;
         case ASM_OP_BEQ:
-            bh_str_buf_append_lit(str_buf, "cmpq");
-            x86_asm_param(str_buf, class_list, instr.params[0]);
-            bh_str_buf_append_lit(str_buf, ",");
-            x86_asm_param(str_buf, class_list, instr.params[1]);
-            bh_str_buf_append_lit(str_buf, "\nje ");
-            x86_asm_param(str_buf, class_list, instr.params[2]);
-            break;
         case ASM_OP_BLT:
-            bh_str_buf_append_lit(str_buf, "cmpq");
-            x86_asm_param(str_buf, class_list, instr.params[0]);
-            bh_str_buf_append_lit(str_buf, ",");
-            x86_asm_param(str_buf, class_list, instr.params[1]);
-            bh_str_buf_append_lit(str_buf, "\njl ");
-            x86_asm_param(str_buf, class_list, instr.params[2]);
-            break;
         case ASM_OP_BLE:
-            bh_str_buf_append_lit(str_buf, "cmpq");
-            x86_asm_param(str_buf, class_list, instr.params[0]);
-            bh_str_buf_append_lit(str_buf, ",");
-            x86_asm_param(str_buf, class_list, instr.params[1]);
-            bh_str_buf_append_lit(str_buf, "\njle ");
+        case ASM_OP_BNE:
+            // Register operands are Ints, Bools or class tags, which are all 32 bit like in the comparison handlers
+            if (instr.params[0].type == ASM_PARAM_REGISTER && instr.params[1].type == ASM_PARAM_REGISTER)
+            {
+                bh_str_buf_append_lit(str_buf, "cmpl");
+                x86_asm_param(str_buf, class_list, instr.params[1]);
+                bh_str_buf_append_lit(str_buf, "d,");
+                x86_asm_param(str_buf, class_list, instr.params[0]);
+                bh_str_buf_append_lit(str_buf, "d");
+            }
+            else
+            {
+                bh_str_buf_append_lit(str_buf, "cmpq");
+                x86_asm_param(str_buf, class_list, instr.params[0]);
+                bh_str_buf_append_lit(str_buf, ",");
+                x86_asm_param(str_buf, class_list, instr.params[1]);
+            }
+            bh_str_buf_append_lit(str_buf, instr.op == ASM_OP_BEQ ? "\nje " : instr.op == ASM_OP_BLT ? "\njl " : instr.op == ASM_OP_BLE ? "\njle " : "\njne ");
             x86_asm_param(str_buf, class_list, instr.params[2]);
             break;
         case ASM_OP_BNZ:
@@ -2000,6 +2567,18 @@ void x86_asm_list(bh_str_buf* str_buf, const ASMList asm_list)
             bh_str_buf_append_lit(str_buf, "\n jne ");
             x86_asm_param(str_buf, class_list, instr.params[1]);
             break;
+        case ASM_OP_SEQ:
+        case ASM_OP_SLT:
+        case ASM_OP_SLE:
+            // Ints are 32 bit, same as the comparison handlers
+            bh_str_buf_append_lit(str_buf, "cmpl");
+            x86_asm_param(str_buf, class_list, instr.params[2]);
+            bh_str_buf_append_lit(str_buf, "d,");
+            x86_asm_param(str_buf, class_list, instr.params[1]);
+            bh_str_buf_append_lit(str_buf, instr.op == ASM_OP_SEQ ? "d\nsete %al" : instr.op == ASM_OP_SLT ? "d\nsetl %al" : "d\nsetle %al");
+            bh_str_buf_append_lit(str_buf, "\nmovzbq %al,");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            break;
         case ASM_OP_ADD:
             bh_str_buf_append_lit(str_buf, "addq");
             x86_asm_param(str_buf, class_list, instr.params[1]);
@@ -2035,13 +2614,59 @@ void x86_asm_list(bh_str_buf* str_buf, const ASMList asm_list)
             bh_str_buf_append_lit(str_buf, ",");
             x86_asm_param(str_buf, class_list, instr.params[0]);
             break;
+        case ASM_OP_SHL:
+            bh_str_buf_append_lit(str_buf, "shll");
+            x86_asm_param(str_buf, class_list, instr.params[1]);
+            bh_str_buf_append_lit(str_buf, ",");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_lit(str_buf, "d");
+            break;
+        case ASM_OP_SHR:
+            // Negative values get 2^k - 1 added first so the shift truncates like idivl does
+            bh_str_buf_append_lit(str_buf, "movl");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_format(str_buf, "d, %%eax\nsarl $31, %%eax\nshrl $%i, %%eax\naddl %%eax,", (int)(32 - instr.params[1].immediate.val));
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_lit(str_buf, "d\nsarl");
+            x86_asm_param(str_buf, class_list, instr.params[1]);
+            bh_str_buf_append_lit(str_buf, ",");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_lit(str_buf, "d");
+            break;
         case ASM_OP_ALLOC:
             bh_str_buf_append_lit(str_buf, "## guarantee 16-byte alignment before call\nandq $0xFFFFFFFFFFFFFFF0, %rsp\n");
             bh_str_buf_append_lit(str_buf, "movq");
             x86_asm_param(str_buf, class_list, instr.params[1]);
-            bh_str_buf_append_lit(str_buf, ", %rdi\ncall coolalloc\nmovq %rax,");
+            bh_str_buf_append_lit(str_buf, ", %rdi\ncall coolalloc");
+            break;
+        case ASM_OP_BUMP_ALLOC:
+            // Same fast path as coolalloc in runtime/coolalloc.c
+            bh_str_buf_append_format(str_buf, "movq %%fs:coolgc_tlab_top@tpoff, %%rax\nleaq %i(%%rax), %%rdx\n", (int)(instr.params[0].immediate.val * 8));
+            bh_str_buf_append_lit(str_buf, "cmpq %fs:coolgc_tlab_limit@tpoff, %rdx\nja ");
+            x86_asm_param(str_buf, class_list, instr.params[1]);
+            bh_str_buf_append_lit(str_buf, "\nmovq %rdx, %fs:coolgc_tlab_top@tpoff");
+            break;
+        case ASM_OP_INTERN_INT:
+            // Only the low 32 bits of a raw Int are meaningful, the unsigned compare checks both ends of the range
+            bh_str_buf_append_lit(str_buf, "movq");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_format(str_buf, ", %%rax\naddl $%i, %%eax\ncmpl $%i, %%eax\nja ", -INTERNED_INT_MIN, INTERNED_INT_MAX - INTERNED_INT_MIN);
+            x86_asm_param(str_buf, class_list, instr.params[1]);
+            bh_str_buf_append_lit(str_buf, "\nshlq $4, %rax\nleaq int_constants(%rax),");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            break;
+        case ASM_OP_INTERN_BOOL:
+            bh_str_buf_append_lit(str_buf, "shlq $4,");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_lit(str_buf, "\naddq $bool_constants,");
             x86_asm_param(str_buf, class_list, instr.params[0]);
             break;
+        case ASM_OP_BARRIER:
+            // The shift has to match CARD_SHIFT in runtime/coolalloc.c
+            bh_str_buf_append_lit(str_buf, "movq");
+            x86_asm_param(str_buf, class_list, instr.params[0]);
+            bh_str_buf_append_lit(str_buf, ", %rax\nshrq $9, %rax\naddq coolgc_card_bias(%rip), %rax\nmovb $1, (%rax)");
+            break;
         case ASM_OP_RETURN:
             bh_str_buf_append_lit(str_buf, "ret");
             break;
@@ -2053,38 +2678,58 @@ void x86_asm_list(bh_str_buf* str_buf, const ASMList asm_list)
     }
 }
 
+// Read by the collector in runtime/coolalloc.c, which checks the version before trusting the layout.
+// The maps get their own read-only section so they can be found or stripped as a unit.
+void x86_stack_maps(bh_str_buf* str_buf, const ASMList asm_list)
+{
+    bh_str_buf_append_lit(str_buf, "## stack maps\n.section .rodata.coolgc_stack_maps, \"a\"\n.p2align 3\n");
+    bh_str_buf_append_format(str_buf, ".globl coolgc_stack_map_version\ncoolgc_stack_map_version:\n.quad %i\n", ASM_STACK_MAP_VERSION);
+    bh_str_buf_append_format(str_buf, ".globl coolgc_stack_map_count\ncoolgc_stack_map_count:\n.quad %i\n", (int)asm_list.stack_map_count);
+    bh_str_buf_append_lit(str_buf, ".globl coolgc_stack_maps\ncoolgc_stack_maps:\n");
+    for (int64_t i = 0; i < asm_list.stack_map_count; i++)
+    {
+        const ASMStackMap map = asm_list.stack_maps[i];
+        bh_str_buf_append_lit(str_buf, ".quad ");
+        bh_str_buf_append(str_buf, map.label);
+        bh_str_buf_append_format(str_buf, "\n.long %i\n.short %i, %i\n.long %i\n.short %i, %i\n",
+            (int)map.flags, (int)map.rbx_slot, (int)map.r15_slot, (int)map.first_offset, (int)map.slot_count, (int)map.outgoing_count);
+    }
+    bh_str_buf_append_lit(str_buf, ".globl coolgc_stack_map_offsets\ncoolgc_stack_map_offsets:\n");
+    for (int64_t i = 0; i < asm_list.stack_map_offset_count; i++)
+    {
+        bh_str_buf_append_format(str_buf, ".short %i\n", (int)asm_list.stack_map_offsets[i]);
+    }
+    bh_str_buf_append_lit(str_buf, ".short 0\n.text\n");
+}
+
 #pragma endregion
 
-ASMList asm_list_init(ClassNodeList* class_list)
+static ASMList asm_list_alloc(ClassNodeList* class_list)
 {
-    int64_t base_capacity = 100;
-#ifdef WIN32
-    ASMInstr* data = VirtualAlloc(NULL, 100000000000, MEM_RESERVE, PAGE_NOACCESS);
-    VirtualAlloc(data, base_capacity * sizeof(ASMInstr), MEM_COMMIT, PAGE_READWRITE);
-    ASMErrorStr* error_strs = VirtualAlloc(NULL, 1000 * sizeof(ASMErrorStr), MEM_RESERVE, PAGE_NOACCESS);
-    VirtualAlloc(error_strs, base_capacity * sizeof(ASMErrorStr), MEM_COMMIT, PAGE_READWRITE);
-    ASMCaseBinding* case_bindings = VirtualAlloc(NULL, 80 * sizeof(ASMCaseBinding), MEM_RESERVE, PAGE_NOACCESS);
-    VirtualAlloc(case_bindings, 10 * sizeof(ASMCaseBinding), MEM_COMMIT, PAGE_READWRITE);
-#else
-    ASMInstr* data = mmap(NULL, 100000000000, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    mprotect(data, base_capacity * sizeof(ASMInstr), PROT_READ | PROT_WRITE);
-    ASMErrorStr* error_strs = mmap(NULL, 1000 * sizeof(ASMErrorStr), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    mprotect(error_strs, base_capacity * sizeof(ASMErrorStr), PROT_READ | PROT_WRITE);
-    ASMCaseBinding* case_bindings = mmap(NULL, 80 * sizeof(ASMCaseBinding), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    mprotect(case_bindings, 10 * sizeof(ASMCaseBinding), PROT_READ | PROT_WRITE);
-#endif
-    ASMList list = (ASMList){
+    const int64_t base_capacity = 100;
+    return (ASMList){
         .instruction_capacity = base_capacity,
-        .instructions = data,
+        .instructions = bh_alloc(GPA, base_capacity * sizeof(ASMInstr)),
         .instruction_count = 0,
-        .error_strs = error_strs,
+        .error_strs = bh_alloc(GPA, base_capacity * sizeof(ASMErrorStr)),
         .error_str_count = 0,
         .error_str_capacity = base_capacity,
         .class_list = class_list,
-        .case_bindings = case_bindings,
+        .case_bindings = bh_alloc(GPA, 10 * sizeof(ASMCaseBinding)),
         .case_binding_count = 0,
-        .case_binding_capacity = 10
+        .case_binding_capacity = 10,
+        .stack_maps = bh_alloc(GPA, base_capacity * sizeof(ASMStackMap)),
+        .stack_map_capacity = base_capacity,
+        .stack_map_offsets = bh_alloc(GPA, base_capacity * sizeof(int64_t)),
+        .stack_map_offset_capacity = base_capacity,
+        .pushed_objects = bh_alloc(GPA, base_capacity * sizeof(bool)),
+        .pushed_capacity = base_capacity
     };
+}
+
+ASMList asm_list_init(ClassNodeList* class_list)
+{
+    ASMList list = asm_list_alloc(class_list);
 
     int64_t bool_class_idx = -1;
     int64_t io_class_idx = -1;
@@ -2104,16 +2749,79 @@ ASMList asm_list_init(ClassNodeList* class_list)
     list.io_class_idx = io_class_idx;
     list.int_class_idx = int_class_idx;
     list.string_class_idx = string_class_idx;
+    list.class_hierarchy = class_hierarchy_init(*class_list, GPA);
+
+    return list;
+}
 
+// A list one method is lowered into on its own, sharing the program's class data. Its numbered labels
+// start with m<method>_ so they stay unique once the list is appended to the program.
+ASMList asm_list_init_method(const ASMList* program, const int64_t method)
+{
+    ASMList list = asm_list_alloc(program->class_list);
+    list.string_allocator = resizable_arena_init(GPA, METHOD_STRING_ARENA_SIZE);
+    bh_str_buf prefix_buf = bh_str_buf_init(list.string_allocator, 24);
+    bh_str_buf_append_format(&prefix_buf, "m%lld_", (long long)method);
+    list.label_prefix = (bh_str){ .buf = prefix_buf.buf, .len = prefix_buf.len };
+    list.class_hierarchy = program->class_hierarchy;
+    list.bool_class_idx = program->bool_class_idx;
+    list.int_class_idx = program->int_class_idx;
+    list.io_class_idx = program->io_class_idx;
+    list.string_class_idx = program->string_class_idx;
     return list;
 }
 
+// Strings stay behind in the method's arena, the instructions copied out of it still point at them
+void asm_list_deinit_method(ASMList* asm_list)
+{
+    bh_free(GPA, asm_list->instructions);
+    bh_free(GPA, asm_list->error_strs);
+    bh_free(GPA, asm_list->case_bindings);
+    bh_free(GPA, asm_list->stack_maps);
+    bh_free(GPA, asm_list->stack_map_offsets);
+    bh_free(GPA, asm_list->pushed_objects);
+}
+
+// Appends a method lowered into its own list. Its labels are already unique, only the stack map offsets move.
+void asm_list_append_method_list(ASMList* asm_list, const ASMList* method_list)
+{
+    for (int64_t i = 0; i < method_list->instruction_count; i++)
+    {
+        asm_list_append(asm_list, method_list->instructions[i]);
+    }
+    for (int64_t i = 0; i < method_list->error_str_count; i++)
+    {
+        const ASMErrorStr error_str = method_list->error_strs[i];
+        asm_list_append_error_str(asm_list, error_str.label, error_str.message);
+    }
+
+    const int64_t offset_base = asm_list->stack_map_offset_count;
+    while (asm_list->stack_map_offset_count + method_list->stack_map_offset_count >= asm_list->stack_map_offset_capacity)
+    {
+        asm_list->stack_map_offset_capacity *= 2;
+        asm_list->stack_map_offsets = bh_realloc(GPA, asm_list->stack_map_offsets, asm_list->stack_map_offset_capacity * sizeof(int64_t));
+    }
+    memcpy(&asm_list->stack_map_offsets[offset_base], method_list->stack_map_offsets, method_list->stack_map_offset_count * sizeof(int64_t));
+    asm_list->stack_map_offset_count += method_list->stack_map_offset_count;
+    while (asm_list->stack_map_count + method_list->stack_map_count >= asm_list->stack_map_capacity)
+    {
+        asm_list->stack_map_capacity *= 2;
+        asm_list->stack_maps = bh_realloc(GPA, asm_list->stack_maps, asm_list->stack_map_capacity * sizeof(ASMStackMap));
+    }
+    for (int64_t i = 0; i < method_list->stack_map_count; i++)
+    {
+        ASMStackMap map = method_list->stack_maps[i];
+        map.first_offset += offset_base;
+        asm_list->stack_maps[asm_list->stack_map_count++] = map;
+    }
+}
+
 void fill_call_data_from_list(TACList list, CallData* call_data, int64_t total_method_count)
 {
     ClassNodeList class_list = list.class_list;
     for (int k = 0; k < list.count; k++)
     {
-        if (list.items[k].operation == TAC_OP_CALL)
+        if (list.items[k].operation == TAC_OP_CALL && list.items[k].rhs1.type == TAC_SYMBOL_TYPE_METHOD)
         {
             int64_t target_class = list.items[k].rhs1.method.class_idx;
             int64_t target_method = list.items[k].rhs1.method.method_idx;
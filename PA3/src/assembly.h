@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 #include "allocator.h"
+#include "class_hierarchy.h"
 #include "tac.h"
 
 #define CONSTRUCTOR_METHOD (-1)
@@ -25,6 +26,21 @@
 #define INTERNAL_COOLALLOC_INIT_HANDLER (-9)
 #define INTERNAL_COOLOUT_FLUSH_HANDLER (-10)
 
+// Objects are a vtable pointer followed by their attributes (or the Int/Bool/String payload),
+// the class tag and object size are stored in the two words in front of the vtable label
+#define OBJECT_VTABLE 0
+#define OBJECT_ATTRIBUTES 1
+#define VTABLE_CLASS_TAG (-2)
+#define VTABLE_OBJECT_SIZE (-1)
+
+// Boxed Ints in this range and both Bools are preallocated by asm_from_interned_constants, Ints and Bools
+// are immutable so every box of the same value can share one object
+#define INTERNED_INT_MIN (-128)
+#define INTERNED_INT_MAX 1023
+
+// Starting size of the string arena a method lowered on its own gets
+#define METHOD_STRING_ARENA_SIZE (16 * 1024)
+
 typedef enum ASMOpType
 {
     ASM_OP_NULL,
@@ -38,17 +54,27 @@ typedef enum ASMOpType
     ASM_OP_SYSCALL,
     ASM_OP_RETURN,
     ASM_OP_ALLOC,
+    ASM_OP_BUMP_ALLOC,
+    ASM_OP_INTERN_INT,
+    ASM_OP_INTERN_BOOL,
+    ASM_OP_BARRIER,
     ASM_OP_ST,
     ASM_OP_JMP,
     ASM_OP_BEQ,
     ASM_OP_BLT,
     ASM_OP_BLE,
+    ASM_OP_BNE,
     ASM_OP_BNZ,
+    ASM_OP_SEQ,
+    ASM_OP_SLT,
+    ASM_OP_SLE,
     ASM_OP_ADD,
     ASM_OP_SUB,
     ASM_OP_MUL,
     ASM_OP_DIV,
     ASM_OP_AND,
+    ASM_OP_SHL,
+    ASM_OP_SHR, // Arithmetic shift that rounds toward zero, so it matches DIV by a power of two
     ASM_OP_LABEL,
     ASM_OP_CONSTANT,
     ASM_OP_COMMENT,
@@ -121,6 +147,25 @@ typedef struct ASMErrorStr
     bh_str message;
 } ASMErrorStr;
 
+#define ASM_STACK_MAP_VERSION 1 // Bump whenever the layout x86_stack_maps emits changes
+
+#define ASM_STACK_MAP_RBX_LIVE 1
+#define ASM_STACK_MAP_R15_LIVE 2
+#define ASM_STACK_MAP_R12_LIVE 4 // Only for calls into coolalloc, everything else gets r12 pushed
+#define ASM_STACK_MAP_BOTTOM 8 // The call is made from start, there are no frames above it
+
+// Where the collector finds the objects a frame still needs while the call returning to label runs
+typedef struct ASMStackMap
+{
+    bh_str label;
+    uint32_t flags;
+    int64_t rbx_slot; // Words below RBP the frame saved its caller's rbx and r15 at, 0 if it didn't
+    int64_t r15_slot;
+    int64_t first_offset; // Index into stack_map_offsets, the slots come first then the outgoing words
+    int64_t slot_count; // Words below RBP holding objects
+    int64_t outgoing_count; // Words above the callee's RBP holding objects pushed for the call
+} ASMStackMap;
+
 typedef struct ASMCaseBinding
 {
     bh_str name;
@@ -132,10 +177,11 @@ typedef struct ASMList
     ASMInstr* instructions;
     int64_t instruction_count;
     int64_t instruction_capacity;
-    bh_allocator tac_allocator;
+    bh_allocator tac_allocator; // Resizable arena for attribute initializers, reset after each constructor
     bh_allocator string_allocator;
 
     ClassNodeList* class_list;
+    ClassHierarchy class_hierarchy;
     int64_t bool_class_idx;
     int64_t int_class_idx;
     int64_t io_class_idx;
@@ -149,10 +195,35 @@ typedef struct ASMList
     int64_t case_binding_count;
     int64_t case_binding_capacity;
 
+    // Locations of the temporaries of the TAC list being emitted
+    const struct RegisterAllocation* register_allocation;
+
+    ASMStackMap* stack_maps;
+    int64_t stack_map_count;
+    int64_t stack_map_capacity;
+    int64_t* stack_map_offsets;
+    int64_t stack_map_offset_count;
+    int64_t stack_map_offset_capacity;
+
+    // Objects the expression being emitted keeps across its calls
+    int64_t* live_slots;
+    int64_t live_slot_count;
+    uint32_t live_registers;
+
+    // Words pushed since the prologue, and whether each holds an object
+    bool* pushed_objects;
+    int64_t pushed_count;
+    int64_t pushed_capacity;
+
+    uint32_t frame_callee_saved;
+    int64_t frame_stack_slot_count;
+
     int64_t _stack_depth;
     int64_t _global_label;
     int64_t _error_label;
     int64_t _string_counter;
+    int64_t _safepoint_label;
+    bh_str label_prefix; // Only set on a method's own list, see asm_list_init_method
 } ASMList;
 
 typedef struct MainData
@@ -172,15 +243,21 @@ typedef struct CallData
 
 MainData find_maindata(ASMList* asm_list);
 void asm_from_vtable(ASMList* asm_list);
+void asm_from_interned_constants(ASMList* asm_list);
+bool asm_int_is_interned(int64_t value);
 void asm_list_append_call_method(ASMList* asm_list, int64_t class_idx, int64_t method_idx);
 void asm_from_constructor(ASMList* asm_list, ClassNode class_node, int64_t class_idx, CallData* call_data, int64_t total_method_count);
 int64_t asm_from_tac_list(ASMList* asm_list, TACList tac_list);
 void asm_from_method_stub(ASMList* asm_list, TACList tac_list);
-void asm_from_method(ASMList* asm_list, TACList tac_list);
+void asm_from_method(ASMList* asm_list, TACList* tac_list);
 ASMList asm_list_init(ClassNodeList* class_list);
+ASMList asm_list_init_method(const ASMList* program, int64_t method);
+void asm_list_deinit_method(ASMList* asm_list);
+void asm_list_append_method_list(ASMList* asm_list, const ASMList* method_list);
 
 void display_asm_list(bh_str_buf* str_buf, ASMList asm_list);
 void x86_asm_list(bh_str_buf* str_buf, ASMList asm_list);
+void x86_stack_maps(bh_str_buf* str_buf, ASMList asm_list);
 
 void builtin_append_string_helpers(bh_str_buf* buf);
 void builtin_append_string_constants(ASMList* asm_list);
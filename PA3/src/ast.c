@@ -7,6 +7,7 @@
 #include <alloca.h>
 #include <assert.h>
 #include <stddef.h>
+#include <string.h>
 
 ClassNodeList parse_class_map(bh_str* str, bh_allocator allocator)
 {
@@ -24,6 +25,7 @@ ClassNodeList parse_class_map(bh_str* str, bh_allocator allocator)
     {
         bh_str class_name = eat_until_newline(str);
         list.class_nodes[i].name = class_name;
+        list.class_nodes[i].name_atom = bh_atom_from_str(class_name);
         int attribute_count = eat_uint_until_newline(str);
         list.class_nodes[i].attribute_count = attribute_count;
         list.class_nodes[i].attributes = bh_alloc(allocator, attribute_count * sizeof(ClassAttribute));
@@ -33,7 +35,9 @@ ClassNodeList parse_class_map(bh_str* str, bh_allocator allocator)
             bh_str attribute_name = eat_until_newline(str);
             bh_str type_name = eat_until_newline(str);
             list.class_nodes[i].attributes[j].name = attribute_name;
+            list.class_nodes[i].attributes[j].name_atom = bh_atom_from_str(attribute_name);
             list.class_nodes[i].attributes[j].type = type_name;
+            list.class_nodes[i].attributes[j].type_atom = bh_atom_from_str(type_name);
             if (bh_str_equal_lit(initializer_status, "initializer"))
             {
                 CoolExpression expression = parse_expression(str, allocator);
@@ -64,6 +68,7 @@ void parse_implementation_map(bh_str* str, bh_allocator allocator, ClassNodeList
         {
             bh_str method_name = eat_until_newline(str);
             list.class_nodes[i].methods[j].name = method_name;
+            list.class_nodes[i].methods[j].name_atom = bh_atom_from_str(method_name);
             int formal_count = eat_uint_until_newline(str);
             list.class_nodes[i].methods[j].parameter_count = formal_count;
             list.class_nodes[i].methods[j].parameters = bh_alloc(allocator, sizeof(ClassMethodParameter) * formal_count);
@@ -71,15 +76,75 @@ void parse_implementation_map(bh_str* str, bh_allocator allocator, ClassNodeList
             {
                 bh_str formal_name = eat_until_newline(str);
                 list.class_nodes[i].methods[j].parameters[k].name = formal_name;
+                list.class_nodes[i].methods[j].parameters[k].name_atom = bh_atom_from_str(formal_name);
             }
             bh_str inherited_from = eat_until_newline(str);
             list.class_nodes[i].methods[j].inherited_from = inherited_from;
+            list.class_nodes[i].methods[j].inherited_from_atom = bh_atom_from_str(inherited_from);
             CoolExpression expression = parse_expression(str, allocator);
             list.class_nodes[i].methods[j].body = expression;
         }
     }
 }
 
+static uint64_t class_index_hash(const uint64_t key)
+{
+    uint64_t hash = key * 0x9e3779b97f4a7c15;
+    return hash ^ (hash >> 29);
+}
+
+static void class_index_insert(ClassNodeList* list, const uint64_t key, const int64_t value)
+{
+    uint64_t slot = class_index_hash(key) & (list->index_capacity - 1);
+    while (list->index[slot].key != 0 && list->index[slot].key != key) slot = (slot + 1) & (list->index_capacity - 1);
+    // The implementation map can list a name twice, the first one is what the linear scans used to find
+    if (list->index[slot].key == key) return;
+    list->index[slot] = (ClassIndexEntry){ .key = key, .value = value };
+}
+
+static int64_t class_index_find(const ClassNodeList list, const uint64_t key)
+{
+    if (list.index_capacity == 0) return -1;
+    uint64_t slot = class_index_hash(key) & (list.index_capacity - 1);
+    while (list.index[slot].key != 0)
+    {
+        if (list.index[slot].key == key) return list.index[slot].value;
+        slot = (slot + 1) & (list.index_capacity - 1);
+    }
+    return -1;
+}
+
+// Needs the implementation map, so it goes right after parse_implementation_map
+void build_class_index(ClassNodeList* list, bh_allocator allocator)
+{
+    int64_t entry_count = list->class_count;
+    for (int i = 0; i < list->class_count; i++) entry_count += list->class_nodes[i].method_count;
+    list->index_capacity = 16;
+    while (list->index_capacity < entry_count * 2) list->index_capacity *= 2;
+    list->index = bh_alloc(allocator, sizeof(ClassIndexEntry) * list->index_capacity);
+    memset(list->index, 0, sizeof(ClassIndexEntry) * list->index_capacity);
+
+    for (int i = 0; i < list->class_count; i++)
+    {
+        const ClassNode class_node = list->class_nodes[i];
+        class_index_insert(list, class_node.name_atom, i);
+        for (int j = 0; j < class_node.method_count; j++)
+        {
+            class_index_insert(list, (uint64_t)(i + 1) << 32 | class_node.methods[j].name_atom, j);
+        }
+    }
+}
+
+int64_t class_idx_from_atom(const ClassNodeList list, const bh_atom name)
+{
+    return class_index_find(list, name);
+}
+
+int64_t method_idx_from_atom(const ClassNodeList list, const int64_t class_idx, const bh_atom name)
+{
+    return class_index_find(list, (uint64_t)(class_idx + 1) << 32 | name);
+}
+
 void parse_parent_map(bh_str* str, bh_allocator allocator, ClassNodeList list)
 {
     bh_str parent_map_word = eat_until_newline(str);
@@ -89,25 +154,77 @@ void parse_parent_map(bh_str* str, bh_allocator allocator, ClassNodeList list)
 
     for (int i = 0; i < relation_count; i++)
     {
-        bh_str child_name = eat_until_newline(str);
-        bh_str parent_name = eat_until_newline(str);
+        const int64_t child_idx = class_idx_from_atom(list, bh_atom_from_str(eat_until_newline(str)));
+        const int64_t parent_idx = class_idx_from_atom(list, bh_atom_from_str(eat_until_newline(str)));
+        if (child_idx == -1) continue;
+        list.class_nodes[child_idx].parent = &list.class_nodes[parent_idx != -1 ? parent_idx : 0];
+    }
+}
 
-        for (int j = 0; j < list.class_count; j++)
+typedef struct BuiltinSignature
+{
+    const char* class_name;
+    const char* method_name;
+    const char* return_type;
+    const char* parameter_types[2];
+} BuiltinSignature;
+
+static const BuiltinSignature builtin_signatures[] = {
+    { "Object", "abort", "Object", { 0 } },
+    { "Object", "type_name", "String", { 0 } },
+    { "Object", "copy", "SELF_TYPE", { 0 } },
+    { "IO", "out_string", "SELF_TYPE", { "String" } },
+    { "IO", "out_int", "SELF_TYPE", { "Int" } },
+    { "IO", "in_string", "String", { 0 } },
+    { "IO", "in_int", "Int", { 0 } },
+    { "String", "length", "Int", { 0 } },
+    { "String", "concat", "String", { "String" } },
+    { "String", "substr", "String", { "Int", "Int" } },
+};
+
+// The implementation map only names formals, the declared types come from the annotated AST that follows it
+void parse_method_signatures(bh_str* str, bh_allocator allocator, ClassNodeList list)
+{
+    const CoolAST ast = parse_ast(str, allocator);
+
+    for (int i = 0; i < list.class_count; i++)
+    {
+        for (int j = 0; j < list.class_nodes[i].method_count; j++)
         {
-            if (bh_str_equal(list.class_nodes[j].name, child_name))
+            ClassMethod* method = &list.class_nodes[i].methods[j];
+            bool found = false;
+            for (int k = 0; k < ast.class_count && !found; k++)
             {
-                int64_t parent_idx = 0;
-                for (int k = 0; k < list.class_count; k++)
+                if (ast.classes[k].name.name_atom != method->inherited_from_atom) continue;
+                for (int l = 0; l < ast.classes[k].feature_count; l++)
                 {
-                    if (bh_str_equal(list.class_nodes[k].name, parent_name))
+                    const CoolFeature feature = ast.classes[k].features[l];
+                    if (!feature.is_method || feature.name.name_atom != method->name_atom) continue;
+                    method->return_type = feature.type_name.name;
+                    method->return_type_atom = feature.type_name.name_atom;
+                    for (int p = 0; p < method->parameter_count && p < feature.formal_count; p++)
                     {
-                        parent_idx = k;
-                        break;
+                        method->parameters[p].type = feature.formals[p].type_name.name;
+                        method->parameters[p].type_atom = feature.formals[p].type_name.name_atom;
                     }
+                    found = true;
+                    break;
+                }
+            }
+            for (int k = 0; k < sizeof(builtin_signatures) / sizeof(builtin_signatures[0]) && !found; k++)
+            {
+                if (!bh_str_equal_lit(method->inherited_from, builtin_signatures[k].class_name)) continue;
+                if (!bh_str_equal_lit(method->name, builtin_signatures[k].method_name)) continue;
+                method->return_type = bh_str_from_cstr(builtin_signatures[k].return_type);
+                method->return_type_atom = bh_atom_from_str(method->return_type);
+                for (int p = 0; p < method->parameter_count; p++)
+                {
+                    method->parameters[p].type = bh_str_from_cstr(builtin_signatures[k].parameter_types[p]);
+                    method->parameters[p].type_atom = bh_atom_from_str(method->parameters[p].type);
                 }
-                list.class_nodes[j].parent = &list.class_nodes[parent_idx];
-                break;
+                found = true;
             }
+            assert(found && "Method has no declaration in the annotated AST");
         }
     }
 }
@@ -157,6 +274,7 @@ CoolIdentifier parse_identifier(bh_str* str)
     CoolIdentifier identifier = (CoolIdentifier){ .type = COOL_NODE_TYPE_IDENTIFIER };
     identifier.line_num = eat_uint_until_newline(str);
     identifier.name = eat_until_newline(str);
+    identifier.name_atom = bh_atom_from_str(identifier.name);
     return identifier;
 }
 
@@ -209,12 +327,14 @@ CoolExpression parse_expression(bh_str* str, bh_allocator allocator)
     bh_str_eat_chars(*str, line_num_str.len + 1);
 
     expression.expression_typename = eat_until_newline(str);
+    expression.expression_typename_atom = bh_atom_from_str(expression.expression_typename);
 
     bh_str name_str = eat_until_newline(str);
 
     if (bh_str_equal_lit(name_str, "internal"))
     {
         expression.data.internal.method = eat_until_newline(str);
+        expression.data.internal.method_atom = bh_atom_from_str(expression.data.internal.method);
         expression.expression_type = COOL_EXPR_TYPE_INTERNAL;
         return expression;
     }
@@ -386,13 +506,13 @@ CoolExpression parse_expression(bh_str* str, bh_allocator allocator)
 // Checks if subclass is a subtype of the parent class. Is not called directly and does not support SELF_TYPE directly
 bool is_class_subtype_of(ClassNode subclass, ClassNode parent_class)
 {
-    if (bh_str_equal(subclass.name, parent_class.name)) return true;
+    if (subclass.name_atom == parent_class.name_atom) return true;
 
     // Walk through the subclass's parents until we find the parent class
     ClassNode* parent = subclass.parent;
     while (parent != NULL)
     {
-        if (bh_str_equal(parent->name, parent_class.name))
+        if (parent->name_atom == parent_class.name_atom)
         {
             return true;
         }
@@ -66,6 +66,7 @@ typedef struct CoolIdentifier
     CoolNodeType type;
     uint64_t line_num;
     bh_str name;
+    bh_atom name_atom;
 } CoolIdentifier;
 
 typedef struct CoolFormal
@@ -96,12 +97,13 @@ typedef struct CoolExpression {
     CoolExpressionType expression_type;
     int64_t line_num;
     bh_str expression_typename;
+    bh_atom expression_typename_atom;
     union {
         struct { CoolIdentifier var; struct CoolExpression* rhs; } assign;
         struct { CoolIdentifier method; uint16_t args_length; struct CoolExpression* args; struct CoolExpression* e; } dynamic_dispatch;
         struct { CoolIdentifier method; uint16_t args_length; struct CoolExpression* args; struct CoolExpression* e; CoolIdentifier type_name; } static_dispatch;
         struct { CoolIdentifier method; uint16_t args_length; struct CoolExpression* args; } self_dispatch;
-        struct { bh_str method; } internal;
+        struct { bh_str method; bh_atom method_atom; } internal;
         struct { struct CoolExpression* predicate; struct CoolExpression* then_branch; struct CoolExpression* else_branch; } if_expr;
         struct { struct CoolExpression* predicate; struct CoolExpression* body; } while_expr;
         struct { uint64_t body_length; struct CoolExpression* body; } block;
@@ -156,22 +158,29 @@ CoolExpression parse_expression(bh_str* str, bh_allocator allocator);
 typedef struct ClassAttribute
 {
     bh_str name;
+    bh_atom name_atom;
     bh_str type;
+    bh_atom type_atom;
     CoolExpression expr;
 } ClassAttribute;
 
 typedef struct ClassMethodParameter
 {
     bh_str name;
+    bh_atom name_atom;
     bh_str type;
+    bh_atom type_atom;
 } ClassMethodParameter;
 
 typedef struct ClassMethod
 {
     bh_str name;
+    bh_atom name_atom;
     int64_t name_line_num;
     bh_str inherited_from;
+    bh_atom inherited_from_atom;
     bh_str return_type;
+    bh_atom return_type_atom;
     int16_t parameter_count;
     ClassMethodParameter* parameters;
     CoolExpression body;
@@ -180,6 +189,7 @@ typedef struct ClassMethod
 typedef struct ClassNode
 {
     bh_str name;
+    bh_atom name_atom;
     struct ClassNode* parent;
 
     int16_t attribute_count;
@@ -194,15 +204,29 @@ typedef struct ClassNode
     bool methods_filled;
 } ClassNode;
 
+// Open addressing over (class, name) keys. Class names are keyed under class 0 and methods under their
+// class_idx + 1, so one table covers both.
+typedef struct ClassIndexEntry
+{
+    uint64_t key;
+    int64_t value;
+} ClassIndexEntry;
+
 typedef struct ClassNodeList
 {
     int16_t class_count;
     ClassNode* class_nodes;
+    ClassIndexEntry* index;
+    int64_t index_capacity;
 } ClassNodeList;
 
 ClassNodeList parse_class_map(bh_str* str, bh_allocator allocator);
 void parse_implementation_map(bh_str* str, bh_allocator allocator, ClassNodeList list);
+void build_class_index(ClassNodeList* list, bh_allocator allocator);
+int64_t class_idx_from_atom(ClassNodeList list, bh_atom name);
+int64_t method_idx_from_atom(ClassNodeList list, int64_t class_idx, bh_atom name);
 void parse_parent_map(bh_str* str, bh_allocator allocator, ClassNodeList list);
+void parse_method_signatures(bh_str* str, bh_allocator allocator, ClassNodeList list);
 bool is_class_subtype_of(ClassNode subclass, ClassNode parent_class);
 ClassNode class_node_from_id(ClassNodeList list, int64_t id);
 
@@ -0,0 +1,88 @@
+#include "class_hierarchy.h"
+
+#include <string.h>
+
+ClassHierarchy class_hierarchy_init(const ClassNodeList class_list, bh_allocator allocator)
+{
+    ClassHierarchy hierarchy = (ClassHierarchy){
+        .class_list = class_list,
+        .method_offsets = bh_alloc(allocator, sizeof(int64_t) * (class_list.class_count + 1)),
+        .allocator = allocator
+    };
+    hierarchy.method_offsets[0] = 0;
+    for (int64_t i = 0; i < class_list.class_count; i++)
+    {
+        hierarchy.method_offsets[i + 1] = hierarchy.method_offsets[i] + class_list.class_nodes[i].method_count;
+    }
+    const int64_t total = hierarchy.method_offsets[class_list.class_count];
+    const int64_t slots = total > 0 ? total : 1;
+    hierarchy.defined_in = bh_alloc(allocator, sizeof(int64_t) * slots);
+    hierarchy.first_implementation = bh_alloc(allocator, sizeof(int64_t) * slots);
+    hierarchy.implementation_count = bh_alloc(allocator, sizeof(int64_t) * slots);
+    int64_t capacity = slots;
+    int64_t count = 0;
+    hierarchy.implementations = bh_alloc(allocator, sizeof(int64_t) * capacity);
+
+    for (int64_t i = 0; i < class_list.class_count; i++)
+    {
+        const ClassNode class_node = class_list.class_nodes[i];
+        for (int64_t m = 0; m < class_node.method_count; m++)
+        {
+            hierarchy.defined_in[hierarchy.method_offsets[i] + m] = class_idx_from_atom(class_list, class_node.methods[m].inherited_from_atom);
+        }
+    }
+
+    // A subclass lists its parent's methods first and in the same order, which is what makes method_idx
+    // mean the same thing on every class under the static type
+    bool* seen = bh_alloc(allocator, sizeof(bool) * (class_list.class_count > 0 ? class_list.class_count : 1));
+    for (int64_t i = 0; i < class_list.class_count; i++)
+    {
+        const ClassNode static_class = class_list.class_nodes[i];
+        for (int64_t m = 0; m < static_class.method_count; m++)
+        {
+            const int64_t slot = hierarchy.method_offsets[i] + m;
+            hierarchy.first_implementation[slot] = count;
+            memset(seen, 0, sizeof(bool) * class_list.class_count);
+            for (int64_t s = 0; s < class_list.class_count; s++)
+            {
+                if (!is_class_subtype_of(class_list.class_nodes[s], static_class)) continue;
+                const int64_t defined_in = hierarchy.defined_in[hierarchy.method_offsets[s] + m];
+                if (defined_in == -1 || seen[defined_in]) continue;
+                seen[defined_in] = true;
+                if (count == capacity)
+                {
+                    capacity *= 2;
+                    hierarchy.implementations = bh_realloc(allocator, hierarchy.implementations, sizeof(int64_t) * capacity);
+                }
+                hierarchy.implementations[count++] = defined_in;
+            }
+            hierarchy.implementation_count[slot] = count - hierarchy.first_implementation[slot];
+        }
+    }
+    bh_free(allocator, seen);
+
+    return hierarchy;
+}
+
+void class_hierarchy_deinit(ClassHierarchy* hierarchy)
+{
+    bh_free(hierarchy->allocator, hierarchy->implementations);
+    bh_free(hierarchy->allocator, hierarchy->implementation_count);
+    bh_free(hierarchy->allocator, hierarchy->first_implementation);
+    bh_free(hierarchy->allocator, hierarchy->defined_in);
+    bh_free(hierarchy->allocator, hierarchy->method_offsets);
+}
+
+// The class whose implementation a call always runs, or -1 if that depends on the receiver. Static
+// dispatch names the class outright.
+int64_t class_hierarchy_call_target(const ClassHierarchy* hierarchy, const TACSymbol method)
+{
+    if (method.type != TAC_SYMBOL_TYPE_METHOD) return -1;
+    if (method.method.class_idx < 0)
+    {
+        return hierarchy->defined_in[hierarchy->method_offsets[-method.method.class_idx - 1] + method.method.method_idx];
+    }
+    const int64_t slot = hierarchy->method_offsets[method.method.class_idx] + method.method.method_idx;
+    if (hierarchy->implementation_count[slot] != 1) return -1;
+    return hierarchy->implementations[hierarchy->first_implementation[slot]];
+}
@@ -0,0 +1,26 @@
+#ifndef CLASS_HIERARCHY_H
+#define CLASS_HIERARCHY_H
+
+#include <stdint.h>
+
+#include "allocator.h"
+#include "ast.h"
+#include "tac.h"
+
+// For every class and method, the classes whose implementation a dispatch on that static type can run
+typedef struct ClassHierarchy
+{
+    ClassNodeList class_list;
+    int64_t* method_offsets; // Per class, where its methods start in the arrays below
+    int64_t* defined_in; // Class the implementation each class inherits comes from
+    int64_t* first_implementation; // Into implementations, which are unique and in class order
+    int64_t* implementation_count;
+    int64_t* implementations;
+    bh_allocator allocator;
+} ClassHierarchy;
+
+ClassHierarchy class_hierarchy_init(ClassNodeList class_list, bh_allocator allocator);
+void class_hierarchy_deinit(ClassHierarchy* hierarchy);
+int64_t class_hierarchy_call_target(const ClassHierarchy* hierarchy, TACSymbol method);
+
+#endif //CLASS_HIERARCHY_H
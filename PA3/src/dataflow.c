@@ -0,0 +1,192 @@
+#include "dataflow.h"
+
+#include <string.h>
+
+DataflowProblem dataflow_problem_init(const CFG* cfg, const DataflowDirection direction, const DataflowMeet meet, const int64_t bit_count, bh_allocator allocator)
+{
+    DataflowProblem problem = (DataflowProblem){
+        .direction = direction,
+        .meet = meet,
+        .bit_count = bit_count,
+        .word_count = (bit_count + 63) / 64,
+        .block_count = cfg->block_count,
+        .allocator = allocator
+    };
+    const int64_t bitset_size = sizeof(uint64_t) * (problem.word_count * problem.block_count > 0 ? problem.word_count * problem.block_count : 1);
+    problem.gen = bh_alloc(allocator, bitset_size);
+    problem.kill = bh_alloc(allocator, bitset_size);
+    problem.in = bh_alloc(allocator, bitset_size);
+    problem.out = bh_alloc(allocator, bitset_size);
+    memset(problem.gen, 0, bitset_size);
+    memset(problem.kill, 0, bitset_size);
+    memset(problem.in, 0, bitset_size);
+    memset(problem.out, 0, bitset_size);
+    return problem;
+}
+
+void dataflow_problem_deinit(DataflowProblem* problem)
+{
+    bh_free(problem->allocator, problem->gen);
+    bh_free(problem->allocator, problem->kill);
+    bh_free(problem->allocator, problem->in);
+    bh_free(problem->allocator, problem->out);
+    *problem = (DataflowProblem){ 0 };
+}
+
+// Combines the sets flowing into block from its neighbours. The entry block and blocks without neighbours
+// also meet the empty set. Forward problems ignore edges out of unreachable blocks so dead code can't
+// weaken an intersection.
+static void dataflow_meet(const DataflowProblem* problem, const CFG* cfg, const bool* reachable, const int64_t block, uint64_t* result)
+{
+    const CFGBlock* cfg_block = &cfg->blocks[block];
+    const bool intersect = problem->meet == DATAFLOW_MEET_INTERSECTION;
+    bool any = false;
+
+    for (int64_t w = 0; w < problem->word_count; w++) result[w] = intersect ? ~(uint64_t)0 : 0;
+    if (problem->direction == DATAFLOW_FORWARD)
+    {
+        for (int64_t p = 0; p < cfg_block->predecessor_count; p++)
+        {
+            const int64_t predecessor = cfg->predecessors[cfg_block->first_predecessor + p];
+            if (!reachable[predecessor]) continue;
+            const uint64_t* set = DATAFLOW_SET(problem, out, predecessor);
+            for (int64_t w = 0; w < problem->word_count; w++) result[w] = intersect ? result[w] & set[w] : result[w] | set[w];
+            any = true;
+        }
+    }
+    else
+    {
+        for (int n = 0; n < 2; n++)
+        {
+            if (!cfg_block->next[n]) continue;
+            const uint64_t* set = DATAFLOW_SET(problem, in, cfg_block->next[n]->id);
+            for (int64_t w = 0; w < problem->word_count; w++) result[w] = intersect ? result[w] & set[w] : result[w] | set[w];
+            any = true;
+        }
+    }
+    if (!any || (intersect && problem->direction == DATAFLOW_FORWARD && block == 0))
+    {
+        memset(result, 0, sizeof(uint64_t) * problem->word_count);
+    }
+}
+
+// Worklist solver. Blocks are seeded in reverse postorder (postorder for backward problems) so most
+// sets are final after one visit, a block is only revisited when something it depends on changed.
+void dataflow_solve(DataflowProblem* problem, const CFG* cfg)
+{
+    const int64_t block_count = problem->block_count;
+    if (block_count == 0) return;
+    const bool forward = problem->direction == DATAFLOW_FORWARD;
+
+    // Everything starts at the top of the lattice, the meet pulls it down from there
+    const int64_t bitset_size = sizeof(uint64_t) * problem->word_count * block_count;
+    const int top = problem->meet == DATAFLOW_MEET_INTERSECTION ? 0xff : 0;
+    memset(forward ? problem->out : problem->in, top, bitset_size);
+
+    bool* reachable = bh_alloc(problem->allocator, sizeof(bool) * block_count);
+    bool* queued = bh_alloc(problem->allocator, sizeof(bool) * block_count);
+    int64_t* queue = bh_alloc(problem->allocator, sizeof(int64_t) * block_count);
+    memset(reachable, 0, sizeof(bool) * block_count);
+    for (int64_t i = 0; i < cfg->reachable_count; i++) reachable[cfg->order[i]] = true;
+    for (int64_t i = 0; i < block_count; i++)
+    {
+        queue[i] = forward ? cfg->order[i] : cfg->order[block_count - 1 - i];
+        queued[queue[i]] = true;
+    }
+    int64_t queue_start = 0;
+    int64_t queue_count = block_count;
+
+    uint64_t* result = bh_alloc(problem->allocator, sizeof(uint64_t) * (problem->word_count > 0 ? problem->word_count : 1));
+    while (queue_count > 0)
+    {
+        const int64_t b = queue[queue_start];
+        queue_start = (queue_start + 1) % block_count;
+        queue_count -= 1;
+        queued[b] = false;
+
+        uint64_t* meet_set = forward ? DATAFLOW_SET(problem, in, b) : DATAFLOW_SET(problem, out, b);
+        uint64_t* transfer_set = forward ? DATAFLOW_SET(problem, out, b) : DATAFLOW_SET(problem, in, b);
+        const uint64_t* gen = DATAFLOW_SET(problem, gen, b);
+        const uint64_t* kill = DATAFLOW_SET(problem, kill, b);
+
+        dataflow_meet(problem, cfg, reachable, b, meet_set);
+        bool changed = false;
+        for (int64_t w = 0; w < problem->word_count; w++)
+        {
+            result[w] = gen[w] | (meet_set[w] & ~kill[w]);
+            if (result[w] != transfer_set[w]) changed = true;
+            transfer_set[w] = result[w];
+        }
+        if (!changed) continue;
+
+        const CFGBlock* block = &cfg->blocks[b];
+        const int64_t dependent_count = forward ? 2 : block->predecessor_count;
+        for (int64_t d = 0; d < dependent_count; d++)
+        {
+            int64_t dependent = -1;
+            if (forward && block->next[d]) dependent = block->next[d]->id;
+            if (!forward) dependent = cfg->predecessors[block->first_predecessor + d];
+            if (dependent == -1 || queued[dependent]) continue;
+            queue[(queue_start + queue_count) % block_count] = dependent;
+            queue_count += 1;
+            queued[dependent] = true;
+        }
+    }
+
+    bh_free(problem->allocator, result);
+    bh_free(problem->allocator, queue);
+    bh_free(problem->allocator, queued);
+    bh_free(problem->allocator, reachable);
+}
+
+#pragma region Expression helpers
+
+// Side effect free expressions whose operands are temporaries or constants, and copies of a variable into
+// a temporary. Recomputing one gives the same value until an operand or the variable is written.
+bool tac_expr_is_available_candidate(const TACExpr expr)
+{
+    if (expr.lhs.type != TAC_SYMBOL_TYPE_SYMBOL) return false;
+    switch (expr.operation)
+    {
+    case TAC_OP_ASSIGN:
+        return expr.rhs1.type == TAC_SYMBOL_TYPE_VARIABLE;
+    case TAC_OP_PLUS:
+    case TAC_OP_MINUS:
+    case TAC_OP_TIMES:
+    case TAC_OP_DIVIDE:
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+        if (expr.rhs2.type == TAC_SYMBOL_TYPE_VARIABLE) return false;
+        // Fall through
+    case TAC_OP_NOT:
+    case TAC_OP_NEG:
+    case TAC_OP_ISVOID:
+        return expr.rhs1.type != TAC_SYMBOL_TYPE_VARIABLE;
+    default:
+        return false;
+    }
+}
+
+// Attributes of self can change inside any call, and through a store into what might be the same object
+bool tac_expr_may_write_attributes(const TACExpr expr)
+{
+    return expr.operation == TAC_OP_CALL || expr.operation == TAC_OP_NEW || expr.operation == TAC_OP_STORE_ATTRIBUTE;
+}
+
+// Formals and self only change when they're assigned to, attributes can also change inside any call
+bool tac_list_variable_is_local(const TACList* list, const TACSymbol variable)
+{
+    if (variable.variable.atom == BH_ATOM_SELF) return true;
+    if (list->class_idx < 0 || list->class_idx >= list->class_list.class_count) return false;
+    const ClassNode class_node = list->class_list.class_nodes[list->class_idx];
+    if (list->method_idx < 0 || list->method_idx >= class_node.method_count) return false;
+    const ClassMethod method = class_node.methods[list->method_idx];
+    for (int64_t i = 0; i < method.parameter_count; i++)
+    {
+        if (method.parameters[i].name_atom == variable.variable.atom) return true;
+    }
+    return false;
+}
+
+#pragma endregion
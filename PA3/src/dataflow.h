@@ -0,0 +1,51 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include <stdint.h>
+
+#include "tac.h"
+
+#define BITSET_GET(set, bit) (((set)[(bit) / 64] >> ((bit) % 64)) & 1)
+#define BITSET_SET(set, bit) ((set)[(bit) / 64] |= (uint64_t)1 << ((bit) % 64))
+#define BITSET_CLEAR(set, bit) ((set)[(bit) / 64] &= ~((uint64_t)1 << ((bit) % 64)))
+
+// The bitset a problem holds for block in one of gen, kill, in or out
+#define DATAFLOW_SET(problem, sets, block) (&(problem)->sets[(block) * (problem)->word_count])
+
+typedef enum DataflowDirection
+{
+    DATAFLOW_FORWARD,
+    DATAFLOW_BACKWARD,
+} DataflowDirection;
+
+typedef enum DataflowMeet
+{
+    DATAFLOW_MEET_UNION, // Holds on some path
+    DATAFLOW_MEET_INTERSECTION, // Holds on every path
+} DataflowMeet;
+
+// A gen/kill problem over the blocks of a CFG. The caller fills in gen and kill, dataflow_solve fills in
+// in and out. The entry (or for backward problems the exits) also meet the empty set.
+typedef struct DataflowProblem
+{
+    DataflowDirection direction;
+    DataflowMeet meet;
+    int64_t bit_count;
+    int64_t word_count; // Words per bitset
+    int64_t block_count;
+    uint64_t* gen; // block_count * word_count
+    uint64_t* kill;
+    uint64_t* in;
+    uint64_t* out;
+    bh_allocator allocator;
+} DataflowProblem;
+
+DataflowProblem dataflow_problem_init(const CFG* cfg, DataflowDirection direction, DataflowMeet meet, int64_t bit_count, bh_allocator allocator);
+void dataflow_problem_deinit(DataflowProblem* problem);
+void dataflow_solve(DataflowProblem* problem, const CFG* cfg);
+
+bool tac_expr_may_write_attributes(TACExpr expr);
+bool tac_list_variable_is_local(const TACList* list, TACSymbol variable);
+bool tac_expr_is_available_candidate(TACExpr expr);
+
+#endif //DATAFLOW_H
@@ -0,0 +1,319 @@
+#include "inliner.h"
+
+#include <string.h>
+
+#include "dataflow.h"
+#include "optimizer_tac.h"
+#include "profiler.h"
+
+typedef struct InlineBuffer
+{
+    int64_t* positions;
+    TACExpr* exprs;
+    int64_t count;
+    int64_t capacity;
+} InlineBuffer;
+
+// A call being replaced by a copy of the method it lands in
+typedef struct InlineSite
+{
+    TACList* caller;
+    const TACList* callee;
+    const ClassMethod* method;
+    InlineBuffer* buffer;
+    int64_t position;
+    bool on_self; // Self dispatch, the callee's variables mean the same thing in the caller
+    TACSymbol receiver;
+    TACSymbol* formals;
+    int64_t symbol_base;
+    int64_t label_base;
+} InlineSite;
+
+static void inline_buffer_append(InlineBuffer* buffer, const int64_t position, const TACExpr expr)
+{
+    if (buffer->count == buffer->capacity)
+    {
+        buffer->capacity = buffer->capacity > 0 ? buffer->capacity * 2 : 64;
+        buffer->positions = bh_realloc(GPA, buffer->positions, sizeof(int64_t) * buffer->capacity);
+        buffer->exprs = bh_realloc(GPA, buffer->exprs, sizeof(TACExpr) * buffer->capacity);
+    }
+    buffer->positions[buffer->count] = position;
+    buffer->exprs[buffer->count] = expr;
+    buffer->count += 1;
+}
+
+static bool is_builtin_class(const bh_atom name)
+{
+    return name == BH_ATOM_OBJECT || name == BH_ATOM_IO || name == BH_ATOM_STRING || name == BH_ATOM_INT || name == BH_ATOM_BOOL;
+}
+
+static int64_t method_formal(const ClassMethod* method, const bh_atom name)
+{
+    for (int64_t i = 0; i < method->parameter_count; i++)
+    {
+        if (method->parameters[i].name_atom == name) return i;
+    }
+    return -1;
+}
+
+static int64_t class_attribute(const ClassNode class_node, const bh_atom name)
+{
+    for (int64_t i = 0; i < class_node.attribute_count; i++)
+    {
+        if (class_node.attributes[i].name_atom == name) return i;
+    }
+    return -1;
+}
+
+// The CallData index of every method slot in the hierarchy, -1 where the class inherits the method
+static int64_t* inline_targets_init(const CallData* call_data, const int64_t method_count, const ClassHierarchy* hierarchy)
+{
+    const int64_t slot_count = hierarchy->method_offsets[hierarchy->class_list.class_count];
+    int64_t* targets = bh_alloc(GPA, sizeof(int64_t) * (slot_count > 0 ? slot_count : 1));
+    for (int64_t i = 0; i < slot_count; i++) targets[i] = -1;
+    for (int64_t i = 0; i < method_count; i++)
+    {
+        targets[hierarchy->method_offsets[call_data[i].class_idx] + call_data[i].method_idx] = i;
+    }
+    return targets;
+}
+
+// The CallData index of the only method a call can land in, -1 if that depends on the receiver
+static int64_t inline_call_target(const int64_t* targets, const ClassHierarchy* hierarchy, const TACExpr call)
+{
+    const int64_t target_class = class_hierarchy_call_target(hierarchy, call.rhs1);
+    if (target_class == -1) return -1;
+    return targets[hierarchy->method_offsets[target_class] + call.rhs1.method.method_idx];
+}
+
+// A variable the callee names has to mean the same thing once it's copied out. On self an attribute has to
+// be the one the same name finds in the caller, off self it has to be one the receiver has.
+static bool inline_variable_is_visible(const TACList* caller, const TACList* callee, const bool on_self, const TACSymbol symbol)
+{
+    if (symbol.type != TAC_SYMBOL_TYPE_VARIABLE || symbol.variable.atom == BH_ATOM_SELF) return true;
+    const ClassNode class_node = callee->class_list.class_nodes[callee->class_idx];
+    if (method_formal(&class_node.methods[callee->method_idx], symbol.variable.atom) != -1) return true;
+    if (!on_self) return class_attribute(class_node, symbol.variable.atom) != -1;
+    return !tac_list_variable_is_local(caller, symbol);
+}
+
+// How many expressions copying the callee adds, -1 if it can't be inlined. Built in methods are written in
+// assembly. A new SELF_TYPE reads the class off the caller's self, so it only means the same thing when the
+// callee runs on that too.
+static int64_t inline_callee_size(const TACList* caller, const TACList* callee, const bool on_self)
+{
+    if (is_builtin_class(callee->class_list.class_nodes[callee->class_idx].name_atom)) return -1;
+    int64_t size = 0;
+    for (int64_t i = 0; i < callee->count; i++)
+    {
+        const TACExpr expr = callee->items[i];
+        if (expr.operation == TAC_OP_NULL || expr.operation == TAC_OP_COMMENT || expr.operation == TAC_OP_IGNORE) continue;
+        size += 1;
+        if (expr.operation == TAC_OP_CALL && expr.rhs1.type != TAC_SYMBOL_TYPE_METHOD) return -1;
+        if (expr.operation == TAC_OP_NEW && expr.rhs1.variable.atom == BH_ATOM_SELF_TYPE && !on_self) return -1;
+        if (expr.operation == TAC_OP_RETURN && i != callee->count - 1) return -1;
+
+        if (!inline_variable_is_visible(caller, callee, on_self, expr.lhs)) return -1;
+        if (expr.operation != TAC_OP_NEW && expr.operation != TAC_OP_DEFAULT && !inline_variable_is_visible(caller, callee, on_self, expr.rhs1)) return -1;
+        if (!inline_variable_is_visible(caller, callee, on_self, expr.rhs2)) return -1;
+        for (int64_t j = 0; expr.operation == TAC_OP_CALL && j < expr.arg_count; j++)
+        {
+            if (!inline_variable_is_visible(caller, callee, on_self, expr.args[j])) return -1;
+        }
+    }
+    if (size > INLINE_CALLEE_BUDGET || callee->count == 0 || callee->items[callee->count - 1].operation != TAC_OP_RETURN) return -1;
+    return size;
+}
+
+static TACSymbol inline_operand(const InlineSite* site, const TACSymbol operand, const int64_t line_num)
+{
+    switch (operand.type)
+    {
+    case TAC_SYMBOL_TYPE_SYMBOL:
+        return (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = operand.symbol + site->symbol_base };
+    case TAC_SYMBOL_TYPE_VARIABLE:
+        {
+            if (operand.variable.atom == BH_ATOM_SELF) return site->on_self ? operand : site->receiver;
+            const int64_t formal = method_formal(site->method, operand.variable.atom);
+            if (formal != -1) return site->formals[formal];
+            if (site->on_self) return operand;
+
+            const TACSymbol value = TAC_request_symbol(site->caller);
+            const int64_t attribute = class_attribute(site->callee->class_list.class_nodes[site->callee->class_idx], operand.variable.atom);
+            inline_buffer_append(site->buffer, site->position, (TACExpr){
+                .operation = TAC_OP_LOAD_ATTRIBUTE,
+                .line_num = line_num,
+                .lhs = value,
+                .rhs1 = site->receiver,
+                .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = attribute }
+            });
+            return value;
+        }
+    default:
+        return operand;
+    }
+}
+
+static void inline_expr(const InlineSite* site, TACExpr expr)
+{
+    switch (expr.operation)
+    {
+    case TAC_OP_NULL:
+        return;
+    case TAC_OP_JMP:
+    case TAC_OP_LABEL:
+        expr.rhs1.integer += site->label_base;
+        inline_buffer_append(site->buffer, site->position, expr);
+        return;
+    case TAC_OP_BT:
+        expr.rhs2.integer += site->label_base;
+        break;
+    case TAC_OP_NEW:
+    case TAC_OP_DEFAULT:
+        break; // rhs1 names a class
+    default:
+        expr.rhs1 = inline_operand(site, expr.rhs1, expr.line_num);
+        expr.rhs2 = inline_operand(site, expr.rhs2, expr.line_num);
+        break;
+    }
+    if (expr.operation == TAC_OP_BT) expr.rhs1 = inline_operand(site, expr.rhs1, expr.line_num);
+    if (expr.operation == TAC_OP_CALL)
+    {
+        TACSymbol* args = bh_alloc(site->caller->allocator, sizeof(TACSymbol) * expr.arg_count);
+        for (int64_t j = 0; j < expr.arg_count; j++)
+        {
+            const bool self_dispatch = j == expr.arg_count - 1 && expr.args[j].type == TAC_SYMBOL_TYPE_NULL;
+            args[j] = self_dispatch ? (site->on_self ? expr.args[j] : site->receiver) : inline_operand(site, expr.args[j], expr.line_num);
+        }
+        expr.args = args;
+    }
+
+    int64_t stored_attribute = -1;
+    if (expr.lhs.type == TAC_SYMBOL_TYPE_SYMBOL)
+    {
+        expr.lhs.symbol += site->symbol_base;
+    }
+    else if (expr.lhs.type == TAC_SYMBOL_TYPE_VARIABLE)
+    {
+        const int64_t formal = method_formal(site->method, expr.lhs.variable.atom);
+        if (formal != -1)
+        {
+            expr.lhs = site->formals[formal];
+        }
+        else if (!site->on_self)
+        {
+            stored_attribute = class_attribute(site->callee->class_list.class_nodes[site->callee->class_idx], expr.lhs.variable.atom);
+            expr.lhs = TAC_request_symbol(site->caller);
+        }
+    }
+    inline_buffer_append(site->buffer, site->position, expr);
+
+    if (stored_attribute != -1)
+    {
+        inline_buffer_append(site->buffer, site->position, (TACExpr){
+            .operation = TAC_OP_STORE_ATTRIBUTE,
+            .line_num = expr.line_num,
+            .lhs = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = stored_attribute },
+            .rhs1 = site->receiver,
+            .rhs2 = expr.lhs
+        });
+    }
+}
+
+// Copies the callee in ahead of the call at idx and turns the call into a copy of what it returns. The
+// callee's temporaries and labels are shifted past the caller's, and its formals become temporaries. Off
+// self, its attributes become loads and stores on the receiver, which gets the void check the call did.
+static void inline_call(TACList* caller, const TACList* callee, InlineBuffer* buffer, const int64_t idx)
+{
+    const TACExpr call = caller->items[idx];
+    const ClassMethod* method = &callee->class_list.class_nodes[callee->class_idx].methods[callee->method_idx];
+    const TACSymbol receiver = call.args[call.arg_count - 1];
+    InlineSite site = (InlineSite){
+        .caller = caller,
+        .callee = callee,
+        .method = method,
+        .buffer = buffer,
+        .position = idx,
+        .on_self = receiver.type == TAC_SYMBOL_TYPE_NULL,
+        .formals = bh_alloc(GPA, sizeof(TACSymbol) * (method->parameter_count + 1)),
+        .symbol_base = caller->_curr_symbol,
+        .label_base = caller->_curr_label
+    };
+    caller->_curr_symbol += callee->_curr_symbol;
+    caller->_curr_label += callee->_curr_label;
+
+    if (!site.on_self)
+    {
+        site.receiver = TAC_request_symbol(caller);
+        const TACSymbol is_void = TAC_request_symbol(caller);
+        const TACSymbol not_void = TAC_request_symbol(caller);
+        const int64_t label = caller->_curr_label++;
+        inline_buffer_append(buffer, idx, (TACExpr){ .operation = TAC_OP_ASSIGN, .line_num = call.line_num, .lhs = site.receiver, .rhs1 = receiver });
+        inline_buffer_append(buffer, idx, (TACExpr){ .operation = TAC_OP_ISVOID, .line_num = call.line_num, .lhs = is_void, .rhs1 = site.receiver });
+        inline_buffer_append(buffer, idx, (TACExpr){ .operation = TAC_OP_NOT, .line_num = call.line_num, .lhs = not_void, .rhs1 = is_void });
+        inline_buffer_append(buffer, idx, (TACExpr){
+            .operation = TAC_OP_BT,
+            .line_num = call.line_num,
+            .rhs1 = not_void,
+            .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label }
+        });
+        inline_buffer_append(buffer, idx, (TACExpr){
+            .operation = TAC_OP_RUNTIME_ERROR,
+            .line_num = call.line_num,
+            .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = { .data = bh_str_from_cstr("dispatch on void") } }
+        });
+        inline_buffer_append(buffer, idx, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label } });
+    }
+    for (int64_t j = 0; j < method->parameter_count; j++)
+    {
+        site.formals[j] = TAC_request_symbol(caller);
+        inline_buffer_append(buffer, idx, (TACExpr){ .operation = TAC_OP_ASSIGN, .line_num = call.line_num, .lhs = site.formals[j], .rhs1 = call.args[j] });
+    }
+
+    for (int64_t i = 0; i < callee->count - 1; i++) inline_expr(&site, callee->items[i]);
+    const TACExpr ret = callee->items[callee->count - 1];
+    caller->items[idx] = (TACExpr){ .operation = TAC_OP_ASSIGN, .line_num = call.line_num, .lhs = call.lhs, .rhs1 = inline_operand(&site, ret.rhs1, ret.line_num) };
+
+    bh_free(GPA, site.formals);
+}
+
+// Splices small methods into the calls that can only land in them. Methods go in order, so a callee
+// earlier in call_data already has its own calls inlined. Callers that change are optimized again.
+void inline_method_calls(CallData* call_data, const int64_t method_count, const ClassHierarchy* hierarchy)
+{
+    PROFILE_BLOCK
+    {
+        int64_t* targets = inline_targets_init(call_data, method_count, hierarchy);
+        InlineBuffer buffer = (InlineBuffer){ 0 };
+        for (int64_t m = 0; m < method_count; m++)
+        {
+            TACList* caller = &call_data[m].tac_list;
+            if (is_builtin_class(caller->class_list.class_nodes[caller->class_idx].name_atom)) continue;
+
+            buffer.count = 0;
+            int64_t growth = 0;
+            for (int64_t i = 0; i < caller->count; i++)
+            {
+                const TACExpr call = caller->items[i];
+                if (call.operation != TAC_OP_CALL) continue;
+                const int64_t target = inline_call_target(targets, hierarchy, call);
+                if (target == -1 || target == m) continue;
+
+                const TACList* callee = &call_data[target].tac_list;
+                const bool on_self = call.args[call.arg_count - 1].type == TAC_SYMBOL_TYPE_NULL;
+                const int64_t size = inline_callee_size(caller, callee, on_self);
+                if (size == -1 || growth + size > INLINE_CALLER_BUDGET) continue;
+
+                growth += size;
+                inline_call(caller, callee, &buffer, i);
+            }
+            if (buffer.count == 0) continue;
+
+            TAC_list_insert_many(caller, buffer.positions, buffer.exprs, buffer.count);
+            optimize_tac_list(caller);
+        }
+        bh_free(GPA, buffer.exprs);
+        bh_free(GPA, buffer.positions);
+        bh_free(GPA, targets);
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef INLINER_H
+#define INLINER_H
+
+#include <stdint.h>
+
+#include "assembly.h"
+
+// Largest callee, in expressions, that gets copied into a call site
+#define INLINE_CALLEE_BUDGET 24
+// How many expressions inlining can add to one caller
+#define INLINE_CALLER_BUDGET 256
+
+void inline_method_calls(CallData* call_data, int64_t method_count, const ClassHierarchy* hierarchy);
+
+#endif //INLINER_H
@@ -0,0 +1,114 @@
+#include "loops.h"
+
+#include <string.h>
+
+// Headers go in reverse postorder, so a loop is found before the loops nested in it and the last loop to
+// claim a block is the innermost one
+TACLoops tac_loops_init(const CFG* cfg, const TACDominators* dominators, bh_allocator allocator)
+{
+    const int64_t block_count = cfg->block_count > 0 ? cfg->block_count : 1;
+    TACLoops loops = (TACLoops){
+        .loops = bh_alloc(allocator, sizeof(TACLoop) * block_count),
+        .blocks = bh_alloc(allocator, sizeof(int64_t) * block_count),
+        .innermost = bh_alloc(allocator, sizeof(int64_t) * block_count),
+        .allocator = allocator
+    };
+    memset(loops.innermost, -1, sizeof(int64_t) * block_count);
+    int64_t blocks_capacity = block_count;
+    int64_t blocks_count = 0;
+
+    int64_t* stamps = bh_alloc(allocator, sizeof(int64_t) * block_count);
+    memset(stamps, -1, sizeof(int64_t) * block_count);
+    int64_t* worklist = bh_alloc(allocator, sizeof(int64_t) * block_count);
+    for (int64_t o = 0; o < cfg->reachable_count; o++)
+    {
+        const int64_t header = cfg->order[o];
+        const CFGBlock* block = &cfg->blocks[header];
+        const int64_t loop = loops.loop_count;
+        int64_t worklist_count = 0;
+        stamps[header] = loop;
+        for (int64_t p = 0; p < block->predecessor_count; p++)
+        {
+            const int64_t predecessor = cfg->predecessors[block->first_predecessor + p];
+            if (!tac_dominates(dominators, header, predecessor) || stamps[predecessor] == loop) continue;
+            stamps[predecessor] = loop;
+            worklist[worklist_count++] = predecessor;
+        }
+        if (worklist_count == 0) continue;
+
+        if (blocks_count + cfg->reachable_count > blocks_capacity)
+        {
+            while (blocks_count + cfg->reachable_count > blocks_capacity) blocks_capacity *= 2;
+            loops.blocks = bh_realloc(allocator, loops.blocks, sizeof(int64_t) * blocks_capacity);
+        }
+        loops.loops[loop] = (TACLoop){ .header = header, .parent = loops.innermost[header], .first_block = blocks_count };
+        loops.blocks[blocks_count++] = header;
+        while (worklist_count > 0)
+        {
+            const int64_t b = worklist[--worklist_count];
+            loops.blocks[blocks_count++] = b;
+            const CFGBlock* member = &cfg->blocks[b];
+            for (int64_t p = 0; p < member->predecessor_count; p++)
+            {
+                const int64_t predecessor = cfg->predecessors[member->first_predecessor + p];
+                if (dominators->idom[predecessor] == -1 || stamps[predecessor] == loop) continue;
+                stamps[predecessor] = loop;
+                worklist[worklist_count++] = predecessor;
+            }
+        }
+        loops.loops[loop].block_count = blocks_count - loops.loops[loop].first_block;
+        for (int64_t i = loops.loops[loop].first_block; i < blocks_count; i++) loops.innermost[loops.blocks[i]] = loop;
+        loops.loop_count += 1;
+    }
+
+    bh_free(allocator, worklist);
+    bh_free(allocator, stamps);
+    return loops;
+}
+
+void tac_loops_deinit(TACLoops* loops)
+{
+    bh_free(loops->allocator, loops->innermost);
+    bh_free(loops->allocator, loops->blocks);
+    bh_free(loops->allocator, loops->loops);
+}
+
+// Whether inner is outer or nested somewhere inside it. inner can be -1 for code outside every loop.
+bool tac_loop_encloses(const TACLoops* loops, const int64_t outer, int64_t inner)
+{
+    while (inner != -1 && inner != outer) inner = loops->loops[inner].parent;
+    return inner == outer;
+}
+
+// The predecessor slot of the header the loop is entered through, -1 unless there's exactly one
+int64_t tac_loop_entry_slot(const CFG* cfg, const TACLoops* loops, const int64_t loop)
+{
+    const CFGBlock* header = &cfg->blocks[loops->loops[loop].header];
+    int64_t entry_slot = -1;
+    for (int64_t p = 0; p < header->predecessor_count; p++)
+    {
+        if (tac_loop_encloses(loops, loop, loops->innermost[cfg->predecessors[header->first_predecessor + p]])) continue;
+        if (entry_slot != -1) return -1;
+        entry_slot = p;
+    }
+    return entry_slot;
+}
+
+// Where code that should run once right before the loop goes, or -1 if there's nowhere to put it. The
+// header needs a single way in from outside the loop. If that edge is the only one leaving its block the
+// code goes at the end of that block, and if it's the fallthrough of a branch the code gets a block of its
+// own between the two. Either way the header keeps its predecessors in the same order, so phis line up.
+int64_t tac_loop_preheader_position(const TACList* list, const TACLoops* loops, const int64_t loop)
+{
+    const CFG* cfg = &list->cfg;
+    const CFGBlock* header = &cfg->blocks[loops->loops[loop].header];
+    const int64_t entry_slot = tac_loop_entry_slot(cfg, loops, loop);
+    if (entry_slot == -1) return -1;
+
+    const CFGBlock* predecessor = &cfg->blocks[cfg->predecessors[header->first_predecessor + entry_slot]];
+    const int64_t last_idx = predecessor->start + predecessor->tac_contents.count - 1;
+    const TACOp last = predecessor->tac_contents.count > 0 ? list->items[last_idx].operation : TAC_OP_NULL;
+    if (last == TAC_OP_JMP) return last_idx;
+    if (cfg_predecessor_edge(cfg, header->id, entry_slot) != 0 || last_idx + 1 != header->start) return -1;
+    return header->start;
+}
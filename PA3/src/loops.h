@@ -0,0 +1,34 @@
+#ifndef LOOPS_H
+#define LOOPS_H
+
+#include <stdint.h>
+
+#include "ssa.h"
+#include "tac.h"
+
+// A natural loop, every block that can reach one of the header's back edges without going through the
+// header. Back edges into the same header make up one loop.
+typedef struct TACLoop
+{
+    int64_t header;
+    int64_t parent; // Innermost loop this one is nested in, -1 at the top level
+    int64_t first_block; // Into TACLoops.blocks, the header comes first
+    int64_t block_count;
+} TACLoop;
+
+typedef struct TACLoops
+{
+    TACLoop* loops; // Loops come before the loops nested in them
+    int64_t loop_count;
+    int64_t* blocks;
+    int64_t* innermost; // Per block, the innermost loop it's in or -1
+    bh_allocator allocator;
+} TACLoops;
+
+TACLoops tac_loops_init(const CFG* cfg, const TACDominators* dominators, bh_allocator allocator);
+void tac_loops_deinit(TACLoops* loops);
+bool tac_loop_encloses(const TACLoops* loops, int64_t outer, int64_t inner);
+int64_t tac_loop_entry_slot(const CFG* cfg, const TACLoops* loops, int64_t loop);
+int64_t tac_loop_preheader_position(const TACList* list, const TACLoops* loops, int64_t loop);
+
+#endif //LOOPS_H
@@ -3,17 +3,22 @@
 //
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #include "allocator.h"
 #include "assembly.h"
 #include "ast.h"
+#include "inliner.h"
 #include "optimizer_tac.h"
 #include "profiler.h"
 #include "tac.h"
+#include "tac_buffer.h"
 #include "types.h"
 
 typedef enum Mode
@@ -28,6 +33,111 @@ typedef enum Mode
 
 #define MODE MODE_X86_ONLY
 
+// Upper bound on worker threads for method compilation
+#define COMPILE_THREAD_LIMIT 32
+// Lowering and optimizing recurse over the method body, so workers get the same room as the main thread
+#define COMPILE_THREAD_STACK_SIZE (64 * 1024 * 1024)
+// Starting size of the arena each method's TAC lives in
+#define METHOD_ARENA_SIZE (64 * 1024)
+
+typedef struct MethodQueue MethodQueue;
+typedef void (MethodWork)(MethodQueue* queue, int64_t method);
+
+struct MethodQueue
+{
+    ClassNodeList class_list;
+    CallData* call_data;
+    int64_t method_count;
+    ASMList* program;
+    ASMList* method_lists; // Per method, joined into program in method order afterwards
+    MainData main_data;
+    MethodWork* work;
+    atomic_int_fast64_t next_method;
+};
+
+static void compile_method_tac(MethodQueue* queue, const int64_t method_idx)
+{
+    CallData* data = &queue->call_data[method_idx];
+    const ClassMethod method = queue->class_list.class_nodes[data->class_idx].methods[data->method_idx];
+
+    // Everything a method's TAC needs is freed together once its assembly is out
+    set_current_allocator(resizable_arena_init(GPA, METHOD_ARENA_SIZE));
+    TACList list = TAC_list_init(100, current_allocator());
+    list.class_list = queue->class_list;
+    list.class_idx = data->class_idx;
+    list.method_idx = data->method_idx;
+    list.method_name = method.name;
+
+    TACSymbol result = tac_list_from_expression(&method.body, &list, (TACSymbol){ 0 });
+    TAC_list_append(&list, (TACExpr){ .operation = TAC_OP_RETURN, .rhs1 = result });
+    optimize_tac_list(&list);
+
+    data->tac_list = list;
+}
+
+static void lower_method(MethodQueue* queue, const int64_t method_idx)
+{
+    CallData* data = &queue->call_data[method_idx];
+    ASMList* method_list = &queue->method_lists[method_idx];
+    *method_list = asm_list_init_method(queue->program, method_idx);
+    if (data->called ||
+        (data->class_idx == queue->main_data.main_class_idx && data->method_idx == queue->main_data.main_method_idx))
+    {
+        asm_from_method(method_list, &data->tac_list);
+    }
+    else
+    {
+        asm_from_method_stub(method_list, data->tac_list);
+    }
+    TAC_list_deinit(data->tac_list);
+    resizable_arena_deinit(data->tac_list.allocator);
+}
+
+static void* method_worker(void* arg)
+{
+    MethodQueue* queue = arg;
+    for (;;)
+    {
+        const int64_t method = atomic_fetch_add(&queue->next_method, 1);
+        if (method >= queue->method_count) break;
+        queue->work(queue, method);
+    }
+    set_current_allocator(GPA);
+    return NULL;
+}
+
+// Once the class list is parsed, methods only read it and write their own call_data and method_lists slots,
+// so they can be worked on by separate threads. Results stay in method order for whatever runs after.
+static void run_methods_in_parallel(MethodQueue* queue, MethodWork* work)
+{
+    queue->work = work;
+    atomic_init(&queue->next_method, 0);
+
+    int64_t thread_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (BH_PROFILER_ENABLED || thread_count < 1) thread_count = 1; // The profiler keeps one global block stack
+    if (thread_count > COMPILE_THREAD_LIMIT) thread_count = COMPILE_THREAD_LIMIT;
+    if (thread_count > queue->method_count) thread_count = queue->method_count;
+
+    // The calling thread works the queue too, so it only spawns the rest
+    pthread_t threads[COMPILE_THREAD_LIMIT];
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, COMPILE_THREAD_STACK_SIZE);
+    int64_t spawned = 0;
+    for (int64_t i = 1; i < thread_count; i++)
+    {
+        if (pthread_create(&threads[spawned], &attr, method_worker, queue) != 0) break;
+        spawned++;
+    }
+    pthread_attr_destroy(&attr);
+
+    method_worker(queue);
+    for (int64_t i = 0; i < spawned; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+}
+
 void append_tac_symbol(bh_str_buf* str_buf, ClassNodeList class_list, TACSymbol symbol)
 {
     switch (symbol.type)
@@ -40,21 +150,15 @@ void append_tac_symbol(bh_str_buf* str_buf, ClassNodeList class_list, TACSymbol
         break;
     case TAC_SYMBOL_TYPE_INTEGER: bh_str_buf_append_format(str_buf, "%i", symbol.integer); break;
     case TAC_SYMBOL_TYPE_CLASSIDX:
-        for (int i = 0; i < class_list.class_count; i++)
         {
-            ClassNode class_node = class_list.class_nodes[i];
-            int64_t class_tag = i;
-            if (bh_str_equal_lit(class_node.name, "Bool")) class_tag = -1;
-            if (bh_str_equal_lit(class_node.name, "Int")) class_tag = -2;
-            if (bh_str_equal_lit(class_node.name, "String")) class_tag = -3;
-            if (class_tag == symbol.integer)
-            {
-                bh_str_buf_append(str_buf, class_node.name);
-                return;
-            }
+            int64_t class_idx = symbol.integer;
+            if (symbol.integer == -1) class_idx = class_idx_from_atom(class_list, BH_ATOM_BOOL);
+            if (symbol.integer == -2) class_idx = class_idx_from_atom(class_list, BH_ATOM_INT);
+            if (symbol.integer == -3) class_idx = class_idx_from_atom(class_list, BH_ATOM_STRING);
+            if (class_idx >= 0 && class_idx < class_list.class_count) bh_str_buf_append(str_buf, class_list.class_nodes[class_idx].name);
+            else bh_str_buf_append_lit(str_buf, "invalid");
+            break;
         }
-        bh_str_buf_append_lit(str_buf, "invalid");
-        break;
     case TAC_SYMBOL_TYPE_STRING: bh_str_buf_append(str_buf, symbol.string.data); break;
     case TAC_SYMBOL_TYPE_BOOL: bh_str_buf_append_format(str_buf, "%s", symbol.integer ? "true" : "false"); break;
     case TAC_SYMBOL_TYPE_METHOD: bh_str_buf_append(str_buf, class_list.class_nodes[symbol.method.class_idx].methods[symbol.method.method_idx].name); break;
@@ -99,6 +203,10 @@ void display_tac_expr(bh_str_buf* str_buf, TACList tac_list, TACExpr expr)
     case TAC_OP_DEFAULT: bh_str_buf_append_lit(str_buf, "default "); break;
     case TAC_OP_ISVOID: bh_str_buf_append_lit(str_buf, "isvoid "); break;
     case TAC_OP_IS_CLASS: bh_str_buf_append_lit(str_buf, "isclass "); break;
+    case TAC_OP_BOX: bh_str_buf_append_lit(str_buf, "box "); break;
+    case TAC_OP_SHL: bh_str_buf_append_lit(str_buf, "<< "); break;
+    case TAC_OP_SHR: bh_str_buf_append_lit(str_buf, ">> "); break;
+    case TAC_OP_LOAD_ATTRIBUTE: bh_str_buf_append_lit(str_buf, "attr "); break;
     case TAC_OP_PHI:bh_str_buf_append_lit(str_buf, "phi "); break;
     case TAC_OP_CALL: bh_str_buf_append_lit(str_buf, "call "); break;
     case TAC_OP_JMP:
@@ -121,6 +229,7 @@ void display_tac_expr(bh_str_buf* str_buf, TACList tac_list, TACExpr expr)
     case TAC_OP_RUNTIME_ERROR:
         bh_str_buf_append_format(str_buf, "ERROR %i: Exception: ", expr.line_num);
         break;
+    case TAC_OP_STORE_ATTRIBUTE: bh_str_buf_append_format(str_buf, "setattr %i ", expr.lhs.integer); break;
     default: assert(0 && "Invalid expression");
     }
     append_tac_symbol(str_buf, tac_list.class_list, expr.rhs1);
@@ -135,7 +244,7 @@ void display_tac_expr(bh_str_buf* str_buf, TACList tac_list, TACExpr expr)
         bh_str_buf_append(str_buf, tac_list.method_name);
         bh_str_buf_append_lit(str_buf, "_");
     }
-    if (expr.operation == TAC_OP_CALL)
+    if (expr.operation == TAC_OP_CALL || expr.operation == TAC_OP_PHI)
     {
         for (int i = 0; i < expr.arg_count; i++)
         {
@@ -162,15 +271,18 @@ int main(int argc, char* argv[])
     bh_allocator parser_arena = arena_init(1000000);
     ClassNodeList class_list = parse_class_map(&file, parser_arena);
     parse_implementation_map(&file, parser_arena, class_list);
+    build_class_index(&class_list, parser_arena);
     parse_parent_map(&file, parser_arena, class_list);
+    parse_method_signatures(&file, parser_arena, class_list);
 
-    bh_allocator tac_allocator = GPA;
+    bh_allocator tac_allocator = resizable_arena_init(GPA, METHOD_ARENA_SIZE);
     ASMList asm_list = asm_list_init(&class_list);
     if (MODE == MODE_X86_ONLY || MODE == MODE_BOTH)
     {
         asm_list.tac_allocator = tac_allocator;
         asm_list.string_allocator = arena_init(1000000);
         asm_from_vtable(&asm_list);
+        asm_from_interned_constants(&asm_list);
 
         // Count how many total methods there are to allocate space
         int64_t total_method_count = 0;
@@ -180,7 +292,7 @@ int main(int argc, char* argv[])
             {
                 const ClassMethod method = class_list.class_nodes[i].methods[j];
 
-                if (bh_str_equal(method.inherited_from, class_list.class_nodes[i].name))
+                if (method.inherited_from_atom == class_list.class_nodes[i].name_atom)
                 {
                     total_method_count += 1;
                 }
@@ -195,7 +307,7 @@ int main(int argc, char* argv[])
             {
                 const ClassMethod method = class_list.class_nodes[i].methods[j];
 
-                if (bh_str_equal(method.inherited_from, class_list.class_nodes[i].name))
+                if (method.inherited_from_atom == class_list.class_nodes[i].name_atom)
                 {
                     call_data[total_method_count].class_idx = i;
                     call_data[total_method_count].method_idx = j;
@@ -209,47 +321,26 @@ int main(int argc, char* argv[])
             asm_from_constructor(&asm_list, class_list.class_nodes[i], i, call_data, total_method_count);
         }
 
-        int64_t method_idx = 0;
-        for (int i = 0; i < class_list.class_count; i++)
+        MethodQueue queue = { .class_list = class_list, .call_data = call_data, .method_count = total_method_count };
+        run_methods_in_parallel(&queue, compile_method_tac);
+        for (int i = 0; i < total_method_count; i++)
         {
-            for (int j = 0; j < class_list.class_nodes[i].method_count; j++)
-            {
-                const ClassMethod method = class_list.class_nodes[i].methods[j];
-
-                if (bh_str_equal(method.inherited_from, class_list.class_nodes[i].name))
-                {
-                    TACList list = TAC_list_init(100, GPA);
-                    list.class_list = class_list;
-                    list.class_idx = i;
-                    list.method_idx = j;
-                    list.method_name = method.name;
-
-                    TACSymbol result = tac_list_from_expression(&method.body, &list, (TACSymbol){ 0 }, false);
-                    TAC_list_append(&list, (TACExpr){ .operation = TAC_OP_RETURN, .rhs1 = result }, false);
-                    optimize_tac_list(&list);
-
-                    call_data[method_idx].tac_list = list;
-
-                    fill_call_data_from_list(list, call_data, total_method_count);
-
-                    method_idx++;
-                }
-            }
+            fill_call_data_from_list(call_data[i].tac_list, call_data, total_method_count);
         }
 
-        MainData main_data = find_maindata(&asm_list);
+        // Inlining needs every callee finished first, so it runs between the two parallel stages
+        inline_method_calls(call_data, total_method_count, &asm_list.class_hierarchy);
+
+        queue.program = &asm_list;
+        queue.main_data = find_maindata(&asm_list);
+        queue.method_lists = bh_alloc(GPA, sizeof(ASMList) * (total_method_count > 0 ? total_method_count : 1));
+        run_methods_in_parallel(&queue, lower_method);
         for (int i = 0; i < total_method_count; i++)
         {
-            if (call_data[i].called ||
-                (call_data[i].class_idx == main_data.main_class_idx && call_data[i].method_idx == main_data.main_method_idx))
-            {
-                asm_from_method(&asm_list, call_data[i].tac_list);
-            }
-            else
-            {
-                asm_from_method_stub(&asm_list, call_data[i].tac_list);
-            }
+            asm_list_append_method_list(&asm_list, &queue.method_lists[i]);
+            asm_list_deinit_method(&queue.method_lists[i]);
         }
+        bh_free(GPA, queue.method_lists);
 
         builtin_append_string_constants(&asm_list);
         builtin_append_start(&asm_list);
@@ -303,6 +394,7 @@ int main(int argc, char* argv[])
     {
         bh_str_buf asm_display = bh_str_buf_init(GPA, 1000000);
         x86_asm_list(&asm_display, asm_list);
+        x86_stack_maps(&asm_display, asm_list);
         builtin_append_string_helpers(&asm_display);
 
         char* output_name  = bh_alloc(GPA, file_name.len + 8);
@@ -317,4 +409,13 @@ int main(int argc, char* argv[])
     }
 
     EndProfilerPrintProfile();
-}
\ No newline at end of file
+    if (getenv("COOL_TAC_BUFFER_STATS"))
+    {
+        const TACBufferStats stats = tac_buffer_stats();
+        fprintf(stderr, "TAC buffers: %lld acquired, %lld reused, peak %lld live, %lld chunks, %lld large\n",
+                (long long)stats.acquired, (long long)stats.reused, (long long)stats.peak_live,
+                (long long)stats.chunks, (long long)stats.large_blocks);
+        fprintf(stderr, "TAC buffer bytes: peak %lld live, largest list %lld\n",
+                (long long)stats.peak_live_bytes, (long long)stats.peak_list_bytes);
+    }
+}
@@ -2,233 +2,82 @@
 // Created by Brandon Howe on 4/7/25.
 //
 
+#include <stdlib.h>
 #include <string.h>
 #include "optimizer_tac.h"
 
+#include "dataflow.h"
+#include "loops.h"
 #include "profiler.h"
+#include "ssa.h"
+#include "use_def.h"
 
-void remove_duplicate_phi_expressions(TACList* list)
+static void mark_defs_live(const TACList* list, const TACUseDef* use_def, bool* live_status, int64_t* worklist, int64_t* worklist_count, const TACSymbol symbol)
 {
-    for (int i = 0; i < list->count; i++)
+    if (symbol.type != TAC_SYMBOL_TYPE_SYMBOL || symbol.symbol >= use_def->symbol_count) return;
+    for (int64_t idx = use_def->first_def[symbol.symbol]; idx != -1; idx = use_def->defs[idx].next)
     {
-        if (list->items[i].operation == TAC_OP_PHI)
-        {
-            for (int j = i + 1; j < list->count; j++)
-            {
-                if (list->items[j].operation == TAC_OP_PHI)
-                {
-                    if ((tac_symbol_equal(list->items[i].rhs1, list->items[j].rhs1) &&
-                        tac_symbol_equal(list->items[i].rhs2, list->items[j].rhs2)) ||
-                        (tac_symbol_equal(list->items[i].rhs1, list->items[j].rhs2) &&
-                        tac_symbol_equal(list->items[i].rhs2, list->items[j].rhs1)))
-                    {
-                        list->items[j].operation = TAC_OP_ASSIGN;
-                        list->items[j].rhs1 = list->items[i].lhs;
-                        list->items[j].rhs2 = (TACSymbol){ 0 };
-                    }
-                }
-            }
-        }
+        const TACUse* def = &use_def->defs[idx];
+        if (!tac_use_def_is_def(list, def, symbol.symbol) || live_status[def->expr]) continue;
+        live_status[def->expr] = true;
+        worklist[(*worklist_count)++] = def->expr;
     }
 }
 
-void remove_phi_expressions(TACList* list)
+// Marks everything with a side effect live, then everything those read from, off a worklist of expressions
+// that were just marked. Dead expressions are nulled out for remove_empty_exprs so indices stay put.
+void eliminate_dead_tac(TACList* list, const TACUseDef* use_def)
 {
-    int64_t max_phi = 0;
-    for (int i = 0; i < list->count; i++)
-    {
-        if (list->items[i].operation == TAC_OP_PHI)
-        {
-            if (list->items[i].rhs1.symbol > max_phi) max_phi = list->items[i].rhs1.symbol;
-            if (list->items[i].rhs2.symbol > max_phi) max_phi = list->items[i].rhs2.symbol;
-        }
-    }
-    max_phi += 1;
-    TACSymbol* phi_bindings = bh_alloc(GPA, max_phi * sizeof(TACSymbol));
-    memset(phi_bindings, 0, max_phi * sizeof(TACSymbol));
-    for (int i = 0; i < list->count; i++)
-    {
-        if (list->items[i].operation == TAC_OP_PHI)
-        {
-            phi_bindings[list->items[i].rhs1.symbol] = list->items[i].lhs;
-            phi_bindings[list->items[i].rhs2.symbol] = list->items[i].lhs;
-        }
-    }
+    if (list->count == 0) return;
+    bh_allocator allocator = GPA;
 
-    PROFILE_BLOCK
-    bool rerun_needed = true;
-    while (rerun_needed)
-    {
-        rerun_needed = false;
-        for (int i = 0; i < list->count; i++)
-        {
-            TACExpr e = list->items[i];
-            // if (e.operation != TAC_OP_PHI)
-            {
-                if ((e.rhs1.type == TAC_SYMBOL_TYPE_VARIABLE || e.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL) &&
-                    e.rhs1.symbol < max_phi &&
-                    phi_bindings[e.rhs1.symbol].type > 0 &&
-                    !tac_symbol_equal(list->items[i].rhs1, phi_bindings[e.rhs1.symbol]))
-                {
-                    list->items[i].rhs1 = phi_bindings[e.rhs1.symbol];
-                    rerun_needed = true;
-                }
-                if ((e.rhs2.type == TAC_SYMBOL_TYPE_VARIABLE || e.rhs2.type == TAC_SYMBOL_TYPE_SYMBOL) &&
-                    e.rhs2.symbol < max_phi &&
-                    phi_bindings[e.rhs2.symbol].type > 0 &&
-                    !tac_symbol_equal(list->items[i].rhs2, phi_bindings[e.rhs2.symbol]))
-                {
-                    list->items[i].rhs2 = phi_bindings[e.rhs2.symbol];
-                    rerun_needed = true;
-                }
-                for (int j = 0; j < e.arg_count; j++)
-                {
-                    TACSymbol arg = e.args[j];
-                    if ((arg.type == TAC_SYMBOL_TYPE_VARIABLE || arg.type == TAC_SYMBOL_TYPE_SYMBOL) &&
-                        arg.symbol < max_phi &&
-                        phi_bindings[arg.symbol].type > 0 &&
-                        !tac_symbol_equal(list->items[i].args[j], phi_bindings[arg.symbol]))
-                    {
-                        list->items[i].args[j] = phi_bindings[arg.symbol];
-                        rerun_needed = true;
-                    }
-                }
-            }
-            if ((e.lhs.type == TAC_SYMBOL_TYPE_VARIABLE || e.lhs.type == TAC_SYMBOL_TYPE_SYMBOL) && e.lhs.symbol < max_phi && phi_bindings[e.lhs.symbol].type > 0)
-            {
-                list->items[i].lhs = phi_bindings[e.lhs.symbol];
-                rerun_needed = true;
-            }
-        }
-        TACSymbol* phi_bindings_copy = bh_alloc(GPA, max_phi * sizeof(TACSymbol));
-        //TODO: figure out cyclical phis
-        for (int i = 0; i < max_phi; i++)
-        {
-            if (phi_bindings_copy[phi_bindings_copy[i].symbol].symbol > phi_bindings_copy[i].symbol)
-            {
-                phi_bindings[i] = phi_bindings_copy[phi_bindings_copy[i].symbol];
-            }
-        }
-        bh_free(GPA, phi_bindings_copy);
-    }
-    bh_free(GPA, phi_bindings);
+    bool* live_status = bh_alloc(allocator, sizeof(bool) * list->count);
+    memset(live_status, 0, sizeof(bool) * list->count);
+    int64_t* worklist = bh_alloc(allocator, sizeof(int64_t) * list->count);
+    int64_t worklist_count = 0;
 
-    for (int i = list->count - 1; i >= 0; i--)
+    for (int64_t i = 0; i < list->count; i++)
     {
-        if (list->items[i].operation == TAC_OP_PHI)
+        const TACExpr expr = list->items[i];
+        switch (expr.operation)
         {
-            list->count -= 1;
-            memmove(&list->items[i], &list->items[i + 1], (list->count - i) * sizeof(TACExpr));
+            case TAC_OP_CALL:
+            case TAC_OP_JMP:
+            case TAC_OP_LABEL:
+            case TAC_OP_BT:
+            case TAC_OP_RETURN:
+            case TAC_OP_IGNORE:
+            case TAC_OP_RUNTIME_ERROR:
+            case TAC_OP_STORE_ATTRIBUTE:
+                break;
+            default:
+                // Writes to variables are kept, they're read by name rather than through a temporary
+                if (expr.operation == TAC_OP_NULL || expr.lhs.type != TAC_SYMBOL_TYPE_VARIABLE) continue;
         }
+        live_status[i] = true;
+        worklist[worklist_count++] = i;
     }
-}
 
-void mark_symbol_live(TACList* list, bool* live_status, TACSymbol symbol)
-{
-    if (symbol.type != TAC_SYMBOL_TYPE_SYMBOL && symbol.type != TAC_SYMBOL_TYPE_VARIABLE)
-    {
-        return;
-    }
-    for (int i = list->count - 1; i >= 0; i--)
-    {
-        bool is_live = false;
-        if (live_status[i]) continue;
-        if (symbol.type == TAC_SYMBOL_TYPE_SYMBOL)
-        {
-            if (list->items[i].lhs.type == TAC_SYMBOL_TYPE_SYMBOL && list->items[i].lhs.symbol == symbol.symbol)
-            {
-                is_live = true;
-            }
-        }
-        else if (symbol.type == TAC_SYMBOL_TYPE_VARIABLE)
-        {
-            if (list->items[i].lhs.type == TAC_SYMBOL_TYPE_VARIABLE &&
-                bh_str_equal(list->items[i].lhs.variable.data, symbol.variable.data) &&
-                list->items[i].lhs.variable.version == symbol.variable.version)
-            {
-                is_live = true;
-            }
-        }
-        if (is_live)
-        {
-            live_status[i] = true;
-            if (!tac_symbol_equal(list->items[i].rhs1, list->items[i].lhs)) mark_symbol_live(list, live_status, list->items[i].rhs1);
-            if (!tac_symbol_equal(list->items[i].rhs2, list->items[i].lhs)) mark_symbol_live(list, live_status, list->items[i].rhs2);
-            for (int j = 0; j < list->items[i].arg_count; j++)
-            {
-                mark_symbol_live(list, live_status, list->items[i].args[j]);
-            }
-            break;
-        }
-    }
-}
-
-void eliminate_dead_tac(TACList* list)
-{
-    bh_allocator allocator = GPA;
-    if (list->count > 2000) return;
-
-    bool* live_status = bh_alloc(allocator, sizeof(bool) * list->count);
+    const TACExpr last = list->items[list->count - 1];
+    const TACSymbol result = last.operation == TAC_OP_RETURN ? last.rhs1 : (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = 0 };
+    mark_defs_live(list, use_def, live_status, worklist, &worklist_count, result);
 
-    for (int i = 0; i < list->count; i++)
+    while (worklist_count > 0)
     {
-        if (list->items[i].operation == TAC_OP_CALL)
-        {
-            // live_status[i] = true;
-            mark_symbol_live(list, live_status, list->items[i].lhs);
-        }
-        if (list->items[i].operation == TAC_OP_JMP || list->items[i].operation == TAC_OP_LABEL)
-        {
-            live_status[i] = true;
-        }
-        if (list->items[i].operation == TAC_OP_BT)
-        {
-            live_status[i] = true;
-            mark_symbol_live(list, live_status, list->items[i].rhs1);
-        }
-        if (list->items[i].operation == TAC_OP_PHI)
-        {
-            live_status[i] = true;
-            mark_symbol_live(list, live_status, list->items[i].rhs1);
-            mark_symbol_live(list, live_status, list->items[i].rhs2);
-        }
-        if (list->items[i].operation == TAC_OP_RETURN || list->items[i].operation == TAC_OP_IGNORE)
+        TACExpr expr = list->items[worklist[--worklist_count]];
+        for (int64_t operand = 0; operand < tac_expr_operand_count(expr); operand++)
         {
-            live_status[i] = true;
+            mark_defs_live(list, use_def, live_status, worklist, &worklist_count, *tac_expr_operand(&expr, operand));
         }
-        if (list->items[i].operation == TAC_OP_RUNTIME_ERROR)
-        {
-            live_status[i] = true;
-        }
-        if (list->items[i].lhs.type == TAC_SYMBOL_TYPE_VARIABLE)
-        {
-            // live_status[i] = true;
-            mark_symbol_live(list, live_status, list->items[i].lhs);
-        }
-    }
-    if (list->items[list->count - 1].operation == TAC_OP_RETURN)
-    {
-        mark_symbol_live(list, live_status, list->items[list->count - 1].rhs1);
-    }
-    else
-    {
-        mark_symbol_live(list, live_status, (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = 0 });
     }
 
-    // Remove unused expressions
-    int64_t unused_count = 0;
-    for (int i = 0; i < list->count; i++)
+    for (int64_t i = 0; i < list->count; i++)
     {
-        if (live_status[i])
-        {
-            list->items[i - unused_count] = list->items[i];
-        }
-        else
-        {
-            unused_count += 1;
-        }
+        if (!live_status[i]) list->items[i] = (TACExpr){ 0 };
     }
-    list->count -= unused_count;
+
+    bh_free(allocator, worklist);
+    bh_free(allocator, live_status);
 }
 
 int64_t compress_tac_symbols(TACList* list, int64_t* symbols, int64_t old_max_symbol, int64_t starting_symbol)
@@ -310,7 +159,7 @@ int64_t compress_tac_symbols(TACList* list, int64_t* symbols, int64_t old_max_sy
     return current_symbol;
 }
 
-void remove_double_nots(TACList* list)
+void remove_double_nots(TACList* list, TACUseDef* use_def)
 {
     for (int i = 0; i < list->count - 1; i++)
     {
@@ -321,6 +170,7 @@ void remove_double_nots(TACList* list)
                 list->items[i].operation = TAC_OP_ASSIGN;
                 list->items[i].lhs = list->items[i + 1].lhs;
                 list->items[i + 1] = (TACExpr){ 0 };
+                if (list->items[i].lhs.type == TAC_SYMBOL_TYPE_SYMBOL) tac_use_def_add_def(use_def, list->items[i].lhs.symbol, i);
             }
         }
         if (list->items[i].operation == TAC_OP_NEG && list->items[i + 1].operation == TAC_OP_NEG)
@@ -330,218 +180,1115 @@ void remove_double_nots(TACList* list)
                 list->items[i].operation = TAC_OP_ASSIGN;
                 list->items[i].lhs = list->items[i + 1].lhs;
                 list->items[i + 1] = (TACExpr){ 0 };
+                if (list->items[i].lhs.type == TAC_SYMBOL_TYPE_SYMBOL) tac_use_def_add_def(use_def, list->items[i].lhs.symbol, i);
             }
         }
     }
 }
 
-void perform_substitutions(TACList* list)
+// Copy propagation: reads of an assigned temporary read its source instead. In SSA form both are written
+// once and the source's write dominates every read of the copy, so all of them can be renamed. The source
+// is already propagated by the time an assignment is reached, so chains collapse in one pass.
+void perform_substitutions(TACList* list, TACUseDef* use_def)
 {
-    // TODO: use a fake hashmap to make this O(n) instead of O(n2)
     for (int i = 0; i < list->count; i++)
     {
         TACExpr e = list->items[i];
         if (e.operation == TAC_OP_ASSIGN && e.lhs.type == TAC_SYMBOL_TYPE_SYMBOL && e.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL)
         {
-            for (int j = i; j < list->count; j++)
+            if (tac_use_def_only_def(list, use_def, e.lhs.symbol) != i) continue;
+            if (tac_use_def_only_def(list, use_def, e.rhs1.symbol) == -1) continue;
+            tac_use_def_replace_uses_after(use_def, list, e.lhs.symbol, e.rhs1.symbol, -1);
+        }
+    }
+}
+
+void remove_empty_exprs(TACList* list)
+{
+    int64_t new_count = 0;
+
+    for (int64_t i = 0; i < list->count; i++) {
+        TACExpr expr = list->items[i];
+        if (expr.operation == TAC_OP_NULL) continue;
+        list->items[new_count++] = expr;
+    }
+
+    list->count = new_count;
+}
+
+typedef enum LatticeState
+{
+    LATTICE_UNDEFINED, // No write to the temporary has been found to run yet
+    LATTICE_CONSTANT,
+    LATTICE_VARYING,
+} LatticeState;
+
+typedef struct LatticeValue
+{
+    LatticeState state;
+    TACSymbol constant;
+} LatticeValue;
+
+typedef struct ConstantPropagation
+{
+    TACList* list;
+    const TACUseDef* use_def;
+    int64_t string_class_idx;
+    int64_t symbol_count;
+    LatticeValue* values; // Per temporary
+    int64_t* expr_blocks; // Block of every expression
+    bool* executable; // Per block
+    bool* executable_edges; // Per block, for next[0] and next[1]
+    int64_t* block_worklist;
+    int64_t block_worklist_count;
+    int64_t* symbol_worklist;
+    int64_t symbol_worklist_count;
+    int64_t symbol_worklist_capacity;
+} ConstantPropagation;
+
+static const LatticeValue lattice_varying = { .state = LATTICE_VARYING };
+
+static LatticeValue lattice_constant(const TACSymbolType type, const int64_t value)
+{
+    return (LatticeValue){ .state = LATTICE_CONSTANT, .constant = (TACSymbol){ .type = type, .integer = value } };
+}
+
+static LatticeValue lattice_meet(const LatticeValue a, const LatticeValue b)
+{
+    if (a.state == LATTICE_UNDEFINED) return b;
+    if (b.state == LATTICE_UNDEFINED) return a;
+    if (a.state == LATTICE_VARYING || b.state == LATTICE_VARYING) return lattice_varying;
+    return tac_symbol_equal(a.constant, b.constant) ? a : lattice_varying;
+}
+
+static LatticeValue constant_propagation_operand(const ConstantPropagation* propagation, const TACSymbol operand)
+{
+    if (operand.type != TAC_SYMBOL_TYPE_SYMBOL || operand.symbol >= propagation->symbol_count) return lattice_varying;
+    return propagation->values[operand.symbol];
+}
+
+// Ints are 32 bit at runtime, so folded arithmetic wraps the same way
+static int64_t wrap_int(const int64_t value)
+{
+    return (int32_t)(uint32_t)value;
+}
+
+static bool constant_propagation_edge_is_executable(const ConstantPropagation* propagation, const int64_t block, const int64_t slot)
+{
+    const CFG* cfg = &propagation->list->cfg;
+    const int64_t predecessor = cfg->predecessors[cfg->blocks[block].first_predecessor + slot];
+    return propagation->executable_edges[predecessor * 2 + cfg_predecessor_edge(cfg, block, slot)];
+}
+
+// A phi only meets the operands of edges that are known to be taken
+static LatticeValue constant_propagation_evaluate_phi(const ConstantPropagation* propagation, const int64_t idx)
+{
+    const TACExpr phi = propagation->list->items[idx];
+    LatticeValue value = (LatticeValue){ 0 };
+    for (int64_t slot = 0; slot < phi.arg_count; slot++)
+    {
+        if (!constant_propagation_edge_is_executable(propagation, propagation->expr_blocks[idx], slot)) continue;
+        value = lattice_meet(value, constant_propagation_operand(propagation, phi.args[slot]));
+    }
+    return value;
+}
+
+// What the expression writes given what is known about its operands so far
+static LatticeValue constant_propagation_evaluate(const ConstantPropagation* propagation, const int64_t idx)
+{
+    const TACExpr expr = propagation->list->items[idx];
+    switch (expr.operation)
+    {
+    case TAC_OP_INT:
+    case TAC_OP_BOOL:
+    case TAC_OP_STRING:
+        return (LatticeValue){ .state = LATTICE_CONSTANT, .constant = expr.rhs1 };
+    case TAC_OP_ASSIGN:
+        return constant_propagation_operand(propagation, expr.rhs1);
+    case TAC_OP_PHI:
+        return constant_propagation_evaluate_phi(propagation, idx);
+    case TAC_OP_PLUS:
+    case TAC_OP_MINUS:
+    case TAC_OP_TIMES:
+    case TAC_OP_DIVIDE:
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+        {
+            const LatticeValue c1 = constant_propagation_operand(propagation, expr.rhs1);
+            const LatticeValue c2 = constant_propagation_operand(propagation, expr.rhs2);
+            if (c1.state == LATTICE_VARYING || c2.state == LATTICE_VARYING) return lattice_varying;
+            if (c1.state == LATTICE_UNDEFINED || c2.state == LATTICE_UNDEFINED) return (LatticeValue){ 0 };
+            if (expr.operation == TAC_OP_EQ && c1.constant.type == TAC_SYMBOL_TYPE_BOOL && c2.constant.type == TAC_SYMBOL_TYPE_BOOL)
             {
-                if (i == j) continue;
-                TACExpr e2 = list->items[j];
-                if (e2.operation == TAC_OP_PHI) continue;
-                // if (e2.lhs.symbol == e.lhs.symbol) list->items[j].lhs.symbol = e.rhs1.symbol;
-                if (tac_symbol_equal(e2.rhs1, e.lhs)) list->items[j].rhs1.symbol = e.rhs1.symbol;
-                if (tac_symbol_equal(e2.rhs2, e.lhs)) list->items[j].rhs2.symbol = e.rhs1.symbol;
-                for (int k = 0; k < e2.arg_count; k++)
-                {
-                    if (tac_symbol_equal(e2.args[k], e.lhs)) list->items[j].args[k].symbol = e.rhs1.symbol;
-                }
+                return lattice_constant(TAC_SYMBOL_TYPE_BOOL, c1.constant.integer == c2.constant.integer);
+            }
+            if (c1.constant.type != TAC_SYMBOL_TYPE_INTEGER || c2.constant.type != TAC_SYMBOL_TYPE_INTEGER) return lattice_varying;
+
+            const int64_t v1 = wrap_int(c1.constant.integer);
+            const int64_t v2 = wrap_int(c2.constant.integer);
+            switch (expr.operation)
+            {
+            case TAC_OP_PLUS: return lattice_constant(TAC_SYMBOL_TYPE_INTEGER, wrap_int(v1 + v2));
+            case TAC_OP_MINUS: return lattice_constant(TAC_SYMBOL_TYPE_INTEGER, wrap_int(v1 - v2));
+            case TAC_OP_TIMES: return lattice_constant(TAC_SYMBOL_TYPE_INTEGER, wrap_int(v1 * v2));
+            case TAC_OP_DIVIDE:
+                if (v2 == 0 || (v1 == INT32_MIN && v2 == -1)) return lattice_varying; // Left for the runtime to trap
+                return lattice_constant(TAC_SYMBOL_TYPE_INTEGER, v1 / v2);
+            case TAC_OP_LT: return lattice_constant(TAC_SYMBOL_TYPE_BOOL, v1 < v2);
+            case TAC_OP_LTE: return lattice_constant(TAC_SYMBOL_TYPE_BOOL, v1 <= v2);
+            default: return lattice_constant(TAC_SYMBOL_TYPE_BOOL, v1 == v2);
             }
         }
+    case TAC_OP_NOT:
+    case TAC_OP_NEG:
+        {
+            const LatticeValue c1 = constant_propagation_operand(propagation, expr.rhs1);
+            if (c1.state != LATTICE_CONSTANT) return c1;
+            if (expr.operation == TAC_OP_NOT && c1.constant.type == TAC_SYMBOL_TYPE_BOOL) return lattice_constant(TAC_SYMBOL_TYPE_BOOL, !c1.constant.integer);
+            if (expr.operation == TAC_OP_NEG && c1.constant.type == TAC_SYMBOL_TYPE_INTEGER) return lattice_constant(TAC_SYMBOL_TYPE_INTEGER, wrap_int(-c1.constant.integer));
+            return lattice_varying;
+        }
+    case TAC_OP_ISVOID:
+        {
+            // Constants are boxed into real objects
+            const LatticeValue c1 = constant_propagation_operand(propagation, expr.rhs1);
+            return c1.state == LATTICE_CONSTANT ? lattice_constant(TAC_SYMBOL_TYPE_BOOL, 0) : c1;
+        }
+    case TAC_OP_CALL:
+        if (expr.rhs1.type != TAC_SYMBOL_TYPE_METHOD || expr.rhs1.method.class_idx != propagation->string_class_idx) return lattice_varying;
+        if (expr.rhs1.method.method_idx == 4) // length
+        {
+            const LatticeValue string = constant_propagation_operand(propagation, expr.args[0]);
+            if (string.state != LATTICE_CONSTANT) return string;
+            return lattice_constant(TAC_SYMBOL_TYPE_INTEGER, string.constant.string.data.len);
+        }
+        if (expr.rhs1.method.method_idx == 5) // substr
+        {
+            const LatticeValue start = constant_propagation_operand(propagation, expr.args[0]);
+            const LatticeValue length = constant_propagation_operand(propagation, expr.args[1]);
+            const LatticeValue string = constant_propagation_operand(propagation, expr.args[2]);
+            if (start.state == LATTICE_VARYING || length.state == LATTICE_VARYING || string.state == LATTICE_VARYING) return lattice_varying;
+            if (start.state == LATTICE_UNDEFINED || length.state == LATTICE_UNDEFINED || string.state == LATTICE_UNDEFINED) return (LatticeValue){ 0 };
+            const int64_t i = start.constant.integer;
+            const int64_t l = length.constant.integer;
+            // Out of range substrings are a runtime error
+            if (i < 0 || l < 0 || i + l > string.constant.string.data.len) return lattice_varying;
+            bh_str substring = string.constant.string.data;
+            substring.buf += i;
+            substring.len = l;
+            return (LatticeValue){ .state = LATTICE_CONSTANT, .constant = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = { .data = substring } } };
+        }
+        return lattice_varying;
+    default:
+        return lattice_varying;
     }
 }
 
-void perform_constant_folding(TACList* list)
+static void constant_propagation_visit_expr(ConstantPropagation* propagation, int64_t idx);
+
+static void constant_propagation_mark_edge(ConstantPropagation* propagation, const int64_t block_idx, const int edge)
 {
-    int64_t string_class_idx = -1;
-    for (int i = 0; i < list->class_list.class_count; i++)
+    const CFGBlock* next = propagation->list->cfg.blocks[block_idx].next[edge];
+    if (!next || propagation->executable_edges[block_idx * 2 + edge]) return;
+    propagation->executable_edges[block_idx * 2 + edge] = true;
+    if (!propagation->executable[next->id])
     {
-        const ClassNode class_node = list->class_list.class_nodes[i];
-        if (bh_str_equal_lit(class_node.name, "String")) string_class_idx = i;
-        if (string_class_idx > -1) break;
+        propagation->executable[next->id] = true;
+        propagation->block_worklist[propagation->block_worklist_count++] = next->id;
+        return;
     }
 
-    int64_t max_symbol = list->_curr_symbol + 1;
-    TACSymbol* constants = bh_alloc(GPA, max_symbol * sizeof(TACSymbol));
-    for (int i = 0; i < max_symbol; i++)
+    // A block that already ran only has its phis change, they get another operand
+    for (int64_t i = next->start; i < next->start + next->tac_contents.count; i++)
     {
-        constants[i] = (TACSymbol){ 0 };
+        if (propagation->list->items[i].operation == TAC_OP_PHI) constant_propagation_visit_expr(propagation, i);
     }
+}
 
-    bool rerun_needed = true;
-    while (rerun_needed)
+// Marks the successors control can reach from the end of block
+static void constant_propagation_visit_branch(ConstantPropagation* propagation, const int64_t block_idx, const bool force)
+{
+    const CFGBlock* block = &propagation->list->cfg.blocks[block_idx];
+    if (block->tac_contents.count > 0 && block->tac_contents.items[block->tac_contents.count - 1].operation == TAC_OP_BT)
     {
-        rerun_needed = false;
-        // Collect constants
-        for (int i = 0; i < list->count; i++)
+        const TACExpr last = block->tac_contents.items[block->tac_contents.count - 1];
+        const LatticeValue condition = constant_propagation_operand(propagation, last.rhs1);
+        if (condition.state == LATTICE_UNDEFINED && !force) return;
+        if (condition.state == LATTICE_CONSTANT && condition.constant.type == TAC_SYMBOL_TYPE_BOOL)
         {
-            TACExpr e = list->items[i];
+            constant_propagation_mark_edge(propagation, block_idx, condition.constant.integer ? 1 : 0);
+            return;
+        }
+    }
+    constant_propagation_mark_edge(propagation, block_idx, 0);
+    constant_propagation_mark_edge(propagation, block_idx, 1);
+}
+
+static void constant_propagation_visit_expr(ConstantPropagation* propagation, const int64_t idx)
+{
+    const TACExpr expr = propagation->list->items[idx];
+    if (expr.operation == TAC_OP_NULL || expr.lhs.type != TAC_SYMBOL_TYPE_SYMBOL || expr.lhs.symbol >= propagation->symbol_count) return;
+    if (expr.operation == TAC_OP_BT) return;
+
+    LatticeValue* value = &propagation->values[expr.lhs.symbol];
+    const LatticeValue new_value = lattice_meet(*value, constant_propagation_evaluate(propagation, idx));
+    if (new_value.state == value->state && (new_value.state != LATTICE_CONSTANT || tac_symbol_equal(new_value.constant, value->constant))) return;
+    *value = new_value;
+
+    if (propagation->symbol_worklist_count == propagation->symbol_worklist_capacity)
+    {
+        propagation->symbol_worklist_capacity *= 2;
+        propagation->symbol_worklist = bh_realloc(GPA, propagation->symbol_worklist, sizeof(int64_t) * propagation->symbol_worklist_capacity);
+    }
+    propagation->symbol_worklist[propagation->symbol_worklist_count++] = expr.lhs.symbol;
+}
 
-            if ((e.operation == TAC_OP_INT || e.operation == TAC_OP_BOOL || e.operation == TAC_OP_STRING) && e.lhs.type == TAC_SYMBOL_TYPE_SYMBOL)
+static void constant_propagation_run(ConstantPropagation* propagation)
+{
+    const TACList* list = propagation->list;
+    const TACUseDef* use_def = propagation->use_def;
+    while (propagation->block_worklist_count > 0 || propagation->symbol_worklist_count > 0)
+    {
+        if (propagation->block_worklist_count > 0)
+        {
+            const int64_t b = propagation->block_worklist[--propagation->block_worklist_count];
+            const CFGBlock block = list->cfg.blocks[b];
+            for (int64_t i = block.start; i < block.start + block.tac_contents.count; i++)
             {
-                constants[e.lhs.symbol] = e.rhs1;
+                constant_propagation_visit_expr(propagation, i);
             }
+            constant_propagation_visit_branch(propagation, b, false);
+            continue;
         }
 
-        for (int i = 0; i < list->count; i++)
+        // Only reads in blocks known to run see the new value, the rest are visited with their block
+        const int64_t symbol = propagation->symbol_worklist[--propagation->symbol_worklist_count];
+        for (int64_t entry = use_def->first_use[symbol]; entry != -1; entry = use_def->uses[entry].next)
         {
-            TACExpr e = list->items[i];
+            const TACUse* use = &use_def->uses[entry];
+            if (!tac_use_def_is_use(list, use, symbol)) continue;
+            const int64_t b = propagation->expr_blocks[use->expr];
+            if (!propagation->executable[b]) continue;
+            constant_propagation_visit_expr(propagation, use->expr);
+            const CFGBlock block = list->cfg.blocks[b];
+            if (use->expr == block.start + block.tac_contents.count - 1) constant_propagation_visit_branch(propagation, b, false);
+        }
+    }
+}
 
-            bool is_comparison = e.operation == TAC_OP_EQ || e.operation == TAC_OP_LTE || e.operation == TAC_OP_LT;
-            if (e.operation == TAC_OP_PLUS ||
-                e.operation == TAC_OP_MINUS ||
-                e.operation == TAC_OP_TIMES ||
-                e.operation == TAC_OP_DIVIDE ||
-                is_comparison)
+// Sparse conditional constant propagation. Temporaries start out undefined and only the first block is
+// known to run; values are pushed along the uses of each temporary and blocks are only visited once a
+// branch that can reach them is. Afterwards constant results are folded, branches on constants become
+// jumps and blocks that never run are deleted along with their labels. Phis lose the operands of edges
+// that are never taken, matching the CFG once it's regenerated. Dead expressions are nulled out.
+void perform_constant_propagation(TACList* list, const TACUseDef* use_def)
+{
+    const CFG* cfg = &list->cfg;
+    if (cfg->block_count == 0) return;
+
+    ConstantPropagation propagation = (ConstantPropagation){
+        .list = list,
+        .use_def = use_def,
+        .string_class_idx = -1,
+        .symbol_count = use_def->symbol_count,
+        .values = bh_alloc(GPA, sizeof(LatticeValue) * (use_def->symbol_count > 0 ? use_def->symbol_count : 1)),
+        .expr_blocks = bh_alloc(GPA, sizeof(int64_t) * list->count),
+        .executable = bh_alloc(GPA, sizeof(bool) * cfg->block_count),
+        .executable_edges = bh_alloc(GPA, sizeof(bool) * 2 * cfg->block_count),
+        .block_worklist = bh_alloc(GPA, sizeof(int64_t) * cfg->block_count),
+        .symbol_worklist_capacity = 64,
+        .symbol_worklist = bh_alloc(GPA, sizeof(int64_t) * 64),
+    };
+    for (int i = 0; i < list->class_list.class_count; i++)
+    {
+        if (list->class_list.class_nodes[i].name_atom == BH_ATOM_STRING) propagation.string_class_idx = i;
+    }
+    memset(propagation.values, 0, sizeof(LatticeValue) * use_def->symbol_count);
+    for (int64_t symbol = 0; symbol < use_def->symbol_count; symbol++)
+    {
+        // Nothing is known about a temporary that is read without ever being written here
+        bool written = false;
+        for (int64_t entry = use_def->first_def[symbol]; entry != -1 && !written; entry = use_def->defs[entry].next)
+        {
+            written = tac_use_def_is_def(list, &use_def->defs[entry], symbol);
+        }
+        if (!written) propagation.values[symbol] = lattice_varying;
+    }
+    memset(propagation.executable, 0, sizeof(bool) * cfg->block_count);
+    memset(propagation.executable_edges, 0, sizeof(bool) * 2 * cfg->block_count);
+    for (int64_t b = 0; b < cfg->block_count; b++)
+    {
+        for (int64_t i = cfg->blocks[b].start; i < cfg->blocks[b].start + cfg->blocks[b].tac_contents.count; i++) propagation.expr_blocks[i] = b;
+    }
+
+    // A branch on something that is never written can go either way
+    propagation.executable[0] = true;
+    propagation.block_worklist[propagation.block_worklist_count++] = 0;
+    bool forced = true;
+    while (forced)
+    {
+        constant_propagation_run(&propagation);
+        forced = false;
+        for (int64_t b = 0; b < cfg->block_count; b++)
+        {
+            const CFGBlock block = cfg->blocks[b];
+            if (!propagation.executable[b] || block.tac_contents.count == 0) continue;
+            const TACExpr last = block.tac_contents.items[block.tac_contents.count - 1];
+            if (last.operation != TAC_OP_BT) continue;
+            if (constant_propagation_operand(&propagation, last.rhs1).state != LATTICE_UNDEFINED) continue;
+            constant_propagation_visit_branch(&propagation, b, true);
+            forced = forced || propagation.block_worklist_count > 0 || propagation.symbol_worklist_count > 0;
+        }
+    }
+
+    for (int64_t b = 0; b < cfg->block_count; b++)
+    {
+        const CFGBlock block = cfg->blocks[b];
+        for (int64_t i = block.start; i < block.start + block.tac_contents.count; i++)
+        {
+            TACExpr* expr = &list->items[i];
+            if (!propagation.executable[b])
             {
-                TACSymbol c1 = constants[e.rhs1.symbol];
-                TACSymbol c2 = constants[e.rhs2.symbol];
-                if (e.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL && c1.type == TAC_SYMBOL_TYPE_INTEGER &&
-                    e.rhs2.type == TAC_SYMBOL_TYPE_SYMBOL && c2.type == TAC_SYMBOL_TYPE_INTEGER)
-                {
-                    int64_t v1 = c1.integer;
-                    int64_t v2 = c2.integer;
-                    if (e.operation == TAC_OP_DIVIDE && v2 == 0) continue; // No division by 0
-                    list->items[i].operation = is_comparison ? TAC_OP_BOOL : TAC_OP_INT;
-                    int64_t result = e.operation == TAC_OP_PLUS ? v1 + v2
-                        : e.operation == TAC_OP_MINUS ? v1 - v2
-                        : e.operation == TAC_OP_TIMES ? v1 * v2
-                        : e.operation == TAC_OP_DIVIDE ? v1 / v2
-                        : e.operation == TAC_OP_LTE ? v1 <= v2
-                        : e.operation == TAC_OP_LT ? v1 < v2
-                        : v1 == v2;
-                    list->items[i].rhs1 = (TACSymbol){
-                        .type = is_comparison ? TAC_SYMBOL_TYPE_BOOL : TAC_SYMBOL_TYPE_INTEGER,
-                        .integer = result
-                    };
-                    list->items[i].rhs2 = (TACSymbol){ 0 };
-                    rerun_needed = true;
-                }
+                // The return stays so the method still ends in one
+                if (expr->operation != TAC_OP_RETURN) *expr = (TACExpr){ 0 };
+                continue;
             }
-            if (e.operation == TAC_OP_NEG)
+
+            if (expr->operation == TAC_OP_BT)
             {
-                TACSymbol c1 = constants[e.rhs1.symbol];
-                if (e.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL && c1.type == TAC_SYMBOL_TYPE_INTEGER)
+                const LatticeValue condition = constant_propagation_operand(&propagation, expr->rhs1);
+                if (condition.state != LATTICE_CONSTANT || condition.constant.type != TAC_SYMBOL_TYPE_BOOL) continue;
+                if (condition.constant.integer)
                 {
-                    list->items[i].operation = TAC_OP_INT;
-                    int64_t result = -c1.integer;
-                    list->items[i].rhs1 = (TACSymbol){
-                        .type = TAC_SYMBOL_TYPE_INTEGER,
-                        .integer = result
-                    };
-                    list->items[i].rhs2 = (TACSymbol){ 0 };
-                    rerun_needed = true;
+                    *expr = (TACExpr){ .operation = TAC_OP_JMP, .line_num = expr->line_num, .rhs1 = expr->rhs2 };
                 }
-            }
-            if (e.operation == TAC_OP_NOT)
-            {
-                TACSymbol c1 = constants[e.rhs1.symbol];
-                if (e.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL && c1.type == TAC_SYMBOL_TYPE_BOOL)
+                else
                 {
-                    list->items[i].operation = TAC_OP_BOOL;
-                    int64_t result = c1.integer == 0 ? 1 : 0;
-                    list->items[i].rhs1 = (TACSymbol){
-                        .type = TAC_SYMBOL_TYPE_BOOL,
-                        .integer = result
-                    };
-                    list->items[i].rhs2 = (TACSymbol){ 0 };
-                    rerun_needed = true;
+                    *expr = (TACExpr){ 0 };
                 }
+                continue;
             }
-            if (e.operation == TAC_OP_BT)
+            if (expr->lhs.type != TAC_SYMBOL_TYPE_SYMBOL || expr->lhs.symbol >= propagation.symbol_count) continue;
+
+            const LatticeValue value = propagation.values[expr->lhs.symbol];
+            if (value.state == LATTICE_CONSTANT)
             {
-                TACSymbol c1 = constants[e.rhs1.symbol];
-                if (e.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL && c1.type == TAC_SYMBOL_TYPE_BOOL)
-                {
-                    if (c1.integer)
-                    {
-                        list->items[i].operation = TAC_OP_JMP;
-                        list->items[i].rhs1 = list->items[i].rhs2;
-                        list->items[i].rhs2 = (TACSymbol){ 0 };
-                    }
-                    else
-                    {
-                        list->items[i].operation = TAC_OP_ASSIGN;
-                        list->items[i].lhs = list->items[i].rhs1;
-                        list->items[i].rhs2 = (TACSymbol){ 0 };
-                    }
-                }
+                const TACOp operation = value.constant.type == TAC_SYMBOL_TYPE_INTEGER ? TAC_OP_INT
+                    : value.constant.type == TAC_SYMBOL_TYPE_BOOL ? TAC_OP_BOOL
+                    : TAC_OP_STRING;
+                *expr = (TACExpr){ .operation = operation, .line_num = expr->line_num, .lhs = expr->lhs, .rhs1 = value.constant };
+                continue;
             }
-            if (e.operation == TAC_OP_CALL)
+            if (expr->operation == TAC_OP_PHI)
             {
-                if (e.rhs1.method.class_idx == string_class_idx && e.rhs1.method.method_idx == 4) // strlen
+                int64_t arg_count = 0;
+                for (int64_t slot = 0; slot < expr->arg_count; slot++)
                 {
-                    TACSymbol c1 = constants[e.args[0].symbol];
-                    if (c1.type == TAC_SYMBOL_TYPE_STRING)
-                    {
-                        list->items[i].operation = TAC_OP_INT;
-                        list->items[i].rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = c1.string.data.len };
-                        list->items[i].arg_count = 0;
-                        rerun_needed = true;
-                    }
+                    if (constant_propagation_edge_is_executable(&propagation, b, slot)) expr->args[arg_count++] = expr->args[slot];
                 }
-                if (e.rhs1.method.class_idx == string_class_idx && e.rhs1.method.method_idx == 5) // substr
+                expr->arg_count = arg_count;
+                if (arg_count == 1) *expr = (TACExpr){ .operation = TAC_OP_ASSIGN, .line_num = expr->line_num, .lhs = expr->lhs, .rhs1 = expr->args[0] };
+            }
+        }
+    }
+
+    bh_free(GPA, propagation.symbol_worklist);
+    bh_free(GPA, propagation.block_worklist);
+    bh_free(GPA, propagation.executable_edges);
+    bh_free(GPA, propagation.executable);
+    bh_free(GPA, propagation.expr_blocks);
+    bh_free(GPA, propagation.values);
+}
+
+typedef struct ExpressionKey
+{
+    TACOp operation;
+    TACSymbol rhs1;
+    TACSymbol rhs2;
+} ExpressionKey;
+
+static int compare_tac_symbols(const TACSymbol a, const TACSymbol b)
+{
+    if (a.type != b.type) return a.type < b.type ? -1 : 1;
+    switch (a.type)
+    {
+    case TAC_SYMBOL_TYPE_NULL:
+        return 0;
+    case TAC_SYMBOL_TYPE_SYMBOL:
+    case TAC_SYMBOL_TYPE_INTEGER:
+    case TAC_SYMBOL_TYPE_BOOL:
+    case TAC_SYMBOL_TYPE_CLASSIDX:
+        return a.integer == b.integer ? 0 : a.integer < b.integer ? -1 : 1;
+    case TAC_SYMBOL_TYPE_VARIABLE:
+        if (a.variable.version != b.variable.version) return a.variable.version < b.variable.version ? -1 : 1;
+        return a.variable.atom == b.variable.atom ? 0 : a.variable.atom < b.variable.atom ? -1 : 1;
+    default:
+        return tac_symbol_equal(a, b) ? 0 : 1;
+    }
+}
+
+static uint64_t hash_tac_symbol(const TACSymbol symbol)
+{
+    uint64_t hash = symbol.type * 0x9e3779b97f4a7c15;
+    if (symbol.type == TAC_SYMBOL_TYPE_VARIABLE)
+    {
+        return ((hash ^ symbol.variable.atom) * 0x100000001b3) ^ symbol.variable.version;
+    }
+    if (symbol.type == TAC_SYMBOL_TYPE_NULL) return hash;
+    return (hash ^ symbol.integer) * 0x100000001b3;
+}
+
+static TACSymbol value_number(const TACSymbol* numbers, const int64_t symbol_count, const TACSymbol operand)
+{
+    if (operand.type != TAC_SYMBOL_TYPE_SYMBOL || operand.symbol >= symbol_count) return operand;
+    return numbers[operand.symbol];
+}
+
+// Loads are keyed on the epoch they happen in, they only match while nothing could have written the variable
+static ExpressionKey expression_key(const TACSymbol* numbers, const int64_t symbol_count, const TACExpr expr, const int64_t epoch)
+{
+    ExpressionKey key = (ExpressionKey){
+        .operation = expr.operation,
+        .rhs1 = value_number(numbers, symbol_count, expr.rhs1),
+        .rhs2 = value_number(numbers, symbol_count, expr.rhs2)
+    };
+    if (expr.operation == TAC_OP_ASSIGN) key.rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = epoch };
+    const bool commutative = expr.operation == TAC_OP_PLUS || expr.operation == TAC_OP_TIMES || expr.operation == TAC_OP_EQ;
+    if (commutative && compare_tac_symbols(key.rhs1, key.rhs2) > 0)
+    {
+        const TACSymbol temp = key.rhs1;
+        key.rhs1 = key.rhs2;
+        key.rhs2 = temp;
+    }
+    return key;
+}
+
+static uint64_t hash_expression_key(const ExpressionKey key)
+{
+    return (hash_tac_symbol(key.rhs1) * 31 + hash_tac_symbol(key.rhs2)) ^ key.operation;
+}
+
+static bool expression_keys_equal(const ExpressionKey a, const ExpressionKey b)
+{
+    return a.operation == b.operation && compare_tac_symbols(a.rhs1, b.rhs1) == 0 && compare_tac_symbols(a.rhs2, b.rhs2) == 0;
+}
+
+// A phi whose operands all hold the same value holds it too, as long as that's a constant or a temporary
+// written once. That write reaches the end of every predecessor, so it dominates the join.
+static void value_number_phi(TACList* list, TACUseDef* use_def, TACSymbol* numbers, const int64_t idx)
+{
+    TACExpr* phi = &list->items[idx];
+    if (phi->arg_count == 0) return;
+    const TACSymbol number = value_number(numbers, use_def->symbol_count, phi->args[0]);
+    for (int64_t k = 1; k < phi->arg_count; k++)
+    {
+        if (compare_tac_symbols(value_number(numbers, use_def->symbol_count, phi->args[k]), number) != 0) return;
+    }
+
+    switch (number.type)
+    {
+    case TAC_SYMBOL_TYPE_SYMBOL:
+        if (number.symbol == phi->lhs.symbol || tac_use_def_only_def(list, use_def, number.symbol) == -1) return;
+        *phi = (TACExpr){ .operation = TAC_OP_ASSIGN, .line_num = phi->line_num, .lhs = phi->lhs, .rhs1 = number };
+        tac_use_def_add_use(use_def, number.symbol, idx, TAC_OPERAND_RHS1);
+        break;
+    case TAC_SYMBOL_TYPE_INTEGER:
+        *phi = (TACExpr){ .operation = TAC_OP_INT, .line_num = phi->line_num, .lhs = phi->lhs, .rhs1 = number };
+        break;
+    case TAC_SYMBOL_TYPE_BOOL:
+        *phi = (TACExpr){ .operation = TAC_OP_BOOL, .line_num = phi->line_num, .lhs = phi->lhs, .rhs1 = number };
+        break;
+    default:
+        return;
+    }
+    numbers[phi->lhs.symbol] = number;
+}
+
+// Global value numbering over the dominator tree. Temporaries holding the same value share a number, the
+// literal for constants and otherwise the first temporary found to hold it. An expression whose operator
+// and operand numbers match one in a dominating block becomes a copy of that one's result, which
+// perform_substitutions forwards. Calls, writes to variables and joins start a new epoch for loads.
+void global_value_numbering(TACList* list, TACUseDef* use_def)
+{
+    const CFG* cfg = &list->cfg;
+    if (cfg->reachable_count == 0) return;
+    TACDominators dominators = tac_dominators_init(cfg, GPA);
+
+    const int64_t symbol_count = use_def->symbol_count;
+    TACSymbol* numbers = bh_alloc(GPA, sizeof(TACSymbol) * (symbol_count > 0 ? symbol_count : 1));
+    for (int64_t symbol = 0; symbol < symbol_count; symbol++) numbers[symbol] = (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = symbol };
+
+    // The table is scoped to the dominator tree, leaving a block takes out what it put in
+    int64_t bucket_count = 64;
+    while (bucket_count < list->count * 2) bucket_count *= 2;
+    int64_t* buckets = bh_alloc(GPA, sizeof(int64_t) * bucket_count);
+    memset(buckets, -1, sizeof(int64_t) * bucket_count);
+    int64_t* next_in_bucket = bh_alloc(GPA, sizeof(int64_t) * list->count);
+    ExpressionKey* keys = bh_alloc(GPA, sizeof(ExpressionKey) * list->count);
+    int64_t* scope = bh_alloc(GPA, sizeof(int64_t) * list->count);
+    int64_t scope_count = 0;
+    int64_t* scope_marks = bh_alloc(GPA, sizeof(int64_t) * cfg->block_count);
+    int64_t* exit_epochs = bh_alloc(GPA, sizeof(int64_t) * 2 * cfg->block_count); // Locals, then attributes
+    int64_t epoch_count = 0;
+
+    int64_t* stack = bh_alloc(GPA, sizeof(int64_t) * 2 * cfg->block_count);
+    int64_t stack_count = 0;
+    stack[stack_count++] = cfg->order[0];
+    while (stack_count > 0)
+    {
+        const int64_t entry = stack[--stack_count];
+        if (entry < 0)
+        {
+            while (scope_count > scope_marks[~entry])
+            {
+                const int64_t i = scope[--scope_count];
+                buckets[hash_expression_key(keys[i]) & (bucket_count - 1)] = next_in_bucket[i];
+            }
+            continue;
+        }
+
+        const CFGBlock* block = &cfg->blocks[entry];
+        scope_marks[entry] = scope_count;
+
+        // A block entered only from its dominator carries on from it, a join could have come from anywhere
+        int64_t local_epoch = epoch_count++;
+        int64_t attribute_epoch = epoch_count++;
+        const int64_t idom = dominators.idom[entry];
+        if (entry != cfg->order[0] && block->predecessor_count == 1 && cfg->predecessors[block->first_predecessor] == idom)
+        {
+            local_epoch = exit_epochs[idom * 2];
+            attribute_epoch = exit_epochs[idom * 2 + 1];
+        }
+
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+        {
+            TACExpr* expr = &list->items[i];
+            if (expr->operation == TAC_OP_NULL) continue;
+            if (tac_expr_may_write_attributes(*expr)) attribute_epoch = epoch_count++;
+            if (expr->lhs.type == TAC_SYMBOL_TYPE_VARIABLE)
+            {
+                if (tac_list_variable_is_local(list, expr->lhs)) local_epoch = epoch_count++;
+                else attribute_epoch = epoch_count++;
+            }
+            if (expr->lhs.type != TAC_SYMBOL_TYPE_SYMBOL || expr->lhs.symbol >= symbol_count) continue;
+            if (tac_use_def_only_def(list, use_def, expr->lhs.symbol) != i) continue;
+
+            const int64_t symbol = expr->lhs.symbol;
+            if (expr->operation == TAC_OP_PHI)
+            {
+                value_number_phi(list, use_def, numbers, i);
+                continue;
+            }
+            if (expr->operation == TAC_OP_INT || expr->operation == TAC_OP_BOOL || (expr->operation == TAC_OP_ASSIGN && expr->rhs1.type != TAC_SYMBOL_TYPE_VARIABLE))
+            {
+                numbers[symbol] = value_number(numbers, symbol_count, expr->rhs1);
+                continue;
+            }
+            if (!tac_expr_is_available_candidate(*expr)) continue;
+
+            const bool local_load = expr->operation == TAC_OP_ASSIGN && tac_list_variable_is_local(list, expr->rhs1);
+            keys[i] = expression_key(numbers, symbol_count, *expr, local_load ? local_epoch : attribute_epoch);
+            const uint64_t bucket = hash_expression_key(keys[i]) & (bucket_count - 1);
+            int64_t match = buckets[bucket];
+            while (match != -1 && !expression_keys_equal(keys[match], keys[i])) match = next_in_bucket[match];
+            if (match == -1)
+            {
+                next_in_bucket[i] = buckets[bucket];
+                buckets[bucket] = i;
+                scope[scope_count++] = i;
+                continue;
+            }
+
+            const TACSymbol leader = list->items[match].lhs;
+            *expr = (TACExpr){ .operation = TAC_OP_ASSIGN, .line_num = expr->line_num, .lhs = expr->lhs, .rhs1 = leader };
+            tac_use_def_add_use(use_def, leader.symbol, i, TAC_OPERAND_RHS1);
+            numbers[symbol] = numbers[leader.symbol];
+        }
+        exit_epochs[entry * 2] = local_epoch;
+        exit_epochs[entry * 2 + 1] = attribute_epoch;
+
+        stack[stack_count++] = ~entry;
+        for (int64_t child = dominators.first_child[entry]; child != -1; child = dominators.next_sibling[child]) stack[stack_count++] = child;
+    }
+
+    bh_free(GPA, stack);
+    bh_free(GPA, exit_epochs);
+    bh_free(GPA, scope_marks);
+    bh_free(GPA, scope);
+    bh_free(GPA, keys);
+    bh_free(GPA, next_in_bucket);
+    bh_free(GPA, buckets);
+    bh_free(GPA, numbers);
+    tac_dominators_deinit(&dominators);
+}
+
+typedef struct HoistedExpr
+{
+    int64_t position;
+    int64_t sequence;
+    TACExpr expr;
+} HoistedExpr;
+
+static int compare_hoisted_exprs(const void* a, const void* b)
+{
+    const HoistedExpr* x = a;
+    const HoistedExpr* y = b;
+    if (x->position != y->position) return x->position < y->position ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : x->sequence > y->sequence;
+}
+
+typedef struct LoopWrite
+{
+    int64_t expr;
+    int64_t next; // Next write in the same loop, -1 at the end
+} LoopWrite;
+
+typedef struct LoopInvariance
+{
+    const TACList* list;
+    const TACUseDef* use_def;
+    TACLoops loops;
+    int64_t* location; // Per expression, the innermost loop it runs in once it's been hoisted
+    bool* clobbers_attributes; // Per loop, whether something in it could write an attribute
+    int64_t* first_write; // Per loop, the writes to variables inside it
+    LoopWrite* writes;
+    int64_t write_count;
+    int64_t write_capacity;
+} LoopInvariance;
+
+// String.length can't write anything and gives the same answer for the same string. Nothing can inherit
+// from String, so a dispatch on one always lands there.
+static bool is_string_length_call(const TACList* list, const TACExpr expr)
+{
+    if (expr.operation != TAC_OP_CALL || expr.rhs1.type != TAC_SYMBOL_TYPE_METHOD || expr.arg_count != 1) return false;
+    const int64_t class_idx = expr.rhs1.method.class_idx < 0 ? -expr.rhs1.method.class_idx - 1 : expr.rhs1.method.class_idx;
+    const ClassNode class_node = list->class_list.class_nodes[class_idx];
+    return class_node.name_atom == BH_ATOM_STRING && class_node.methods[expr.rhs1.method.method_idx].name_atom == BH_ATOM_LENGTH;
+}
+
+// Expressions that can run ahead of time without anything noticing. Division is left in place since it can
+// raise an error the loop might never have gotten to.
+static bool is_hoistable(const TACList* list, const TACExpr expr)
+{
+    if (expr.lhs.type != TAC_SYMBOL_TYPE_SYMBOL) return false;
+    switch (expr.operation)
+    {
+    case TAC_OP_ASSIGN:
+    case TAC_OP_INT:
+    case TAC_OP_BOOL:
+    case TAC_OP_STRING:
+    case TAC_OP_PLUS:
+    case TAC_OP_MINUS:
+    case TAC_OP_TIMES:
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+    case TAC_OP_NOT:
+    case TAC_OP_NEG:
+    case TAC_OP_ISVOID:
+        return true;
+    case TAC_OP_CALL:
+        return is_string_length_call(list, expr);
+    default:
+        return false;
+    }
+}
+
+static bool loop_invariant_operand(const LoopInvariance* invariance, const int64_t loop, const TACSymbol operand)
+{
+    switch (operand.type)
+    {
+    case TAC_SYMBOL_TYPE_SYMBOL:
+        {
+            const int64_t def = tac_use_def_only_def(invariance->list, invariance->use_def, operand.symbol);
+            return def != -1 && !tac_loop_encloses(&invariance->loops, loop, invariance->location[def]);
+        }
+    case TAC_SYMBOL_TYPE_VARIABLE:
+        {
+            if (invariance->clobbers_attributes[loop] && !tac_list_variable_is_local(invariance->list, operand)) return false;
+            for (int64_t w = invariance->first_write[loop]; w != -1; w = invariance->writes[w].next)
+            {
+                if (invariance->list->items[invariance->writes[w].expr].lhs.variable.atom == operand.variable.atom) return false;
+            }
+            return true;
+        }
+    default:
+        return true;
+    }
+}
+
+static bool loop_invariant_expr(const LoopInvariance* invariance, const int64_t loop, TACExpr expr)
+{
+    for (int64_t operand = 0; operand < tac_expr_operand_count(expr); operand++)
+    {
+        if (!loop_invariant_operand(invariance, loop, *tac_expr_operand(&expr, operand))) return false;
+    }
+    return true;
+}
+
+// Loop-invariant code motion. Pure expressions whose operands all come from outside a loop move to its
+// preheader, out of as many loops as they're invariant in. A load also needs its variable to not be
+// written in the loop, and for attributes nothing in the loop that could call out. list->cfg is rebuilt
+// when anything moves, use_def is left stale.
+void hoist_loop_invariants(TACList* list, const TACUseDef* use_def)
+{
+    const CFG* cfg = &list->cfg;
+    if (cfg->reachable_count == 0) return;
+    TACDominators dominators = tac_dominators_init(cfg, GPA);
+    LoopInvariance invariance = (LoopInvariance){
+        .list = list,
+        .use_def = use_def,
+        .loops = tac_loops_init(cfg, &dominators, GPA),
+        .write_capacity = 16,
+    };
+    const int64_t loop_count = invariance.loops.loop_count;
+    if (loop_count == 0)
+    {
+        tac_loops_deinit(&invariance.loops);
+        tac_dominators_deinit(&dominators);
+        return;
+    }
+
+    invariance.location = bh_alloc(GPA, sizeof(int64_t) * list->count);
+    invariance.clobbers_attributes = bh_alloc(GPA, sizeof(bool) * loop_count);
+    invariance.first_write = bh_alloc(GPA, sizeof(int64_t) * loop_count);
+    invariance.writes = bh_alloc(GPA, sizeof(LoopWrite) * invariance.write_capacity);
+    memset(invariance.clobbers_attributes, 0, sizeof(bool) * loop_count);
+    memset(invariance.first_write, -1, sizeof(int64_t) * loop_count);
+    for (int64_t b = 0; b < cfg->block_count; b++)
+    {
+        const CFGBlock* block = &cfg->blocks[b];
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+        {
+            const TACExpr expr = list->items[i];
+            invariance.location[i] = invariance.loops.innermost[b];
+            const bool calls = tac_expr_may_write_attributes(expr) && !is_string_length_call(list, expr);
+            const bool writes = expr.operation != TAC_OP_NULL && expr.lhs.type == TAC_SYMBOL_TYPE_VARIABLE;
+            for (int64_t loop = invariance.loops.innermost[b]; loop != -1 && (calls || writes); loop = invariance.loops.loops[loop].parent)
+            {
+                if (calls) invariance.clobbers_attributes[loop] = true;
+                if (!writes) continue;
+                if (invariance.write_count == invariance.write_capacity)
                 {
-                    TACSymbol c2 = constants[e.args[0].symbol];
-                    TACSymbol c3 = constants[e.args[1].symbol];
-                    TACSymbol c1 = constants[e.args[2].symbol];
-                    if (c1.type == TAC_SYMBOL_TYPE_STRING && c2.type == TAC_SYMBOL_TYPE_INTEGER && c3.type == TAC_SYMBOL_TYPE_INTEGER)
-                    {
-                        // Check in range
-                        if (c2.integer >= 0 && c3.integer >= 0 && c2.integer + c3.integer <= c1.string.data.len)
-                        {
-                            list->items[i].operation = TAC_OP_STRING;
-                            bh_str new_str = c1.string.data;
-                            new_str.buf += c2.integer;
-                            new_str.len = c3.integer;
-                            list->items[i].rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = new_str };
-                            list->items[i].arg_count = 0;
-                            rerun_needed = true;
-                        }
-                    }
+                    invariance.write_capacity *= 2;
+                    invariance.writes = bh_realloc(GPA, invariance.writes, sizeof(LoopWrite) * invariance.write_capacity);
                 }
+                invariance.writes[invariance.write_count] = (LoopWrite){ .expr = i, .next = invariance.first_write[loop] };
+                invariance.first_write[loop] = invariance.write_count++;
             }
         }
     }
 
-    bh_free(GPA, constants);
+    int64_t* preheaders = bh_alloc(GPA, sizeof(int64_t) * loop_count);
+    for (int64_t loop = 0; loop < loop_count; loop++) preheaders[loop] = tac_loop_preheader_position(list, &invariance.loops, loop);
+
+    // Blocks go in reverse postorder so operands are placed before whatever reads them
+    int64_t hoisted_count = 0;
+    HoistedExpr* hoisted = bh_alloc(GPA, sizeof(HoistedExpr) * list->count);
+    for (int64_t o = 0; o < cfg->reachable_count; o++)
+    {
+        const CFGBlock* block = &cfg->blocks[cfg->order[o]];
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+        {
+            const TACExpr expr = list->items[i];
+            if (invariance.location[i] == -1 || !is_hoistable(list, expr)) continue;
+            if (tac_use_def_only_def(list, use_def, expr.lhs.symbol) != i) continue;
+
+            int64_t target = -1;
+            for (int64_t loop = invariance.location[i]; loop != -1; loop = invariance.loops.loops[loop].parent)
+            {
+                if (!loop_invariant_expr(&invariance, loop, expr)) break;
+                if (preheaders[loop] != -1) target = loop;
+            }
+            if (target == -1) continue;
+
+            invariance.location[i] = invariance.loops.loops[target].parent;
+            hoisted[hoisted_count] = (HoistedExpr){ .position = preheaders[target], .sequence = hoisted_count, .expr = expr };
+            hoisted_count += 1;
+        }
+    }
+
+    if (hoisted_count > 0)
+    {
+        for (int64_t h = 0; h < hoisted_count; h++)
+        {
+            const int64_t def = tac_use_def_only_def(list, use_def, hoisted[h].expr.lhs.symbol);
+            list->items[def] = (TACExpr){ 0 };
+        }
+        qsort(hoisted, hoisted_count, sizeof(HoistedExpr), compare_hoisted_exprs);
+        int64_t* positions = bh_alloc(GPA, sizeof(int64_t) * hoisted_count);
+        TACExpr* exprs = bh_alloc(GPA, sizeof(TACExpr) * hoisted_count);
+        for (int64_t h = 0; h < hoisted_count; h++)
+        {
+            positions[h] = hoisted[h].position;
+            exprs[h] = hoisted[h].expr;
+        }
+        TAC_list_insert_many(list, positions, exprs, hoisted_count);
+        generate_cfg_for_tac_list(list);
+        bh_free(GPA, exprs);
+        bh_free(GPA, positions);
+    }
+
+    bh_free(GPA, hoisted);
+    bh_free(GPA, preheaders);
+    bh_free(GPA, invariance.writes);
+    bh_free(GPA, invariance.first_write);
+    bh_free(GPA, invariance.clobbers_attributes);
+    bh_free(GPA, invariance.location);
+    tac_loops_deinit(&invariance.loops);
+    tac_dominators_deinit(&dominators);
 }
 
-void remove_empty_exprs(TACList* list)
+// The k in 2^k if operand is always that power of two, -1 otherwise. Int only goes up to 2^30.
+static int64_t power_of_two_exponent(const TACList* list, const TACUseDef* use_def, const TACSymbol operand)
 {
-    int64_t new_count = 0;
+    if (operand.type != TAC_SYMBOL_TYPE_SYMBOL) return -1;
+    const int64_t def = tac_use_def_only_def(list, use_def, operand.symbol);
+    if (def == -1 || list->items[def].operation != TAC_OP_INT) return -1;
+    const int64_t value = list->items[def].rhs1.integer;
+    if (value <= 0 || (value & (value - 1)) != 0) return -1;
+    int64_t exponent = 0;
+    while ((1LL << exponent) != value) exponent += 1;
+    return exponent;
+}
 
-    for (int64_t i = 0; i < list->count; i++) {
-        TACExpr expr = list->items[i];
-        if (expr.operation == TAC_OP_NULL) continue;
-        list->items[new_count++] = expr;
+// Multiplies and divides by a constant power of two become shifts. The divisor is known to be nonzero so
+// no check is needed, and SHR rounds toward zero the way DIVIDE does.
+void shift_by_powers_of_two(TACList* list, TACUseDef* use_def)
+{
+    for (int64_t i = 0; i < list->count; i++)
+    {
+        TACExpr* expr = &list->items[i];
+        if (expr->operation != TAC_OP_TIMES && expr->operation != TAC_OP_DIVIDE) continue;
+        if (expr->lhs.type != TAC_SYMBOL_TYPE_SYMBOL) continue;
+
+        int64_t exponent = power_of_two_exponent(list, use_def, expr->rhs2);
+        if (exponent == -1 && expr->operation == TAC_OP_TIMES)
+        {
+            exponent = power_of_two_exponent(list, use_def, expr->rhs1);
+            if (exponent == -1) continue;
+            expr->rhs1 = expr->rhs2;
+            if (expr->rhs1.type == TAC_SYMBOL_TYPE_SYMBOL) tac_use_def_add_use(use_def, expr->rhs1.symbol, i, TAC_OPERAND_RHS1);
+        }
+        if (exponent == -1) continue;
+
+        if (exponent == 0)
+        {
+            *expr = (TACExpr){ .operation = TAC_OP_ASSIGN, .line_num = expr->line_num, .lhs = expr->lhs, .rhs1 = expr->rhs1 };
+            continue;
+        }
+        expr->operation = expr->operation == TAC_OP_TIMES ? TAC_OP_SHL : TAC_OP_SHR;
+        expr->rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = exponent };
     }
+}
 
-    list->count = new_count;
+// A loop counter: a phi in the header that comes in as start and goes around as itself plus or minus an
+// amount that doesn't change in the loop
+typedef struct InductionVariable
+{
+    TACSymbol start;
+    TACSymbol step;
+    TACOp direction; // TAC_OP_PLUS or TAC_OP_MINUS
+    int64_t update; // The expression that steps it
+} InductionVariable;
+
+static bool loop_invariant_symbol(const TACList* list, const TACUseDef* use_def, const TACLoops* loops, const int64_t* location, const int64_t loop, const TACSymbol operand)
+{
+    if (operand.type != TAC_SYMBOL_TYPE_SYMBOL) return false;
+    const int64_t def = tac_use_def_only_def(list, use_def, operand.symbol);
+    return def != -1 && !tac_loop_encloses(loops, loop, location[def]);
+}
+
+static bool find_induction_variable(const TACList* list, const TACUseDef* use_def, const TACLoops* loops, const int64_t* location, const int64_t loop, const int64_t entry_slot, const int64_t phi_idx, InductionVariable* result)
+{
+    const TACExpr phi = list->items[phi_idx];
+    if (phi.arg_count < 2 || phi.lhs.type != TAC_SYMBOL_TYPE_SYMBOL) return false;
+    const TACSymbol next = phi.args[entry_slot == 0 ? 1 : 0];
+    for (int64_t slot = 0; slot < phi.arg_count; slot++)
+    {
+        if (slot != entry_slot && !tac_symbol_equal(phi.args[slot], next)) return false;
+    }
+    if (phi.args[entry_slot].type != TAC_SYMBOL_TYPE_SYMBOL || next.type != TAC_SYMBOL_TYPE_SYMBOL) return false;
+
+    const int64_t update = tac_use_def_only_def(list, use_def, next.symbol);
+    if (update == -1) return false;
+    const TACExpr expr = list->items[update];
+    TACSymbol step;
+    if (expr.operation == TAC_OP_PLUS && tac_symbol_equal(expr.rhs1, phi.lhs)) step = expr.rhs2;
+    else if (expr.operation == TAC_OP_PLUS && tac_symbol_equal(expr.rhs2, phi.lhs)) step = expr.rhs1;
+    else if (expr.operation == TAC_OP_MINUS && tac_symbol_equal(expr.rhs1, phi.lhs)) step = expr.rhs2;
+    else return false;
+    if (!loop_invariant_symbol(list, use_def, loops, location, loop, step)) return false;
+
+    *result = (InductionVariable){ .start = phi.args[entry_slot], .step = step, .direction = expr.operation, .update = update };
+    return true;
+}
+
+static bool int_constant(const TACList* list, const TACUseDef* use_def, const TACSymbol operand, int64_t* value)
+{
+    const int64_t def = tac_use_def_only_def(list, use_def, operand.symbol);
+    if (def == -1 || list->items[def].operation != TAC_OP_INT) return false;
+    *value = list->items[def].rhs1.integer;
+    return true;
+}
+
+// Puts in whatever computes a * b ahead of the loop, skipping it when a constant makes that unnecessary
+static TACSymbol preheader_product(TACList* list, const TACUseDef* use_def, HoistedExpr* inserted, int64_t* inserted_count, const int64_t position, const TACSymbol a, const TACSymbol b)
+{
+    int64_t a_value = 0, b_value = 0;
+    const bool a_constant = int_constant(list, use_def, a, &a_value);
+    const bool b_constant = int_constant(list, use_def, b, &b_value);
+    if (a_constant && a_value == 1) return b;
+    if (b_constant && b_value == 1) return a;
+
+    const TACSymbol result = TAC_request_symbol(list);
+    TACExpr expr = (TACExpr){ .operation = TAC_OP_TIMES, .lhs = result, .rhs1 = a, .rhs2 = b };
+    if ((a_constant && b_constant) || (a_constant && a_value == 0) || (b_constant && b_value == 0))
+    {
+        const int64_t product = wrap_int(a_value * b_value);
+        expr = (TACExpr){ .operation = TAC_OP_INT, .lhs = result, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = product } };
+    }
+    inserted[*inserted_count] = (HoistedExpr){ .position = position, .sequence = *inserted_count, .expr = expr };
+    *inserted_count += 1;
+    return result;
+}
+
+// Strength reduction. A multiply of a loop counter i by an amount k that doesn't change in the loop gets a
+// counter of its own that starts at start * k and steps by step * k wherever i steps, so the loop adds
+// instead of multiplying. Ints wrap at 32 bits either way, so the two always agree. list->cfg is rebuilt
+// when anything changes, use_def is left stale.
+void reduce_induction_variables(TACList* list, TACUseDef* use_def)
+{
+    const CFG* cfg = &list->cfg;
+    if (cfg->reachable_count == 0) return;
+    TACDominators dominators = tac_dominators_init(cfg, GPA);
+    TACLoops loops = tac_loops_init(cfg, &dominators, GPA);
+    if (loops.loop_count == 0)
+    {
+        tac_loops_deinit(&loops);
+        tac_dominators_deinit(&dominators);
+        return;
+    }
+
+    int64_t* location = bh_alloc(GPA, sizeof(int64_t) * list->count);
+    for (int64_t b = 0; b < cfg->block_count; b++)
+    {
+        const CFGBlock* block = &cfg->blocks[b];
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++) location[i] = loops.innermost[b];
+    }
+
+    // Each reduced multiply adds at most four expressions
+    int64_t inserted_count = 0;
+    int64_t inserted_capacity = 16;
+    HoistedExpr* inserted = bh_alloc(GPA, sizeof(HoistedExpr) * inserted_capacity);
+    for (int64_t loop = 0; loop < loops.loop_count; loop++)
+    {
+        const int64_t preheader = tac_loop_preheader_position(list, &loops, loop);
+        const int64_t entry_slot = tac_loop_entry_slot(cfg, &loops, loop);
+        if (preheader == -1) continue;
+
+        const CFGBlock* header = &cfg->blocks[loops.loops[loop].header];
+        for (int64_t p = header->start; p < header->start + header->tac_contents.count; p++)
+        {
+            const TACExpr phi = list->items[p];
+            InductionVariable iv;
+            if (phi.operation != TAC_OP_PHI || phi.arg_count != header->predecessor_count) continue;
+            if (!find_induction_variable(list, use_def, &loops, location, loop, entry_slot, p, &iv)) continue;
+
+            for (int64_t u = use_def->first_use[phi.lhs.symbol]; u != -1; u = use_def->uses[u].next)
+            {
+                const TACUse use = use_def->uses[u];
+                if (!tac_use_def_is_use(list, &use, phi.lhs.symbol)) continue;
+                const TACExpr expr = list->items[use.expr];
+                if (expr.operation != TAC_OP_TIMES || expr.lhs.type != TAC_SYMBOL_TYPE_SYMBOL) continue;
+                if (!tac_loop_encloses(&loops, loop, location[use.expr])) continue;
+                if (tac_use_def_only_def(list, use_def, expr.lhs.symbol) != use.expr) continue;
+                const TACSymbol factor = use.operand == TAC_OPERAND_RHS1 ? expr.rhs2 : expr.rhs1;
+                if (!loop_invariant_symbol(list, use_def, &loops, location, loop, factor)) continue;
+
+                if (inserted_count + 4 > inserted_capacity)
+                {
+                    inserted_capacity *= 2;
+                    inserted = bh_realloc(GPA, inserted, sizeof(HoistedExpr) * inserted_capacity);
+                }
+                const TACSymbol start = preheader_product(list, use_def, inserted, &inserted_count, preheader, iv.start, factor);
+                const TACSymbol step = preheader_product(list, use_def, inserted, &inserted_count, preheader, iv.step, factor);
+                const TACSymbol current = TAC_request_symbol(list);
+                const TACSymbol next = TAC_request_symbol(list);
+                TACExpr reduced = (TACExpr){
+                    .operation = TAC_OP_PHI,
+                    .line_num = phi.line_num,
+                    .lhs = current,
+                    .arg_count = phi.arg_count,
+                    .args = bh_alloc(list->allocator, sizeof(TACSymbol) * phi.arg_count)
+                };
+                for (int64_t slot = 0; slot < phi.arg_count; slot++) reduced.args[slot] = slot == entry_slot ? start : next;
+                inserted[inserted_count] = (HoistedExpr){ .position = p, .sequence = inserted_count, .expr = reduced };
+                inserted_count += 1;
+                inserted[inserted_count] = (HoistedExpr){
+                    .position = iv.update + 1,
+                    .sequence = inserted_count,
+                    .expr = (TACExpr){ .operation = iv.direction, .line_num = expr.line_num, .lhs = next, .rhs1 = current, .rhs2 = step }
+                };
+                inserted_count += 1;
+
+                tac_use_def_replace_uses_after(use_def, list, expr.lhs.symbol, current.symbol, -1);
+                list->items[use.expr] = (TACExpr){ 0 };
+            }
+        }
+    }
+
+    if (inserted_count > 0)
+    {
+        qsort(inserted, inserted_count, sizeof(HoistedExpr), compare_hoisted_exprs);
+        int64_t* positions = bh_alloc(GPA, sizeof(int64_t) * inserted_count);
+        TACExpr* exprs = bh_alloc(GPA, sizeof(TACExpr) * inserted_count);
+        for (int64_t h = 0; h < inserted_count; h++)
+        {
+            positions[h] = inserted[h].position;
+            exprs[h] = inserted[h].expr;
+        }
+        TAC_list_insert_many(list, positions, exprs, inserted_count);
+        generate_cfg_for_tac_list(list);
+        bh_free(GPA, exprs);
+        bh_free(GPA, positions);
+    }
+
+    bh_free(GPA, inserted);
+    bh_free(GPA, location);
+    tac_loops_deinit(&loops);
+    tac_dominators_deinit(&dominators);
 }
 
 void optimize_tac_list(TACList* list)
 {
     PROFILE_BLOCK
     {
-        remove_duplicate_phi_expressions(list);
-        eliminate_dead_tac(list);
-        remove_double_nots(list);
         generate_cfg_for_tac_list(list);
-        perform_substitutions(list);
-        perform_constant_folding(list);
-        eliminate_dead_tac(list);
+        tac_construct_ssa(list);
+        TACUseDef use_def = tac_use_def_init(list, GPA);
+        eliminate_dead_tac(list, &use_def);
+        remove_double_nots(list, &use_def);
+        perform_substitutions(list, &use_def);
+        perform_constant_propagation(list, &use_def);
+        tac_use_def_deinit(&use_def);
+        remove_empty_exprs(list); // Deleted blocks take their expressions with them
+        use_def = tac_use_def_init(list, GPA);
+        generate_cfg_for_tac_list(list);
+        global_value_numbering(list, &use_def);
+        perform_substitutions(list, &use_def);
+        eliminate_dead_tac(list, &use_def);
+        hoist_loop_invariants(list, &use_def);
+        tac_use_def_deinit(&use_def);
+        use_def = tac_use_def_init(list, GPA);
+        shift_by_powers_of_two(list, &use_def);
+        perform_substitutions(list, &use_def);
+        eliminate_dead_tac(list, &use_def);
+        reduce_induction_variables(list, &use_def);
+        tac_destruct_ssa(list); // None of the passes since the CFG was built drop edges or reorder them
+        tac_use_def_deinit(&use_def);
         remove_empty_exprs(list);
-        remove_phi_expressions(list);
         // compress_tac_symbols(list, NULL, 0, 1);
     }
-}
\ No newline at end of file
+}
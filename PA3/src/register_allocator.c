@@ -0,0 +1,496 @@
+#include "register_allocator.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dataflow.h"
+#include "unboxing.h"
+
+// Caller-saved registers come first so short-lived temporaries don't force a save in the prologue
+static const ASMRegister allocatable_registers[] = { RCX, RSI, RDI, R8, R9, R10, R11, RBX, R15 };
+#define ALLOCATABLE_REGISTER_COUNT ((int64_t)(sizeof(allocatable_registers) / sizeof(allocatable_registers[0])))
+
+// Positions are doubled: expression i reads its operands at 2i and writes its result at 2i + 1,
+// and any call it makes happens in between.
+typedef struct LiveInterval
+{
+    int64_t symbol;
+    int64_t start;
+    int64_t end;
+    uint32_t clobbered; // Registers destroyed somewhere strictly inside the interval
+} LiveInterval;
+
+int64_t tac_list_symbol_count(const TACList* list)
+{
+    int64_t max_symbol = list->_curr_symbol;
+    for (int64_t i = 0; i < list->count; i++)
+    {
+        const TACExpr e = list->items[i];
+        if (e.lhs.type == TAC_SYMBOL_TYPE_SYMBOL && e.lhs.symbol > max_symbol) max_symbol = e.lhs.symbol;
+        if (e.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL && e.rhs1.symbol > max_symbol) max_symbol = e.rhs1.symbol;
+        if (e.rhs2.type == TAC_SYMBOL_TYPE_SYMBOL && e.rhs2.symbol > max_symbol) max_symbol = e.rhs2.symbol;
+        if (e.operation == TAC_OP_CALL)
+        {
+            for (int64_t j = 0; j < e.arg_count; j++)
+            {
+                if (e.args[j].type == TAC_SYMBOL_TYPE_SYMBOL && e.args[j].symbol > max_symbol) max_symbol = e.args[j].symbol;
+            }
+        }
+    }
+    return max_symbol + 1;
+}
+
+int64_t tac_expr_defined_symbol(const TACExpr expr)
+{
+    if (expr.lhs.type != TAC_SYMBOL_TYPE_SYMBOL) return -1;
+    switch (expr.operation)
+    {
+    case TAC_OP_ASSIGN:
+    case TAC_OP_PLUS:
+    case TAC_OP_MINUS:
+    case TAC_OP_TIMES:
+    case TAC_OP_DIVIDE:
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+    case TAC_OP_INT:
+    case TAC_OP_STRING:
+    case TAC_OP_BOOL:
+    case TAC_OP_NOT:
+    case TAC_OP_NEG:
+    case TAC_OP_NEW:
+    case TAC_OP_DEFAULT:
+    case TAC_OP_ISVOID:
+    case TAC_OP_BOX:
+    case TAC_OP_SHL:
+    case TAC_OP_SHR:
+    case TAC_OP_LOAD_ATTRIBUTE:
+    case TAC_OP_CALL:
+        return expr.lhs.symbol;
+    default:
+        return -1; // bt and isclass carry a lhs that is never written
+    }
+}
+
+// Fills uses with the temporaries read by the expression at idx, which needs room for arg_count + 2 entries
+int64_t tac_expr_used_symbols(const TACList* list, const int64_t idx, int64_t* uses)
+{
+    const TACExpr expr = list->items[idx];
+    int64_t use_count = 0;
+    switch (expr.operation)
+    {
+    case TAC_OP_BT:
+        // An isclass does the branching for the bt that follows it
+        if (idx > 0 && list->items[idx - 1].operation == TAC_OP_IS_CLASS) break;
+        if (expr.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL) uses[use_count++] = expr.rhs1.symbol;
+        break;
+    case TAC_OP_ASSIGN:
+    case TAC_OP_NOT:
+    case TAC_OP_NEG:
+    case TAC_OP_ISVOID:
+    case TAC_OP_IS_CLASS:
+    case TAC_OP_BOX:
+    case TAC_OP_SHL:
+    case TAC_OP_SHR:
+    case TAC_OP_LOAD_ATTRIBUTE:
+    case TAC_OP_RETURN:
+        if (expr.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL) uses[use_count++] = expr.rhs1.symbol;
+        break;
+    case TAC_OP_PLUS:
+    case TAC_OP_MINUS:
+    case TAC_OP_TIMES:
+    case TAC_OP_DIVIDE:
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+    case TAC_OP_STORE_ATTRIBUTE:
+        if (expr.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL) uses[use_count++] = expr.rhs1.symbol;
+        if (expr.rhs2.type == TAC_SYMBOL_TYPE_SYMBOL) uses[use_count++] = expr.rhs2.symbol;
+        break;
+    case TAC_OP_CALL:
+        for (int64_t j = 0; j < expr.arg_count; j++)
+        {
+            if (expr.args[j].type == TAC_SYMBOL_TYPE_SYMBOL) uses[use_count++] = expr.args[j].symbol;
+        }
+        break;
+    default:
+        break;
+    }
+    return use_count;
+}
+
+// Raw results only call out when they have to be boxed on the way into lhs
+static bool tac_expr_boxes_result(const TACList* list, const TACExpr expr)
+{
+    return tac_expr_result_representation(list, expr) != TAC_REPRESENTATION_BOXED &&
+        tac_symbol_representation(list, expr.lhs) == TAC_REPRESENTATION_BOXED;
+}
+
+// Bools and small Int literals are boxed into a preallocated object without calling out
+static bool tac_expr_boxing_calls(const TACList* list, const TACExpr expr)
+{
+    if (!tac_expr_boxes_result(list, expr)) return false;
+    if (tac_expr_result_representation(list, expr) == TAC_REPRESENTATION_BOOL) return false;
+    return expr.operation != TAC_OP_INT || !asm_int_is_interned(expr.rhs1.integer);
+}
+
+// NOTE: This has to match what asm_from_tac_list emits. Operands are always read before and
+// results written after any call an expression makes, so only intervals that extend past
+// the expression are affected.
+uint32_t tac_expr_clobbered_registers(const TACList* list, const int64_t idx)
+{
+    const TACExpr expr = list->items[idx];
+    switch (expr.operation)
+    {
+    case TAC_OP_STRING:
+    case TAC_OP_NEW:
+    case TAC_OP_CALL:
+        return CALLER_SAVED_REGISTERS;
+    case TAC_OP_BOX:
+        return tac_symbol_representation(list, expr.rhs1) == TAC_REPRESENTATION_BOOL ? 0 : CALLER_SAVED_REGISTERS;
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+        if (tac_expr_is_primitive_comparison(list, expr)) return tac_expr_boxing_calls(list, expr) ? CALLER_SAVED_REGISTERS : 0;
+        // The comparison handlers use r15 as scratch
+        return CALLER_SAVED_REGISTERS | REGISTER_MASK(R15);
+    case TAC_OP_DEFAULT:
+        // Int and Bool defaults are interned, everything else is void
+        return expr.rhs1.variable.atom == BH_ATOM_STRING ? CALLER_SAVED_REGISTERS : 0;
+    case TAC_OP_PLUS:
+    case TAC_OP_MINUS:
+    case TAC_OP_TIMES:
+    case TAC_OP_DIVIDE:
+    case TAC_OP_SHL:
+    case TAC_OP_SHR:
+    case TAC_OP_INT:
+    case TAC_OP_BOOL:
+    case TAC_OP_NOT:
+    case TAC_OP_NEG:
+    case TAC_OP_ISVOID:
+    case TAC_OP_ASSIGN:
+        return tac_expr_boxing_calls(list, expr) ? CALLER_SAVED_REGISTERS : 0;
+    default:
+        return 0;
+    }
+}
+
+int64_t tac_list_max_use_count(const TACList* list)
+{
+    int64_t max_uses = 2;
+    for (int64_t i = 0; i < list->count; i++)
+    {
+        if (list->items[i].operation == TAC_OP_CALL && list->items[i].arg_count + 2 > max_uses)
+        {
+            max_uses = list->items[i].arg_count + 2;
+        }
+    }
+    return max_uses;
+}
+
+// Backward union problem over the temporaries, gen is what a block reads before writing it
+TACLiveness compute_tac_liveness(TACList* list, bh_allocator allocator)
+{
+    const CFG* cfg = &list->cfg;
+    const int64_t symbol_count = tac_list_symbol_count(list);
+    DataflowProblem problem = dataflow_problem_init(cfg, DATAFLOW_BACKWARD, DATAFLOW_MEET_UNION, symbol_count, allocator);
+    int64_t* uses = bh_alloc(allocator, sizeof(int64_t) * tac_list_max_use_count(list));
+
+    for (int64_t b = 0; b < cfg->block_count; b++)
+    {
+        const CFGBlock block = cfg->blocks[b];
+        uint64_t* block_gen = DATAFLOW_SET(&problem, gen, b);
+        uint64_t* block_kill = DATAFLOW_SET(&problem, kill, b);
+        for (int64_t i = block.start; i < block.start + block.tac_contents.count; i++)
+        {
+            const int64_t use_count = tac_expr_used_symbols(list, i, uses);
+            for (int64_t u = 0; u < use_count; u++)
+            {
+                if (!BITSET_GET(block_kill, uses[u])) BITSET_SET(block_gen, uses[u]);
+            }
+            const int64_t def = tac_expr_defined_symbol(list->items[i]);
+            if (def > -1) BITSET_SET(block_kill, def);
+        }
+    }
+    dataflow_solve(&problem, cfg);
+    bh_free(allocator, uses);
+
+    const TACLiveness liveness = (TACLiveness){
+        .symbol_count = symbol_count,
+        .word_count = problem.word_count,
+        .live_in = problem.in,
+        .live_out = problem.out
+    };
+    bh_free(allocator, problem.gen);
+    bh_free(allocator, problem.kill);
+    return liveness;
+}
+
+static void live_interval_extend(LiveInterval* interval, const int64_t position)
+{
+    if (position < interval->start) interval->start = position;
+    if (position > interval->end) interval->end = position;
+}
+
+static int compare_intervals_by_start(const void* a, const void* b)
+{
+    const LiveInterval* i1 = a;
+    const LiveInterval* i2 = b;
+    if (i1->start != i2->start) return i1->start < i2->start ? -1 : 1;
+    return i1->symbol < i2->symbol ? -1 : i1->symbol > i2->symbol;
+}
+
+// Walks every block backwards from its live-out set to find what has to survive each call. Unlike the
+// intervals this is exact, so the stack maps never name a location holding a dead or stale value.
+static void compute_live_across(const TACList* list, const TACLiveness* liveness, RegisterAllocation* allocation, bh_allocator allocator)
+{
+    // The scratch comes first so live_across stays the newest allocation, arenas only grow that one in place
+    uint64_t* live = bh_alloc(allocator, sizeof(uint64_t) * (liveness->word_count > 0 ? liveness->word_count : 1));
+    int64_t* uses = bh_alloc(allocator, sizeof(int64_t) * tac_list_max_use_count(list));
+
+    int64_t capacity = 64;
+    int64_t total = 0;
+    allocation->live_across_start = bh_alloc(allocator, sizeof(int64_t) * (list->count + 1));
+    allocation->live_across_count = bh_alloc(allocator, sizeof(int64_t) * (list->count + 1));
+    allocation->live_across = bh_alloc(allocator, sizeof(int64_t) * capacity);
+    memset(allocation->live_across_start, 0, sizeof(int64_t) * (list->count + 1));
+    memset(allocation->live_across_count, 0, sizeof(int64_t) * (list->count + 1));
+    for (int64_t b = 0; b < list->cfg.block_count; b++)
+    {
+        const CFGBlock block = list->cfg.blocks[b];
+        memcpy(live, &liveness->live_out[b * liveness->word_count], sizeof(uint64_t) * liveness->word_count);
+        for (int64_t i = block.start + block.tac_contents.count - 1; i >= block.start; i--)
+        {
+            const int64_t def = tac_expr_defined_symbol(list->items[i]);
+            if (def > -1) BITSET_CLEAR(live, def);
+
+            if (tac_expr_clobbered_registers(list, i))
+            {
+                allocation->live_across_start[i] = total;
+                for (int64_t w = 0; w < liveness->word_count; w++)
+                {
+                    for (uint64_t bits = live[w]; bits; bits &= bits - 1)
+                    {
+                        if (total + 1 >= capacity)
+                        {
+                            capacity *= 2;
+                            allocation->live_across = bh_realloc(allocator, allocation->live_across, sizeof(int64_t) * capacity);
+                        }
+                        allocation->live_across[total++] = w * 64 + __builtin_ctzll(bits);
+                    }
+                }
+                allocation->live_across_count[i] = total - allocation->live_across_start[i];
+            }
+
+            const int64_t use_count = tac_expr_used_symbols(list, i, uses);
+            for (int64_t u = 0; u < use_count; u++)
+            {
+                BITSET_SET(live, uses[u]);
+            }
+        }
+
+    }
+    bh_free(allocator, uses);
+    bh_free(allocator, live);
+}
+
+RegisterAllocation allocate_registers(TACList* list, bh_allocator allocator)
+{
+    // Earlier passes move expressions around, so the blocks have to be rebuilt first
+    generate_cfg_for_tac_list(list);
+    const TACLiveness liveness = compute_tac_liveness(list, allocator);
+    const int64_t symbol_count = liveness.symbol_count;
+
+    RegisterAllocation allocation = (RegisterAllocation){ .symbol_count = symbol_count };
+    allocation.registers = bh_alloc(allocator, sizeof(ASMRegister) * symbol_count);
+    allocation.stack_slots = bh_alloc(allocator, sizeof(int64_t) * symbol_count);
+    for (int64_t s = 0; s < symbol_count; s++)
+    {
+        allocation.registers[s] = INVALID_REGISTER;
+        allocation.stack_slots[s] = -1;
+    }
+
+    // Build one interval per temporary covering every position it is live at
+    LiveInterval* intervals = bh_alloc(allocator, sizeof(LiveInterval) * symbol_count);
+    for (int64_t s = 0; s < symbol_count; s++)
+    {
+        intervals[s] = (LiveInterval){ .symbol = s, .start = INT64_MAX, .end = -1 };
+    }
+    int64_t* uses = bh_alloc(allocator, sizeof(int64_t) * tac_list_max_use_count(list));
+    for (int64_t b = 0; b < list->cfg.block_count; b++)
+    {
+        const CFGBlock block = list->cfg.blocks[b];
+        const int64_t block_end = block.start + block.tac_contents.count - 1;
+        const uint64_t* in = &liveness.live_in[b * liveness.word_count];
+        const uint64_t* out = &liveness.live_out[b * liveness.word_count];
+        // Only the set bits matter, so walk those instead of every symbol
+        for (int64_t w = 0; w < liveness.word_count; w++)
+        {
+            for (uint64_t bits = in[w]; bits; bits &= bits - 1)
+            {
+                live_interval_extend(&intervals[w * 64 + __builtin_ctzll(bits)], 2 * block.start);
+            }
+            for (uint64_t bits = out[w]; bits; bits &= bits - 1)
+            {
+                live_interval_extend(&intervals[w * 64 + __builtin_ctzll(bits)], 2 * block_end + 1);
+            }
+        }
+        for (int64_t i = block.start; i <= block_end; i++)
+        {
+            const int64_t use_count = tac_expr_used_symbols(list, i, uses);
+            for (int64_t u = 0; u < use_count; u++)
+            {
+                live_interval_extend(&intervals[uses[u]], 2 * i);
+            }
+            const int64_t def = tac_expr_defined_symbol(list->items[i]);
+            if (def > -1) live_interval_extend(&intervals[def], 2 * i + 1);
+        }
+    }
+    bh_free(allocator, uses);
+
+    // clobber_counts[r][i] is the number of expressions before i that destroy register r
+    uint32_t all_clobbered = 0;
+    int32_t* clobber_counts = bh_alloc(allocator, sizeof(int32_t) * ALLOCATABLE_REGISTER_COUNT * (list->count + 1));
+    for (int64_t r = 0; r < ALLOCATABLE_REGISTER_COUNT; r++)
+    {
+        clobber_counts[r * (list->count + 1)] = 0;
+    }
+    for (int64_t i = 0; i < list->count; i++)
+    {
+        const uint32_t clobbered = tac_expr_clobbered_registers(list, i);
+        all_clobbered |= clobbered;
+        for (int64_t r = 0; r < ALLOCATABLE_REGISTER_COUNT; r++)
+        {
+            int32_t* counts = &clobber_counts[r * (list->count + 1)];
+            counts[i + 1] = counts[i] + ((clobbered & REGISTER_MASK(allocatable_registers[r])) != 0);
+        }
+    }
+
+    int64_t interval_count = 0;
+    for (int64_t s = 0; s < symbol_count; s++)
+    {
+        if (intervals[s].end < 0) continue;
+        LiveInterval interval = intervals[s];
+        // Expression i destroys the interval's register if start <= 2i and 2i + 1 <= end
+        const int64_t first = (interval.start + 1) / 2;
+        const int64_t last = (interval.end - 1) / 2;
+        for (int64_t r = 0; r < ALLOCATABLE_REGISTER_COUNT && first <= last && interval.end > 0; r++)
+        {
+            const int32_t* counts = &clobber_counts[r * (list->count + 1)];
+            if (counts[last + 1] - counts[first] > 0)
+            {
+                interval.clobbered |= REGISTER_MASK(allocatable_registers[r]);
+            }
+        }
+        intervals[interval_count++] = interval;
+    }
+    bh_free(allocator, clobber_counts);
+    qsort(intervals, interval_count, sizeof(LiveInterval), compare_intervals_by_start);
+
+    // Linear scan. Intervals are never split, a spilled symbol lives on the stack for its whole lifetime.
+    LiveInterval** active = bh_alloc(allocator, sizeof(LiveInterval*) * (ALLOCATABLE_REGISTER_COUNT + 1));
+    int64_t active_count = 0;
+    bool* spilled = bh_alloc(allocator, sizeof(bool) * (interval_count + 1));
+    for (int64_t i = 0; i < interval_count; i++)
+    {
+        LiveInterval* interval = &intervals[i];
+        spilled[i] = false;
+
+        uint32_t in_use = 0;
+        int64_t kept = 0;
+        for (int64_t a = 0; a < active_count; a++)
+        {
+            if (active[a]->end >= interval->start)
+            {
+                active[kept++] = active[a];
+                in_use |= REGISTER_MASK(allocation.registers[active[a]->symbol]);
+            }
+        }
+        active_count = kept;
+
+        ASMRegister chosen = INVALID_REGISTER;
+        for (int64_t r = 0; r < ALLOCATABLE_REGISTER_COUNT; r++)
+        {
+            const uint32_t mask = REGISTER_MASK(allocatable_registers[r]);
+            if (!(in_use & mask) && !(interval->clobbered & mask))
+            {
+                chosen = allocatable_registers[r];
+                break;
+            }
+        }
+
+        if (chosen == INVALID_REGISTER)
+        {
+            // Steal from the active interval that lives the longest, if that outlives this one
+            int64_t victim = -1;
+            for (int64_t a = 0; a < active_count; a++)
+            {
+                if (interval->clobbered & REGISTER_MASK(allocation.registers[active[a]->symbol])) continue;
+                if (victim == -1 || active[a]->end > active[victim]->end) victim = a;
+            }
+            if (victim == -1 || active[victim]->end <= interval->end)
+            {
+                spilled[i] = true;
+                continue;
+            }
+            chosen = allocation.registers[active[victim]->symbol];
+            allocation.registers[active[victim]->symbol] = INVALID_REGISTER;
+            spilled[active[victim] - intervals] = true;
+            active[victim] = active[--active_count];
+        }
+
+        allocation.registers[interval->symbol] = chosen;
+        active[active_count++] = interval;
+    }
+
+    // Give spilled intervals stack slots, reusing the ones whose owners have died
+    int64_t* slot_ends = bh_alloc(allocator, sizeof(int64_t) * (interval_count + 1));
+    for (int64_t i = 0; i < interval_count; i++)
+    {
+        if (!spilled[i]) continue;
+        int64_t slot = -1;
+        for (int64_t k = 0; k < allocation.stack_slot_count; k++)
+        {
+            if (slot_ends[k] < intervals[i].start)
+            {
+                slot = k;
+                break;
+            }
+        }
+        if (slot == -1) slot = allocation.stack_slot_count++;
+        slot_ends[slot] = intervals[i].end;
+        allocation.stack_slots[intervals[i].symbol] = slot + 1;
+    }
+
+    // Callee-saved registers have to be preserved whether we allocated them or the code clobbers them
+    allocation.callee_saved = all_clobbered & CALLEE_SAVED_REGISTERS;
+    for (int64_t s = 0; s < symbol_count; s++)
+    {
+        if (allocation.registers[s] != INVALID_REGISTER)
+        {
+            allocation.callee_saved |= REGISTER_MASK(allocation.registers[s]) & CALLEE_SAVED_REGISTERS;
+        }
+    }
+
+    compute_live_across(list, &liveness, &allocation, allocator);
+
+    bh_free(allocator, slot_ends);
+    bh_free(allocator, spilled);
+    bh_free(allocator, active);
+    bh_free(allocator, intervals);
+    bh_free(allocator, liveness.live_in);
+    bh_free(allocator, liveness.live_out);
+
+    return allocation;
+}
+
+void register_allocation_deinit(RegisterAllocation* allocation, bh_allocator allocator)
+{
+    bh_free(allocator, allocation->registers);
+    bh_free(allocator, allocation->stack_slots);
+    bh_free(allocator, allocation->live_across_start);
+    bh_free(allocator, allocation->live_across_count);
+    bh_free(allocator, allocation->live_across);
+    *allocation = (RegisterAllocation){ 0 };
+}
@@ -0,0 +1,50 @@
+#ifndef REGISTER_ALLOCATOR_H
+#define REGISTER_ALLOCATOR_H
+
+#include <stdint.h>
+
+#include "assembly.h"
+#include "tac.h"
+
+#define REGISTER_MASK(reg) (1u << (reg))
+
+// Registers that do not survive a call into generated code, a constructor or the C runtime
+#define CALLER_SAVED_REGISTERS (REGISTER_MASK(RAX) | REGISTER_MASK(RCX) | REGISTER_MASK(RDX) | \
+    REGISTER_MASK(RSI) | REGISTER_MASK(RDI) | REGISTER_MASK(R8) | REGISTER_MASK(R9) | \
+    REGISTER_MASK(R10) | REGISTER_MASK(R11) | REGISTER_MASK(R13) | REGISTER_MASK(R14))
+// Registers every method and constructor restores before returning
+#define CALLEE_SAVED_REGISTERS (REGISTER_MASK(RBX) | REGISTER_MASK(R15))
+
+typedef struct TACLiveness
+{
+    int64_t symbol_count;
+    int64_t word_count; // Words per bitset
+    uint64_t* live_in; // block_count * word_count
+    uint64_t* live_out;
+} TACLiveness;
+
+typedef struct RegisterAllocation
+{
+    int64_t symbol_count;
+    ASMRegister* registers; // INVALID_REGISTER if the symbol was spilled
+    int64_t* stack_slots; // Words below RBP for spilled symbols
+    int64_t stack_slot_count;
+    uint32_t callee_saved; // Callee-saved registers the code writes to
+    // Temporaries live both before and after each expression that calls out, entries
+    // live_across_start[i] .. live_across_start[i] + live_across_count[i] of live_across
+    int64_t* live_across_start;
+    int64_t* live_across_count;
+    int64_t* live_across;
+} RegisterAllocation;
+
+int64_t tac_list_symbol_count(const TACList* list);
+int64_t tac_expr_defined_symbol(TACExpr expr);
+int64_t tac_expr_used_symbols(const TACList* list, int64_t idx, int64_t* uses);
+int64_t tac_list_max_use_count(const TACList* list);
+uint32_t tac_expr_clobbered_registers(const TACList* list, int64_t idx);
+
+TACLiveness compute_tac_liveness(TACList* list, bh_allocator allocator);
+RegisterAllocation allocate_registers(TACList* list, bh_allocator allocator);
+void register_allocation_deinit(RegisterAllocation* allocation, bh_allocator allocator);
+
+#endif //REGISTER_ALLOCATOR_H
@@ -0,0 +1,518 @@
+#include "ssa.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "use_def.h"
+
+#pragma region Dominators
+
+static int64_t intersect_dominators(const TACDominators* dominators, int64_t a, int64_t b)
+{
+    while (a != b)
+    {
+        while (dominators->order_index[a] > dominators->order_index[b]) a = dominators->idom[a];
+        while (dominators->order_index[b] > dominators->order_index[a]) b = dominators->idom[b];
+    }
+    return a;
+}
+
+TACDominators tac_dominators_init(const CFG* cfg, bh_allocator allocator)
+{
+    const int64_t block_count = cfg->block_count > 0 ? cfg->block_count : 1;
+    TACDominators dominators = (TACDominators){
+        .block_count = cfg->block_count,
+        .idom = bh_alloc(allocator, sizeof(int64_t) * block_count),
+        .order_index = bh_alloc(allocator, sizeof(int64_t) * block_count),
+        .first_child = bh_alloc(allocator, sizeof(int64_t) * block_count),
+        .next_sibling = bh_alloc(allocator, sizeof(int64_t) * block_count),
+        .allocator = allocator
+    };
+    for (int64_t o = 0; o < cfg->block_count; o++)
+    {
+        dominators.idom[cfg->order[o]] = -1;
+        dominators.order_index[cfg->order[o]] = o;
+        dominators.first_child[cfg->order[o]] = -1;
+        dominators.next_sibling[cfg->order[o]] = -1;
+    }
+    if (cfg->reachable_count == 0) return dominators;
+    dominators.idom[cfg->order[0]] = cfg->order[0];
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int64_t o = 1; o < cfg->reachable_count; o++)
+        {
+            const CFGBlock* block = &cfg->blocks[cfg->order[o]];
+            int64_t idom = -1;
+            for (int64_t p = 0; p < block->predecessor_count; p++)
+            {
+                const int64_t predecessor = cfg->predecessors[block->first_predecessor + p];
+                if (dominators.idom[predecessor] == -1) continue;
+                idom = idom == -1 ? predecessor : intersect_dominators(&dominators, predecessor, idom);
+            }
+            if (dominators.idom[block->id] != idom)
+            {
+                dominators.idom[block->id] = idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (int64_t o = cfg->reachable_count - 1; o > 0; o--)
+    {
+        const int64_t b = cfg->order[o];
+        dominators.next_sibling[b] = dominators.first_child[dominators.idom[b]];
+        dominators.first_child[dominators.idom[b]] = b;
+    }
+    return dominators;
+}
+
+void tac_dominators_deinit(TACDominators* dominators)
+{
+    bh_free(dominators->allocator, dominators->next_sibling);
+    bh_free(dominators->allocator, dominators->first_child);
+    bh_free(dominators->allocator, dominators->order_index);
+    bh_free(dominators->allocator, dominators->idom);
+}
+
+// Whether every path from the entry to b goes through a
+bool tac_dominates(const TACDominators* dominators, const int64_t a, int64_t b)
+{
+    if (dominators->idom[a] == -1 || dominators->idom[b] == -1) return false;
+    while (dominators->order_index[b] > dominators->order_index[a]) b = dominators->idom[b];
+    return a == b;
+}
+
+#pragma endregion
+
+#pragma region Construction
+
+typedef struct DominanceFrontier
+{
+    int64_t block;
+    int64_t next; // Next entry for the same block, -1 at the end
+} DominanceFrontier;
+
+static bool is_block_header(const TACExpr expr)
+{
+    return expr.operation == TAC_OP_LABEL || expr.operation == TAC_OP_COMMENT;
+}
+
+// Phis go right after the labels a block starts with
+static int64_t phi_position(const TACList* list, const CFGBlock* block)
+{
+    int64_t position = block->start;
+    while (position < block->start + block->tac_contents.count && is_block_header(list->items[position])) position += 1;
+    return position;
+}
+
+// Places phis for every temporary that is written more than once and read in some block before being
+// written there, at the iterated dominance frontier of its writes. Every write then gets a fresh
+// temporary on a walk down the dominator tree. Blocks that can't be reached are left as they are.
+void tac_construct_ssa(TACList* list)
+{
+    const CFG* cfg = &list->cfg;
+    if (cfg->reachable_count == 0) return;
+
+    TACUseDef use_def = tac_use_def_init(list, GPA);
+    const int64_t symbol_count = use_def.symbol_count;
+    if (list->_curr_symbol < symbol_count) list->_curr_symbol = symbol_count;
+    TACDominators dominators = tac_dominators_init(cfg, GPA);
+
+    // Dominance frontiers, walking up from the predecessors of each join
+    int64_t* frontier_first = bh_alloc(GPA, sizeof(int64_t) * cfg->block_count);
+    memset(frontier_first, -1, sizeof(int64_t) * cfg->block_count);
+    int64_t frontier_count = 0;
+    int64_t frontier_capacity = 64;
+    DominanceFrontier* frontiers = bh_alloc(GPA, sizeof(DominanceFrontier) * frontier_capacity);
+    for (int64_t o = 0; o < cfg->reachable_count; o++)
+    {
+        const CFGBlock* block = &cfg->blocks[cfg->order[o]];
+        if (block->predecessor_count < 2) continue;
+        for (int64_t p = 0; p < block->predecessor_count; p++)
+        {
+            int64_t runner = cfg->predecessors[block->first_predecessor + p];
+            if (dominators.idom[runner] == -1) continue;
+            while (runner != dominators.idom[block->id])
+            {
+                const int64_t head = frontier_first[runner];
+                if (head != -1 && frontiers[head].block == block->id) break;
+                if (frontier_count == frontier_capacity)
+                {
+                    frontier_capacity *= 2;
+                    frontiers = bh_realloc(GPA, frontiers, sizeof(DominanceFrontier) * frontier_capacity);
+                }
+                frontiers[frontier_count] = (DominanceFrontier){ .block = block->id, .next = head };
+                frontier_first[runner] = frontier_count++;
+                runner = dominators.idom[runner];
+            }
+        }
+    }
+
+    // Which temporaries need renaming, and which of those are read across blocks
+    int64_t* block_of = bh_alloc(GPA, sizeof(int64_t) * (list->count > 0 ? list->count : 1));
+    int64_t* def_counts = bh_alloc(GPA, sizeof(int64_t) * (symbol_count > 0 ? symbol_count : 1));
+    int64_t* stamps = bh_alloc(GPA, sizeof(int64_t) * (symbol_count > 0 ? symbol_count : 1));
+    bool* is_global = bh_alloc(GPA, sizeof(bool) * (symbol_count > 0 ? symbol_count : 1));
+    memset(def_counts, 0, sizeof(int64_t) * symbol_count);
+    memset(stamps, -1, sizeof(int64_t) * symbol_count);
+    memset(is_global, 0, sizeof(bool) * symbol_count);
+    for (int64_t b = 0; b < cfg->block_count; b++)
+    {
+        const CFGBlock* block = &cfg->blocks[b];
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+        {
+            block_of[i] = b;
+            TACExpr expr = list->items[i];
+            for (int64_t o = 0; o < tac_expr_operand_count(expr); o++)
+            {
+                const TACSymbol operand = *tac_expr_operand(&expr, o);
+                if (operand.type != TAC_SYMBOL_TYPE_SYMBOL || operand.symbol >= symbol_count) continue;
+                if (stamps[operand.symbol] != b) is_global[operand.symbol] = true;
+            }
+            if (expr.lhs.type != TAC_SYMBOL_TYPE_SYMBOL || expr.operation == TAC_OP_NULL) continue;
+            def_counts[expr.lhs.symbol] += 1;
+            stamps[expr.lhs.symbol] = b;
+        }
+    }
+
+    // Phi placement, one temporary at a time. has_phi and queued hold the last temporary that marked them.
+    int64_t* phi_counts = bh_alloc(GPA, sizeof(int64_t) * (cfg->block_count + 1));
+    memset(phi_counts, 0, sizeof(int64_t) * (cfg->block_count + 1));
+    int64_t placement_count = 0;
+    int64_t placement_capacity = 64;
+    int64_t* placements = bh_alloc(GPA, sizeof(int64_t) * 2 * placement_capacity); // Block, temporary pairs
+    int64_t* has_phi = bh_alloc(GPA, sizeof(int64_t) * cfg->block_count);
+    int64_t* queued = bh_alloc(GPA, sizeof(int64_t) * cfg->block_count);
+    int64_t* worklist = bh_alloc(GPA, sizeof(int64_t) * cfg->block_count);
+    memset(has_phi, -1, sizeof(int64_t) * cfg->block_count);
+    memset(queued, -1, sizeof(int64_t) * cfg->block_count);
+    for (int64_t symbol = 0; symbol < symbol_count; symbol++)
+    {
+        if (def_counts[symbol] < 2 || !is_global[symbol]) continue;
+        int64_t worklist_count = 0;
+        for (int64_t entry = use_def.first_def[symbol]; entry != -1; entry = use_def.defs[entry].next)
+        {
+            if (!tac_use_def_is_def(list, &use_def.defs[entry], symbol)) continue;
+            const int64_t b = block_of[use_def.defs[entry].expr];
+            if (dominators.idom[b] == -1 || queued[b] == symbol) continue;
+            queued[b] = symbol;
+            worklist[worklist_count++] = b;
+        }
+        while (worklist_count > 0)
+        {
+            const int64_t b = worklist[--worklist_count];
+            for (int64_t entry = frontier_first[b]; entry != -1; entry = frontiers[entry].next)
+            {
+                const int64_t frontier = frontiers[entry].block;
+                if (has_phi[frontier] == symbol) continue;
+                has_phi[frontier] = symbol;
+                if (placement_count == placement_capacity)
+                {
+                    placement_capacity *= 2;
+                    placements = bh_realloc(GPA, placements, sizeof(int64_t) * 2 * placement_capacity);
+                }
+                placements[placement_count * 2] = frontier;
+                placements[placement_count * 2 + 1] = symbol;
+                placement_count += 1;
+                phi_counts[frontier + 1] += 1;
+                if (queued[frontier] == symbol) continue;
+                queued[frontier] = symbol;
+                worklist[worklist_count++] = frontier;
+            }
+        }
+    }
+
+    // Phis are sorted by block so they can go in with one pass over the list
+    for (int64_t b = 0; b < cfg->block_count; b++) phi_counts[b + 1] += phi_counts[b];
+    int64_t* positions = bh_alloc(GPA, sizeof(int64_t) * (placement_count > 0 ? placement_count : 1));
+    TACExpr* phis = bh_alloc(GPA, sizeof(TACExpr) * (placement_count > 0 ? placement_count : 1));
+    for (int64_t p = 0; p < placement_count; p++)
+    {
+        const CFGBlock* block = &cfg->blocks[placements[p * 2]];
+        const TACSymbol symbol = (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = placements[p * 2 + 1] };
+        const int64_t slot = phi_counts[block->id]++;
+        positions[slot] = phi_position(list, block);
+        phis[slot] = (TACExpr){
+            .operation = TAC_OP_PHI,
+            .lhs = symbol,
+            .arg_count = block->predecessor_count,
+            .args = bh_alloc(list->allocator, sizeof(TACSymbol) * block->predecessor_count)
+        };
+        for (int64_t k = 0; k < block->predecessor_count; k++) phis[slot].args[k] = symbol;
+    }
+    TAC_list_insert_many(list, positions, phis, placement_count);
+    generate_cfg_for_tac_list(list); // Same blocks, shifted over
+
+    // Renaming. current holds the name each temporary goes by at this point of the walk, and the undo log
+    // what it went by before each write so leaving a block can restore it.
+    TACSymbol* current = bh_alloc(GPA, sizeof(TACSymbol) * (symbol_count > 0 ? symbol_count : 1));
+    for (int64_t symbol = 0; symbol < symbol_count; symbol++) current[symbol] = (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = symbol };
+    int64_t* phi_symbols = bh_alloc(GPA, sizeof(int64_t) * (list->count > 0 ? list->count : 1));
+    for (int64_t i = 0; i < list->count; i++)
+    {
+        phi_symbols[i] = list->items[i].operation == TAC_OP_PHI ? list->items[i].lhs.symbol : -1;
+    }
+    int64_t* undo_symbols = bh_alloc(GPA, sizeof(int64_t) * (list->count > 0 ? list->count : 1));
+    TACSymbol* undo_names = bh_alloc(GPA, sizeof(TACSymbol) * (list->count > 0 ? list->count : 1));
+    int64_t undo_count = 0;
+    int64_t* undo_marks = bh_alloc(GPA, sizeof(int64_t) * cfg->block_count);
+
+    // Entered blocks are pushed again as ~block so they get left after their children
+    int64_t* stack = bh_alloc(GPA, sizeof(int64_t) * 2 * cfg->block_count);
+    int64_t stack_count = 0;
+    stack[stack_count++] = cfg->order[0];
+    while (stack_count > 0)
+    {
+        const int64_t entry = stack[--stack_count];
+        if (entry < 0)
+        {
+            const int64_t b = ~entry;
+            while (undo_count > undo_marks[b])
+            {
+                undo_count -= 1;
+                current[undo_symbols[undo_count]] = undo_names[undo_count];
+            }
+            continue;
+        }
+
+        const CFGBlock* block = &cfg->blocks[entry];
+        undo_marks[entry] = undo_count;
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+        {
+            TACExpr* expr = &list->items[i];
+            if (expr->operation != TAC_OP_PHI)
+            {
+                for (int64_t o = 0; o < tac_expr_operand_count(*expr); o++)
+                {
+                    TACSymbol* operand = tac_expr_operand(expr, o);
+                    if (operand->type != TAC_SYMBOL_TYPE_SYMBOL || operand->symbol >= symbol_count || def_counts[operand->symbol] < 2) continue;
+                    *operand = current[operand->symbol];
+                }
+            }
+            if (expr->operation == TAC_OP_NULL || expr->lhs.type != TAC_SYMBOL_TYPE_SYMBOL) continue;
+            if (expr->lhs.symbol >= symbol_count || def_counts[expr->lhs.symbol] < 2) continue;
+            undo_symbols[undo_count] = expr->lhs.symbol;
+            undo_names[undo_count] = current[expr->lhs.symbol];
+            undo_count += 1;
+            current[expr->lhs.symbol] = TAC_request_symbol(list);
+            expr->lhs = current[expr->lhs.symbol];
+        }
+
+        for (int n = 0; n < 2; n++)
+        {
+            const CFGBlock* next = block->next[n];
+            if (!next) continue;
+            const int64_t slot = cfg_predecessor_slot(cfg, next->id, entry, n);
+            for (int64_t i = next->start; i < next->start + next->tac_contents.count; i++)
+            {
+                if (phi_symbols[i] == -1) continue;
+                list->items[i].args[slot] = current[phi_symbols[i]];
+            }
+        }
+
+        stack[stack_count++] = ~entry;
+        for (int64_t child = dominators.first_child[entry]; child != -1; child = dominators.next_sibling[child]) stack[stack_count++] = child;
+    }
+
+    bh_free(GPA, stack);
+    bh_free(GPA, undo_marks);
+    bh_free(GPA, undo_names);
+    bh_free(GPA, undo_symbols);
+    bh_free(GPA, phi_symbols);
+    bh_free(GPA, current);
+    bh_free(GPA, phis);
+    bh_free(GPA, positions);
+    bh_free(GPA, worklist);
+    bh_free(GPA, queued);
+    bh_free(GPA, has_phi);
+    bh_free(GPA, placements);
+    bh_free(GPA, phi_counts);
+    bh_free(GPA, is_global);
+    bh_free(GPA, stamps);
+    bh_free(GPA, def_counts);
+    bh_free(GPA, block_of);
+    bh_free(GPA, frontiers);
+    bh_free(GPA, frontier_first);
+    tac_dominators_deinit(&dominators);
+    tac_use_def_deinit(&use_def);
+}
+
+#pragma endregion
+
+#pragma region Destruction
+
+typedef struct CopyInsertion
+{
+    int64_t position;
+    int64_t priority; // Edge copies, then a jump past split edges, then the split edges
+    int64_t sequence;
+    TACExpr expr;
+} CopyInsertion;
+
+typedef struct CopyInsertions
+{
+    CopyInsertion* items;
+    int64_t count;
+    int64_t capacity;
+} CopyInsertions;
+
+static void copy_insertions_append(CopyInsertions* insertions, const int64_t position, const int64_t priority, const TACExpr expr)
+{
+    if (insertions->count == insertions->capacity)
+    {
+        insertions->capacity *= 2;
+        insertions->items = bh_realloc(GPA, insertions->items, sizeof(CopyInsertion) * insertions->capacity);
+    }
+    insertions->items[insertions->count] = (CopyInsertion){
+        .position = position,
+        .priority = priority,
+        .sequence = insertions->count,
+        .expr = expr
+    };
+    insertions->count += 1;
+}
+
+static int compare_copy_insertions(const void* a, const void* b)
+{
+    const CopyInsertion* x = a;
+    const CopyInsertion* y = b;
+    if (x->position != y->position) return x->position < y->position ? -1 : 1;
+    if (x->priority != y->priority) return x->priority < y->priority ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : x->sequence > y->sequence;
+}
+
+// Orders a parallel copy so nothing is overwritten before it's read, breaking cycles through a new temporary
+static void sequentialize_copies(TACList* list, CopyInsertions* insertions, const int64_t position, const int64_t priority,
+                                 TACSymbol* destinations, TACSymbol* sources, int64_t count)
+{
+    while (count > 0)
+    {
+        bool emitted = false;
+        for (int64_t i = 0; i < count && !emitted; i++)
+        {
+            bool is_read = false;
+            for (int64_t j = 0; j < count && !is_read; j++)
+            {
+                is_read = j != i && tac_symbol_equal(sources[j], destinations[i]);
+            }
+            if (is_read) continue;
+
+            const TACExpr copy = (TACExpr){ .operation = TAC_OP_ASSIGN, .lhs = destinations[i], .rhs1 = sources[i] };
+            copy_insertions_append(insertions, position, priority, copy);
+            count -= 1;
+            destinations[i] = destinations[count];
+            sources[i] = sources[count];
+            emitted = true;
+        }
+        if (emitted) continue;
+
+        // Only cycles are left, so save one destination off to the side and read it from there
+        const TACSymbol saved = TAC_request_symbol(list);
+        copy_insertions_append(insertions, position, priority, (TACExpr){ .operation = TAC_OP_ASSIGN, .lhs = saved, .rhs1 = destinations[0] });
+        for (int64_t j = 0; j < count; j++)
+        {
+            if (tac_symbol_equal(sources[j], destinations[0])) sources[j] = saved;
+        }
+    }
+}
+
+// Replaces the phis of each block with copies on its incoming edges. Edges leaving through a branch to a
+// block with phis get a block of their own right in front of it, jumped over by whatever falls into it.
+// Phis are nulled out for remove_empty_exprs and list->cfg is left stale.
+void tac_destruct_ssa(TACList* list)
+{
+    const CFG* cfg = &list->cfg;
+    CopyInsertions insertions = (CopyInsertions){ .capacity = 64, .items = bh_alloc(GPA, sizeof(CopyInsertion) * 64) };
+    int64_t copy_capacity = 16;
+    TACSymbol* destinations = bh_alloc(GPA, sizeof(TACSymbol) * copy_capacity);
+    TACSymbol* sources = bh_alloc(GPA, sizeof(TACSymbol) * copy_capacity);
+
+    for (int64_t b = 0; b < cfg->block_count; b++)
+    {
+        const CFGBlock* block = &cfg->blocks[b];
+        int64_t phi_count = 0;
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+        {
+            if (list->items[i].operation == TAC_OP_PHI) phi_count += 1;
+        }
+        if (phi_count == 0) continue;
+        if (phi_count > copy_capacity)
+        {
+            copy_capacity = phi_count;
+            destinations = bh_realloc(GPA, destinations, sizeof(TACSymbol) * copy_capacity);
+            sources = bh_realloc(GPA, sources, sizeof(TACSymbol) * copy_capacity);
+        }
+
+        bool jumped_over = false;
+        for (int64_t slot = 0; slot < block->predecessor_count; slot++)
+        {
+            int64_t count = 0;
+            for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+            {
+                const TACExpr phi = list->items[i];
+                if (phi.operation != TAC_OP_PHI || tac_symbol_equal(phi.lhs, phi.args[slot])) continue;
+                destinations[count] = phi.lhs;
+                sources[count] = phi.args[slot];
+                count += 1;
+            }
+            if (count == 0) continue;
+
+            const CFGBlock* predecessor = &cfg->blocks[cfg->predecessors[block->first_predecessor + slot]];
+            const int64_t last_idx = predecessor->start + predecessor->tac_contents.count - 1;
+            const TACOp last = list->items[last_idx].operation;
+            if (last == TAC_OP_JMP)
+            {
+                sequentialize_copies(list, &insertions, last_idx, 0, destinations, sources, count);
+            }
+            else if (last != TAC_OP_BT || cfg_predecessor_edge(cfg, b, slot) == 0)
+            {
+                sequentialize_copies(list, &insertions, last_idx + 1, 0, destinations, sources, count);
+            }
+            else
+            {
+                assert(list->items[block->start].operation == TAC_OP_LABEL && "Branch target does not start with its label");
+                const CFGBlock* previous = b > 0 ? &cfg->blocks[b - 1] : NULL;
+                const TACOp previous_last = previous ? previous->tac_contents.items[previous->tac_contents.count - 1].operation : TAC_OP_JMP;
+                const TACExpr jump = (TACExpr){ .operation = TAC_OP_JMP, .rhs1 = list->items[block->start].rhs1 };
+                if (!jumped_over && previous_last != TAC_OP_JMP && previous_last != TAC_OP_RETURN && previous_last != TAC_OP_RUNTIME_ERROR)
+                {
+                    copy_insertions_append(&insertions, block->start, 1, jump);
+                    jumped_over = true;
+                }
+
+                const TACSymbol label = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = list->_curr_label++ };
+                list->items[last_idx].rhs2 = label;
+                copy_insertions_append(&insertions, block->start, 2, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = label });
+                sequentialize_copies(list, &insertions, block->start, 2, destinations, sources, count);
+                copy_insertions_append(&insertions, block->start, 2, jump);
+            }
+        }
+
+        for (int64_t i = block->start; i < block->start + block->tac_contents.count; i++)
+        {
+            if (list->items[i].operation == TAC_OP_PHI) list->items[i] = (TACExpr){ 0 };
+        }
+    }
+
+    qsort(insertions.items, insertions.count, sizeof(CopyInsertion), compare_copy_insertions);
+    int64_t* positions = bh_alloc(GPA, sizeof(int64_t) * (insertions.count > 0 ? insertions.count : 1));
+    TACExpr* exprs = bh_alloc(GPA, sizeof(TACExpr) * (insertions.count > 0 ? insertions.count : 1));
+    for (int64_t i = 0; i < insertions.count; i++)
+    {
+        positions[i] = insertions.items[i].position;
+        exprs[i] = insertions.items[i].expr;
+    }
+    TAC_list_insert_many(list, positions, exprs, insertions.count);
+
+    bh_free(GPA, exprs);
+    bh_free(GPA, positions);
+    bh_free(GPA, sources);
+    bh_free(GPA, destinations);
+    bh_free(GPA, insertions.items);
+}
+
+#pragma endregion
@@ -0,0 +1,28 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include <stdint.h>
+
+#include "tac.h"
+
+// Immediate dominators from the Cooper, Harvey and Kennedy iteration over reverse postorder
+typedef struct TACDominators
+{
+    int64_t block_count;
+    int64_t* idom; // The entry is its own, unreachable blocks have -1
+    int64_t* order_index; // Position of each block in cfg.order
+    int64_t* first_child; // Dominator tree, children in reverse postorder, -1 at the end
+    int64_t* next_sibling;
+    bh_allocator allocator;
+} TACDominators;
+
+TACDominators tac_dominators_init(const CFG* cfg, bh_allocator allocator);
+void tac_dominators_deinit(TACDominators* dominators);
+bool tac_dominates(const TACDominators* dominators, int64_t a, int64_t b);
+
+// Phis read args[k] when coming in from the block in predecessor slot k of the CFG they were built
+// against. Passes that drop edges drop the matching operands.
+void tac_construct_ssa(TACList* list);
+void tac_destruct_ssa(TACList* list);
+
+#endif //SSA_H
@@ -6,19 +6,13 @@
 
 #include <assert.h>
 #include <string.h>
-#include <sys/mman.h>
 
 #include "optimizer_tac.h"
+#include "tac_buffer.h"
 
-TACList TAC_list_init(const int64_t capacity, bh_allocator allocator)
+TACList TAC_list_init(int64_t capacity, bh_allocator allocator)
 {
-#ifdef WIN32
-    TACExpr* data = VirtualAlloc(NULL, 1000000000, MEM_RESERVE, PAGE_NOACCESS);
-    VirtualAlloc(data, base_capacity * sizeof(TACExpr), MEM_COMMIT, PAGE_READWRITE);
-#else
-    TACExpr* data = mmap(NULL, 100000000000, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    mprotect(data, capacity * sizeof(TACExpr), PROT_READ | PROT_WRITE);
-#endif
+    TACExpr* data = tac_buffer_acquire(&capacity);
     TACList list = (TACList)
     {
         .allocator = allocator,
@@ -31,15 +25,9 @@ TACList TAC_list_init(const int64_t capacity, bh_allocator allocator)
     return list;
 }
 
-TACList TAC_list_init_no_bindings(const int64_t capacity, bh_allocator allocator)
+TACList TAC_list_init_no_bindings(int64_t capacity, bh_allocator allocator)
 {
-#ifdef WIN32
-    TACExpr* data = VirtualAlloc(NULL, 100000000000, MEM_RESERVE, PAGE_NOACCESS);
-    VirtualAlloc(data, base_capacity * sizeof(TACExpr), MEM_COMMIT, PAGE_READWRITE);
-#else
-    TACExpr* data = mmap(NULL, 100000000000, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    mprotect(data, capacity * sizeof(TACExpr), PROT_READ | PROT_WRITE);
-#endif
+    TACExpr* data = tac_buffer_acquire(&capacity);
     TACList list = (TACList)
     {
         .allocator = allocator,
@@ -52,7 +40,7 @@ TACList TAC_list_init_no_bindings(const int64_t capacity, bh_allocator allocator
 
 void TAC_list_deinit(TACList list)
 {
-    munmap(list.items, 10000000);
+    tac_buffer_release(list.items, list.capacity);
     bh_free(list.allocator, list._bindings);
 }
 
@@ -63,54 +51,31 @@ TACSymbol TAC_request_symbol(TACList* list)
     return (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = res };
 }
 
-TACExpr* TAC_list_append(TACList* list, TACExpr expr, bool add_phi)
+TACExpr* TAC_list_append(TACList* list, TACExpr expr)
 {
-    // expr.lhs = get_bound_symbol_variable(list, expr.lhs);
+    // Let and case variables live in one temporary for their whole scope, SSA construction splits it up
     if (expr.lhs.type == TAC_SYMBOL_TYPE_VARIABLE)
     {
         for (int i = list->_binding_count - 1; i >= 0; i--)
         {
-            if (bh_str_equal(expr.lhs.variable.data, list->_bindings[i].name))
+            if (expr.lhs.variable.atom == list->_bindings[i].name_atom)
             {
-                TACSymbol new_symbol = TAC_request_symbol(list);
                 if (list->_bindings[i].symbol.type == TAC_SYMBOL_TYPE_VARIABLE)
                 {
-                    list->_bindings[i].symbol.variable.version = new_symbol.symbol;
-                    new_symbol = list->_bindings[i].symbol;
-                }
-                else
-                {
-                    list->_bindings[i].symbol = new_symbol;
-                }
-                expr.lhs = new_symbol;
-            }
-        }
-    }
-    if (expr.rhs1.type == TAC_SYMBOL_TYPE_VARIABLE)
-    {
-        for (int i = list->_binding_count - 1; i >= 0; i--)
-        {
-            if (bh_str_equal(expr.rhs1.variable.data, list->_bindings[i].name))
-            {
-                if (add_phi && !tac_symbol_equal(list->_bindings[i].symbol, list->_bindings[i].original_symbol))
-                {
-                    expr.operation = TAC_OP_PHI;
-                    expr.rhs1 = list->_bindings[i].original_symbol;
-                    expr.rhs2 = list->_bindings[i].symbol;
-                }
-                else
-                {
-                    expr.rhs1 = list->_bindings[i].symbol;
+                    list->_bindings[i].symbol.variable.version = TAC_request_symbol(list).symbol;
                 }
+                expr.lhs = list->_bindings[i].symbol;
                 break;
             }
         }
     }
+    expr.rhs1 = get_bound_symbol_variable(list, expr.rhs1);
     expr.rhs2 = get_bound_symbol_variable(list, expr.rhs2);
     if (list->count + 1 >= list->capacity)
     {
-        list->capacity *= 2;
-        mprotect(list->items, list->capacity * sizeof(TACExpr), PROT_READ | PROT_WRITE);
+        int64_t capacity = list->capacity * 2;
+        list->items = tac_buffer_grow(list->items, list->count, list->capacity, &capacity);
+        list->capacity = capacity;
     }
     list->items[list->count] = expr;
     list->count += 1;
@@ -145,8 +110,9 @@ TACExpr* TAC_list_insert_at(TACList* list, TACExpr expr, int64_t index)
     // expr.rhs2 = get_bound_symbol_variable(list, expr.rhs2);
     if (list->count + 1 >= list->capacity)
     {
-        list->capacity *= 2;
-        mprotect(list->items, list->capacity * sizeof(TACExpr), PROT_READ | PROT_WRITE);
+        int64_t capacity = list->capacity * 2;
+        list->items = tac_buffer_grow(list->items, list->count, list->capacity, &capacity);
+        list->capacity = capacity;
     }
     memmove(&list->items[index + 1], &list->items[index], (list->count - index) * sizeof(TACExpr));
     list->items[index] = expr;
@@ -154,6 +120,30 @@ TACExpr* TAC_list_insert_at(TACList* list, TACExpr expr, int64_t index)
     return &list->items[index];
 }
 
+// Inserts exprs[i] before the expression currently at positions[i]. Positions have to be ascending,
+// expressions going in at the same position keep the order they're given in.
+void TAC_list_insert_many(TACList* list, const int64_t* positions, const TACExpr* exprs, const int64_t count)
+{
+    if (count == 0) return;
+    if (list->count + count >= list->capacity)
+    {
+        int64_t capacity = list->capacity;
+        while (list->count + count >= capacity) capacity *= 2;
+        list->items = tac_buffer_grow(list->items, list->count, list->capacity, &capacity);
+        list->capacity = capacity;
+    }
+
+    // Fill from the back so every expression only moves once
+    int64_t read = list->count;
+    int64_t write = list->count + count;
+    for (int64_t i = count - 1; i >= 0; i--)
+    {
+        while (read > positions[i]) list->items[--write] = list->items[--read];
+        list->items[--write] = exprs[i];
+    }
+    list->count += count;
+}
+
 const char* start_str = "start";
 const char* object_str = "Object";
 const char* then_str = "then branch";
@@ -207,10 +197,11 @@ TACList tac_list_from_class_list(ClassNodeList class_list, bh_allocator allocato
     for (int i = 0; i < class_list.class_nodes[class_idx].attribute_count; i++)
     {
         list._bindings[i].name = class_list.class_nodes[class_idx].attributes[i].name;
+        list._bindings[i].name_atom = class_list.class_nodes[class_idx].attributes[i].name_atom;
         list._bindings[i].symbol.type = TAC_SYMBOL_TYPE_VARIABLE;
         list._bindings[i].symbol.variable.data = class_list.class_nodes[class_idx].attributes[i].name;
+        list._bindings[i].symbol.variable.atom = class_list.class_nodes[class_idx].attributes[i].name_atom;
         list._bindings[i].symbol.variable.version = TAC_request_symbol(&list).symbol;
-        list._bindings[i].original_symbol = list._bindings[i].symbol;
     }
 
     bh_str comment_start_str = bh_str_from_cstr(start_str);
@@ -218,18 +209,18 @@ TACList tac_list_from_class_list(ClassNodeList class_list, bh_allocator allocato
     TAC_list_append(&list, (TACExpr){
                         .operation = TAC_OP_COMMENT,
                         .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = comment_start_str }
-                    }, false);
+                    });
 
     TAC_list_append(&list, (TACExpr){
                         .operation = TAC_OP_LABEL,
                         .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = list._curr_label++ }
-                    }, false);
+                    });
 
-    TACSymbol result = tac_list_from_expression(first_method_body, &list, (TACSymbol){ 0 }, false);
+    TACSymbol result = tac_list_from_expression(first_method_body, &list, (TACSymbol){ 0 });
     TAC_list_append(&list, (TACExpr){
                         .operation = TAC_OP_RETURN,
                         .rhs1 = result
-                    }, false);
+                    });
 
     optimize_tac_list(&list);
 
@@ -249,11 +240,11 @@ TACList tac_list_from_method(const ClassMethod* method, bh_allocator allocator)
         ._binding_count = 0
     };
 
-    TACSymbol result = tac_list_from_expression(&method->body, &list, (TACSymbol){ 0 }, false);
+    TACSymbol result = tac_list_from_expression(&method->body, &list, (TACSymbol){ 0 });
     TAC_list_append(&list, (TACExpr){
                         .operation = TAC_OP_RETURN,
                         .rhs1 = result
-                    }, false);
+                    });
     optimize_tac_list(&list);
 
     return list;
@@ -265,7 +256,7 @@ TACSymbol get_bound_symbol_variable(const TACList* list, const TACSymbol symbol)
     {
         for (int i = list->_binding_count - 1; i >= 0; i--)
         {
-            if (bh_str_equal(symbol.variable.data, list->_bindings[i].name))
+            if (symbol.variable.atom == list->_bindings[i].name_atom)
             {
                 return list->_bindings[i].symbol;
             }
@@ -274,12 +265,12 @@ TACSymbol get_bound_symbol_variable(const TACList* list, const TACSymbol symbol)
     return symbol;
 }
 
-int64_t get_symbol_version_for_variable(const TACList* list, const bh_str str)
+int64_t get_symbol_version_for_variable(const TACList* list, const bh_atom atom)
 {
     for (int i = list->count - 1; i >= 0; i--)
     {
         if (list->items[i].lhs.type != TAC_SYMBOL_TYPE_VARIABLE) continue;
-        if (bh_str_equal(list->items[i].lhs.variable.data, str))
+        if (list->items[i].lhs.variable.atom == atom)
         {
             return list->items[i].lhs.variable.version;
         }
@@ -287,7 +278,7 @@ int64_t get_symbol_version_for_variable(const TACList* list, const bh_str str)
     return 0;
 }
 
-TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TACSymbol destination, bool add_phi)
+TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TACSymbol destination)
 {
     if (destination.type == TAC_SYMBOL_TYPE_NULL) destination = TAC_request_symbol(list);
     switch (expr->expression_type)
@@ -298,6 +289,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .type = TAC_SYMBOL_TYPE_VARIABLE,
                 .variable = {
                     .data = expr->data.assign.var.name,
+                    .atom = expr->data.assign.var.name_atom,
                     .version = TAC_request_symbol(list).symbol
                 }
             };
@@ -305,16 +297,16 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .operation = TAC_OP_ASSIGN,
                 .line_num = expr->line_num,
                 .lhs = destination,
-                .rhs1 = tac_list_from_expression(expr->data.assign.rhs, list, dest, add_phi)
+                .rhs1 = tac_list_from_expression(expr->data.assign.rhs, list, dest)
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_DYNAMIC_DISPATCH:
     case COOL_EXPR_TYPE_STATIC_DISPATCH:
     case COOL_EXPR_TYPE_SELF_DISPATCH:
         {
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_IGNORE, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = -1 } }, add_phi);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_IGNORE, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = -1 } });
             TACExpr tac = (TACExpr){
                 .operation = TAC_OP_CALL,
                 .line_num = expr->line_num,
@@ -325,55 +317,36 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
             tac.args = bh_alloc(list->allocator, tac.arg_count * sizeof(TACSymbol));
             for (int i = 0; i < expr->data.dynamic_dispatch.args_length; i++)
             {
-                TACSymbol arg_symbol = tac_list_from_expression(&expr->data.dynamic_dispatch.args[i], list, (TACSymbol){ 0 }, add_phi);
+                TACSymbol arg_symbol = tac_list_from_expression(&expr->data.dynamic_dispatch.args[i], list, (TACSymbol){ 0 });
                 tac.args[i] = arg_symbol;
             }
 
+            // SELF_TYPE isn't a class, and dispatching on it means dispatching on this one
             int64_t class_idx = list->class_idx;
             if (expr->expression_type == COOL_EXPR_TYPE_DYNAMIC_DISPATCH)
             {
-                for (int i = 0; i < list->class_list.class_count; i++)
-                {
-                    if (bh_str_equal(list->class_list.class_nodes[i].name, expr->data.dynamic_dispatch.e->expression_typename))
-                    {
-                        class_idx = i;
-                        break;
-                    }
-                }
+                const int64_t static_type = class_idx_from_atom(list->class_list, expr->data.dynamic_dispatch.e->expression_typename_atom);
+                if (static_type != -1) class_idx = static_type;
             }
             else if (expr->expression_type == COOL_EXPR_TYPE_STATIC_DISPATCH)
             {
-                for (int i = 0; i < list->class_list.class_count; i++)
-                {
-                    if (bh_str_equal(list->class_list.class_nodes[i].name, expr->data.static_dispatch.type_name.name))
-                    {
-                        class_idx = -i - 1;
-                        break;
-                    }
-                }
+                const int64_t static_type = class_idx_from_atom(list->class_list, expr->data.static_dispatch.type_name.name_atom);
+                if (static_type != -1) class_idx = -static_type - 1;
             }
 
             if (expr->expression_type != COOL_EXPR_TYPE_SELF_DISPATCH)
             {
-                TACSymbol result = tac_list_from_expression(expr->data.dynamic_dispatch.e, list, (TACSymbol){ 0 }, add_phi);
+                TACSymbol result = tac_list_from_expression(expr->data.dynamic_dispatch.e, list, (TACSymbol){ 0 });
                 tac.args[tac.arg_count - 1] = result;
             }
 
-            int64_t method_idx = 0;
-            ClassNode class_node = list->class_list.class_nodes[class_idx < 0 ? -class_idx - 1 : class_idx];
-            for (int i = 0; i < class_node.method_count; i++)
-            {
-                if (bh_str_equal(class_node.methods[i].name, expr->data.dynamic_dispatch.method.name))
-                {
-                    method_idx = i;
-                    break;
-                }
-            }
+            const int64_t method_idx = method_idx_from_atom(list->class_list, class_idx < 0 ? -class_idx - 1 : class_idx, expr->data.dynamic_dispatch.method.name_atom);
+            assert(method_idx != -1 && "Dispatch to a method the class doesn't have");
 
             tac.rhs1.method.class_idx = class_idx;
             tac.rhs1.method.method_idx = method_idx;
 
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_INTERNAL:
@@ -382,9 +355,9 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .operation = TAC_OP_CALL,
                 .line_num = expr->line_num,
                 .lhs = destination,
-                .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_VARIABLE, .variable = { .data = expr->data.internal.method } }
+                .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_VARIABLE, .variable = { .data = expr->data.internal.method, .atom = expr->data.internal.method_atom } }
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_IF:
@@ -392,7 +365,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
             int64_t label_else = list->_curr_label++;
             int64_t label_then = list->_curr_label++;
             int64_t label_join = list->_curr_label++;
-            TACSymbol cond = tac_list_from_expression(expr->data.if_expr.predicate, list, (TACSymbol){ 0 }, add_phi);
+            TACSymbol cond = tac_list_from_expression(expr->data.if_expr.predicate, list, (TACSymbol){ 0 });
             const TACExpr bt_true = (TACExpr){
                 .operation = TAC_OP_BT,
                 .line_num = expr->line_num,
@@ -400,39 +373,22 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .rhs1 = cond,
                 .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_then }
             };
-            TAC_list_append(list, bt_true, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(else_str) }}, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_else }}, add_phi);
-            TACSymbol symbol1 = TAC_request_symbol(list);
-            int64_t original_binding_count = list->_binding_count;
-            TACBinding* original_bindings = bh_alloc(GPA, list->_binding_count * sizeof(TACBinding));
-            memcpy(original_bindings, list->_bindings, list->_binding_count * sizeof(TACBinding));
-            tac_list_from_expression(expr->data.if_expr.else_branch, list, symbol1, add_phi);
-            TACBinding* branch1_bindings = bh_alloc(GPA, list->_binding_count * sizeof(TACBinding));
-            memcpy(branch1_bindings, list->_bindings, list->_binding_count * sizeof(TACBinding));
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_JMP, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_join }}, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(then_str) }}, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_then }}, add_phi);
-            TACSymbol symbol2 = TAC_request_symbol(list);
-            memcpy(list->_bindings, original_bindings, original_binding_count * sizeof(TACBinding));
-            list->_binding_count = original_binding_count;
-            tac_list_from_expression(expr->data.if_expr.then_branch, list, symbol2, add_phi);
-            TACBinding* branch2_bindings = list->_bindings;
-
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(if_join_str) }}, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_join }}, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_PHI, .lhs = destination, .rhs1 = symbol1, .rhs2 = symbol2 }, add_phi);
-            for (int i = 0; i < original_binding_count; i++)
+            TAC_list_append(list, bt_true);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(else_str) }});
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_else }});
+            // A let in a branch could shadow a variable being assigned to, so that's only written at the join
+            TACSymbol result = destination.type == TAC_SYMBOL_TYPE_VARIABLE ? TAC_request_symbol(list) : destination;
+            tac_list_from_expression(expr->data.if_expr.else_branch, list, result);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_JMP, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_join }});
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(then_str) }});
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_then }});
+            tac_list_from_expression(expr->data.if_expr.then_branch, list, result);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(if_join_str) }});
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_join }});
+            if (result.type != destination.type)
             {
-                if (!tac_symbol_equal(branch1_bindings[i].symbol, branch2_bindings[i].symbol))
-                {
-                    TACSymbol new_symbol = TAC_request_symbol(list);
-                    TAC_list_append(list, (TACExpr){ .operation = TAC_OP_PHI, .lhs = new_symbol, .rhs1 = branch1_bindings[i].symbol, .rhs2 = branch2_bindings[i].symbol }, add_phi);
-                    list->_bindings[i].symbol = new_symbol;
-                }
+                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_ASSIGN, .lhs = destination, .rhs1 = result });
             }
-            bh_free(GPA, original_bindings);
-            bh_free(GPA, branch1_bindings);
             return destination;
         }
     case COOL_EXPR_TYPE_WHILE:
@@ -440,17 +396,12 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
             int64_t label_cond = list->_curr_label++;
             int64_t label_join = list->_curr_label++;
 
-            int64_t original_binding_count = list->_binding_count;
-            TACBinding* original_bindings = bh_alloc(GPA, list->_binding_count * sizeof(TACBinding));
-            memcpy(original_bindings, list->_bindings, list->_binding_count * sizeof(TACBinding));
-
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(while_pred_str) }}, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_cond }}, add_phi);
-            int64_t cond_start = list->count;
-            TACSymbol cond = tac_list_from_expression(expr->data.while_expr.predicate, list, (TACSymbol){ 0 }, add_phi);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(while_pred_str) }});
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_cond }});
+            TACSymbol cond = tac_list_from_expression(expr->data.while_expr.predicate, list, (TACSymbol){ 0 });
             TACSymbol not_cond_symbol = TAC_request_symbol(list);
             const TACExpr not_cond = (TACExpr){ .operation = TAC_OP_NOT, .lhs = not_cond_symbol, .rhs1 = cond };
-            TAC_list_append(list, not_cond, add_phi);
+            TAC_list_append(list, not_cond);
             const TACExpr bt_false = (TACExpr){
                 .operation = TAC_OP_BT,
                 .line_num = expr->line_num,
@@ -458,70 +409,15 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .rhs1 = not_cond_symbol,
                 .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_join }
             };
-            TAC_list_append(list, bt_false, add_phi);
-            TACSlice cond_slice = (TACSlice){ .items = &list->items[cond_start], .count = list->count - cond_start };
-
-            int64_t body_start = list->count;
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(while_body_str) }}, add_phi);
-            tac_list_from_expression(expr->data.while_expr.body, list, TAC_request_symbol(list), add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_JMP, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_cond }}, add_phi);
-            TACSlice body_slice = (TACSlice){ .items = &list->items[body_start], .count = list->count - body_start };
-
-            for (int i = 0; i < original_binding_count; i++)
-            {
-                if (!tac_symbol_equal(list->_bindings[i].symbol, original_bindings[i].symbol))
-                {
-                    TACSymbol new_symbol = TAC_request_symbol(list);
-                    if (list->_bindings[i].symbol.type == TAC_SYMBOL_TYPE_VARIABLE)
-                    {
-                        new_symbol.type = TAC_SYMBOL_TYPE_VARIABLE;
-                        new_symbol.variable.data = list->_bindings[i].symbol.variable.data;
-                    }
-                    const TACExpr phi = (TACExpr){
-                        .operation = TAC_OP_PHI,
-                        .line_num = expr->line_num,
-                        .lhs = new_symbol,
-                        .rhs1 = list->_bindings[i].symbol,
-                        .rhs2 = original_bindings[i].symbol
-                    };
-                    TAC_list_insert_at(list, phi, cond_start);
-                    cond_slice.count += 1;
-                    body_slice.items += 1;
-                    list->_bindings[i].symbol = new_symbol;
-
-                    for (int j = 0; j < cond_slice.count; j++)
-                    {
-                        if (cond_slice.items[j].operation == TAC_OP_PHI) continue;
-                        if (tac_symbol_equal(cond_slice.items[j].rhs1, original_bindings[i].symbol))
-                        {
-                            cond_slice.items[j].rhs1 = new_symbol;
-                        }
-                        if (tac_symbol_equal(cond_slice.items[j].rhs2, original_bindings[i].symbol))
-                        {
-                            cond_slice.items[j].rhs2 = new_symbol;
-                        }
-                    }
-
-                    for (int j = 0; j < body_slice.count; j++)
-                    {
-                        if (body_slice.items[j].operation == TAC_OP_PHI) continue;
-                        if (tac_symbol_equal(body_slice.items[j].rhs1, original_bindings[i].symbol))
-                        {
-                            body_slice.items[j].rhs1 = new_symbol;
-                        }
-                        if (tac_symbol_equal(body_slice.items[j].rhs2, original_bindings[i].symbol))
-                        {
-                            body_slice.items[j].rhs2 = new_symbol;
-                        }
-                    }
-                }
-            }
+            TAC_list_append(list, bt_false);
 
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(while_join_str) }}, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_join } }, add_phi);
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_DEFAULT, .lhs = destination, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(object_str) }}, add_phi);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(while_body_str) }});
+            tac_list_from_expression(expr->data.while_expr.body, list, TAC_request_symbol(list));
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_JMP, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_cond }});
 
-            bh_free(GPA, original_bindings);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_COMMENT, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = bh_str_from_cstr(while_join_str) }});
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = label_join } });
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_DEFAULT, .lhs = destination, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_VARIABLE, .variable = { .data = bh_str_from_cstr(object_str), .atom = BH_ATOM_OBJECT } }});
             return destination;
         }
         break;
@@ -530,7 +426,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
             for (int i = 0; i < expr->data.block.body_length; i++)
             {
                 int is_last = i == expr->data.block.body_length - 1;
-                tac_list_from_expression(&expr->data.block.body[i], list, is_last ? destination : (TACSymbol){ 0 }, add_phi);
+                tac_list_from_expression(&expr->data.block.body[i], list, is_last ? destination : (TACSymbol){ 0 });
             }
             return destination;
         }
@@ -540,21 +436,21 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .operation = TAC_OP_NEW,
                 .line_num = expr->line_num,
                 .lhs = destination,
-                .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_VARIABLE, .variable = { .data = expr->data.new_expr.class_name.name } }
+                .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_VARIABLE, .variable = { .data = expr->data.new_expr.class_name.name, .atom = expr->data.new_expr.class_name.name_atom } }
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_ISVOID:
         {
-            TACSymbol ta1 = tac_list_from_expression(expr->data.isvoid.e, list, (TACSymbol){ 0 }, add_phi);
+            TACSymbol ta1 = tac_list_from_expression(expr->data.isvoid.e, list, (TACSymbol){ 0 });
             TACExpr tac = (TACExpr) {
                 .operation = TAC_OP_ISVOID,
                 .line_num = expr->line_num,
                 .lhs = destination,
                 .rhs1 = ta1,
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_PLUS:
@@ -569,12 +465,12 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 expr->expression_type == COOL_EXPR_TYPE_EQ ||
                 expr->expression_type == COOL_EXPR_TYPE_LE)
             {
-                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_IGNORE, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = -1 } }, add_phi);
+                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_IGNORE, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = -1 } });
             }
             TACSymbol dest1 = TAC_request_symbol(list);
             TACSymbol dest2 = TAC_request_symbol(list);
-            TACSymbol ta1 = tac_list_from_expression(expr->data.binary.x, list, dest1, add_phi);
-            TACSymbol ta2 = tac_list_from_expression(expr->data.binary.y, list, dest2, add_phi);
+            TACSymbol ta1 = tac_list_from_expression(expr->data.binary.x, list, dest1);
+            TACSymbol ta2 = tac_list_from_expression(expr->data.binary.y, list, dest2);
             TACExpr tac = (TACExpr) {
                 .operation = expr->expression_type - (COOL_EXPR_TYPE_PLUS - TAC_OP_PLUS),
                 .line_num = expr->line_num,
@@ -582,20 +478,20 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .rhs1 = ta1,
                 .rhs2 = ta2
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_NOT:
     case COOL_EXPR_TYPE_NEGATE:
         {
-            TACSymbol ta1 = tac_list_from_expression(expr->data.unary.x, list, (TACSymbol){ 0 }, add_phi);
+            TACSymbol ta1 = tac_list_from_expression(expr->data.unary.x, list, (TACSymbol){ 0 });
             TACExpr tac = (TACExpr) {
                 .operation = expr->expression_type - (COOL_EXPR_TYPE_NOT - TAC_OP_NOT),
                 .line_num = expr->line_num,
                 .lhs = destination,
                 .rhs1 = ta1,
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_INTEGER:
@@ -606,7 +502,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .lhs = destination,
                 .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = expr->data.integer.value }
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_STRING:
@@ -617,7 +513,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .lhs = destination,
                 .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = expr->data.string.value }
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_IDENTIFIER:
@@ -626,7 +522,8 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .type = TAC_SYMBOL_TYPE_VARIABLE,
                 .variable = {
                     .data = expr->data.identifier.variable.name,
-                    .version = get_symbol_version_for_variable(list, expr->data.identifier.variable.name)
+                    .atom = expr->data.identifier.variable.name_atom,
+                    .version = get_symbol_version_for_variable(list, expr->data.identifier.variable.name_atom)
                 }
             };
             const TACExpr tac = (TACExpr){
@@ -635,7 +532,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .lhs = destination,
                 .rhs1 = rhs
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_TRUE:
@@ -647,7 +544,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .lhs = destination,
                 .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_BOOL, .integer = expr->expression_type == COOL_EXPR_TYPE_TRUE }
             };
-            TAC_list_append(list, tac, add_phi);
+            TAC_list_append(list, tac);
             return tac.lhs;
         }
     case COOL_EXPR_TYPE_LET:
@@ -658,33 +555,33 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 TACSymbol new_symbol = TAC_request_symbol(list);
                 list->_bindings[list->_binding_count] = (TACBinding){
                     .name = expr->data.let.bindings[i].variable.name,
-                    .symbol = new_symbol,
-                    .original_symbol = new_symbol
+                    .name_atom = expr->data.let.bindings[i].variable.name_atom,
+                    .symbol = new_symbol
                 };
 
                 if (expr->data.let.bindings[i].exp)
                 {
-                    tac_list_from_expression(expr->data.let.bindings[i].exp, list, list->_bindings[list->_binding_count].symbol, add_phi);
+                    tac_list_from_expression(expr->data.let.bindings[i].exp, list, list->_bindings[list->_binding_count].symbol);
                 }
                 else
                 {
                     TACExpr default_expr = (TACExpr){
                         .operation = TAC_OP_DEFAULT,
                         .lhs = list->_bindings[list->_binding_count].symbol,
-                        .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_VARIABLE, .variable = { .data = expr->data.let.bindings[i].type_name.name } }
+                        .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_VARIABLE, .variable = { .data = expr->data.let.bindings[i].type_name.name, .atom = expr->data.let.bindings[i].type_name.name_atom } }
                     };
-                    TAC_list_append(list, default_expr, add_phi);
+                    TAC_list_append(list, default_expr);
                 }
 
                 list->_bindings[list->_binding_count] = (TACBinding){
                     .name = expr->data.let.bindings[i].variable.name,
-                    .symbol = new_symbol,
-                    .original_symbol = new_symbol
+                    .name_atom = expr->data.let.bindings[i].variable.name_atom,
+                    .symbol = new_symbol
                 };
 
                 list->_binding_count += 1;
             }
-            tac_list_from_expression(expr->data.let.expr, list, destination, add_phi);
+            tac_list_from_expression(expr->data.let.expr, list, destination);
             list->_binding_count = initial_binding_count;
             return destination;
         }
@@ -692,7 +589,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
         {
             // Generate all the if statements
             TACSymbol expr_symbol = TAC_request_symbol(list);
-            tac_list_from_expression(expr->data.case_expr.expr, list, expr_symbol, add_phi);
+            tac_list_from_expression(expr->data.case_expr.expr, list, expr_symbol);
 
             int64_t void_label = list->_curr_label++;
             int64_t error_label = list->_curr_label++;
@@ -705,13 +602,13 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                 .lhs = expr_is_void,
                 .rhs1 = expr_symbol,
             };
-            TAC_list_append(list, isvoid_expr, add_phi);
+            TAC_list_append(list, isvoid_expr);
             TAC_list_append(list, (TACExpr){
                 .operation = TAC_OP_BT,
                 .line_num = expr->line_num,
                 .rhs1 = expr_is_void,
                 .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = void_label }
-            }, add_phi);
+            });
 
             // Figre out which class maps to which label
             for (int i = 0; i < list->class_list.class_count; i++)
@@ -730,7 +627,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                     for (int k = 0; k < case_count; k++)
                     {
                         CoolCaseElement element = expr->data.case_expr.elements[k];
-                        if (bh_str_equal(element.type_name.name, branch_class->name))
+                        if (element.type_name.name_atom == branch_class->name_atom)
                         {
                             correct_branch = k;
                             break;
@@ -747,14 +644,14 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                     .lhs = cond,
                     .rhs1 = expr_symbol,
                     .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_CLASSIDX, .integer = class_tag }
-                }, add_phi);
+                });
                 if (correct_branch == -1)
                 {
                     TAC_list_append(list, (TACExpr){
                         .operation = TAC_OP_BT,
                         .rhs1 = cond,
                         .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = error_label }
-                    }, add_phi);
+                    });
                 }
                 else
                 {
@@ -762,7 +659,7 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
                         .operation = TAC_OP_BT,
                         .rhs1 = cond,
                         .rhs2 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = list->_curr_label + correct_branch }
-                    }, add_phi);
+                    });
                 }
             }
 
@@ -771,57 +668,46 @@ TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TA
             int64_t join_label = list->_curr_label + expr->data.case_expr.element_count;
 
             // if value is void
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = void_label }}, add_phi);
-            bh_str void_str = bh_str_alloc_cstr(list->allocator, "case on void");
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_RUNTIME_ERROR, .line_num = expr->line_num, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = void_str }}, add_phi);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = void_label }});
+            bh_str void_str = bh_str_from_cstr("case on void");
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_RUNTIME_ERROR, .line_num = expr->line_num, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = void_str }});
 
             // if no matching branch found
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = error_label }}, add_phi);
-            bh_str error_str = bh_str_alloc_cstr(list->allocator, "case without matching branch");
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_RUNTIME_ERROR, .line_num = expr->line_num, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = error_str }}, add_phi);
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = error_label }});
+            bh_str error_str = bh_str_from_cstr("case without matching branch");
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_RUNTIME_ERROR, .line_num = expr->line_num, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_STRING, .string = error_str }});
 
             // each branch expressions as TAC
             int64_t base_label = list->_curr_label;
-            int64_t base_dest = list->_curr_symbol;
             list->_curr_label += expr->data.case_expr.element_count + 1;
-            list->_curr_symbol += expr->data.case_expr.element_count;
+            TACSymbol result = destination.type == TAC_SYMBOL_TYPE_VARIABLE ? TAC_request_symbol(list) : destination;
             for (int i = 0; i < expr->data.case_expr.element_count; i++)
             {
                 // Label setup
-                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = base_label + i }}, add_phi);
-                TACSymbol branch_dest = (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = base_dest + i };
+                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = base_label + i }});
 
                 // Add binding
                 list->_bindings[list->_binding_count] = (TACBinding){
                     .name = expr->data.case_expr.elements[i].variable.name,
-                    .symbol = expr_symbol,
-                    .original_symbol = expr_symbol
+                    .name_atom = expr->data.case_expr.elements[i].variable.name_atom,
+                    .symbol = expr_symbol
                 };
                 list->_binding_count += 1;
 
-                tac_list_from_expression(expr->data.case_expr.elements[i].body, list, branch_dest, add_phi);
+                tac_list_from_expression(expr->data.case_expr.elements[i].body, list, result);
 
                 list->_binding_count -= 1;
 
                 if (i < expr->data.case_expr.element_count - 1) // no need to jump on the last one
                 {
-                    TAC_list_append(list, (TACExpr){ .operation = TAC_OP_JMP, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = join_label }}, add_phi);
+                    TAC_list_append(list, (TACExpr){ .operation = TAC_OP_JMP, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = join_label }});
                 }
             }
 
-            // case join (phi functions)
-            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = join_label } }, add_phi);
-            TACSymbol last_symbol = (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = base_dest };
-            for (int i = 1; i < expr->data.case_expr.element_count; i++)
+            TAC_list_append(list, (TACExpr){ .operation = TAC_OP_LABEL, .rhs1 = (TACSymbol){ .type = TAC_SYMBOL_TYPE_INTEGER, .integer = join_label } });
+            if (result.type != destination.type)
             {
-                TACSymbol new_symbol = i == expr->data.case_expr.element_count - 1 ? destination : TAC_request_symbol(list);
-                TACSymbol branch_dest = (TACSymbol){ .type = TAC_SYMBOL_TYPE_SYMBOL, .symbol = base_dest + i };
-                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_PHI, .lhs = new_symbol, .rhs1 = last_symbol, .rhs2 = branch_dest }, add_phi);
-                last_symbol = new_symbol;
-            }
-            if (expr->data.case_expr.element_count == 1)
-            {
-                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_ASSIGN, .lhs = destination, .rhs1 = last_symbol }, add_phi);
+                TAC_list_append(list, (TACExpr){ .operation = TAC_OP_ASSIGN, .lhs = destination, .rhs1 = result });
             }
             return destination;
         }
@@ -844,7 +730,7 @@ bool tac_symbol_equal(const TACSymbol s1, const TACSymbol s2)
     case TAC_SYMBOL_TYPE_STRING:
         return s1.string.version == s2.string.version && bh_str_equal(s1.string.data, s2.string.data);
     case TAC_SYMBOL_TYPE_VARIABLE:
-        return s1.variable.version == s2.variable.version && bh_str_equal(s1.variable.data, s2.variable.data);
+        return s1.variable.version == s2.variable.version && s1.variable.atom == s2.variable.atom;
     case TAC_SYMBOL_TYPE_METHOD:
         return s1.method.class_idx == s2.method.class_idx && s1.method.method_idx == s2.method.method_idx;
     case TAC_SYMBOL_TYPE_EXPRESSION:
@@ -857,62 +743,186 @@ bool tac_symbol_equal(const TACSymbol s1, const TACSymbol s2)
 void generate_cfg_for_tac_list(TACList* tac_list)
 {
     CFG cfg = (CFG){ 0 };
-    cfg.block_capacity = 1;
-    cfg.blocks = bh_alloc(tac_list->allocator, sizeof(CFGBlock) * 1);
+    if (tac_list->cfg.blocks)
+    {
+        bh_free(tac_list->allocator, tac_list->cfg.blocks);
+        bh_free(tac_list->allocator, tac_list->cfg.predecessors);
+        bh_free(tac_list->allocator, tac_list->cfg.order);
+    }
 
-    // Separate the TAC into parts based on control flow
-    int block_len = 0;
-    int block_start = 0;
+    // A block starts at the first expression, at every label, and after every jump
+    int64_t max_label = 0;
+    bool* is_leader = bh_alloc(GPA, sizeof(bool) * (tac_list->count + 1));
+    memset(is_leader, 0, sizeof(bool) * (tac_list->count + 1));
+    is_leader[0] = true;
     for (int k = 0; k < tac_list->count; k++)
     {
-        block_len += 1;
-
-        TACExpr expr = tac_list->items[k];
+        const TACExpr expr = tac_list->items[k];
+        if (expr.operation == TAC_OP_LABEL)
+        {
+            is_leader[k] = true;
+            if (expr.rhs1.integer > max_label) max_label = expr.rhs1.integer;
+        }
         if (expr.operation == TAC_OP_JMP ||
-            expr.operation == TAC_OP_BT)
+            expr.operation == TAC_OP_BT ||
+            expr.operation == TAC_OP_RETURN ||
+            expr.operation == TAC_OP_RUNTIME_ERROR)
         {
-            CFGBlock block = (CFGBlock){
-                .id = cfg.block_count + 1,
-                .tac_contents = (TACSlice){ .count = block_len, .items = &tac_list->items[block_start] }
-            };
+            is_leader[k + 1] = true;
+        }
+    }
+    for (int k = 0; k < tac_list->count; k++)
+    {
+        if (is_leader[k]) cfg.block_count += 1;
+    }
 
-            if (expr.operation == TAC_OP_JMP)
-            {
-                block.next[0] = &cfg.blocks[expr.rhs1.integer + 1];
-            }
-            if (expr.operation == TAC_OP_BT)
-            {
-                block.next[0] = &cfg.blocks[cfg.block_count + 1];
-                block.next[1] = &cfg.blocks[expr.rhs2.integer + 1];
-            }
+    cfg.block_capacity = cfg.block_count > 0 ? cfg.block_count : 1;
+    cfg.blocks = bh_alloc(tac_list->allocator, sizeof(CFGBlock) * cfg.block_capacity);
 
-            if (cfg.block_count + 1 > cfg.block_capacity)
-            {
-                cfg.blocks = bh_realloc(tac_list->allocator, cfg.blocks, sizeof(CFGBlock) * cfg.block_capacity * 2);
-                cfg.block_capacity *= 2;
-            }
+    int64_t* label_blocks = bh_alloc(GPA, sizeof(int64_t) * (max_label + 1));
+    memset(label_blocks, -1, sizeof(int64_t) * (max_label + 1));
 
-            cfg.blocks[cfg.block_count++] = block;
-            block_len = 0;
-            block_start = k + 1;
+    // Separate the TAC into blocks
+    int64_t block_idx = -1;
+    for (int k = 0; k < tac_list->count; k++)
+    {
+        if (is_leader[k])
+        {
+            block_idx += 1;
+            cfg.blocks[block_idx] = (CFGBlock){
+                .id = block_idx,
+                .start = k,
+                .tac_contents = (TACSlice){ .count = 0, .items = &tac_list->items[k] }
+            };
+        }
+        cfg.blocks[block_idx].tac_contents.count += 1;
+        if (tac_list->items[k].operation == TAC_OP_LABEL)
+        {
+            label_blocks[tac_list->items[k].rhs1.integer] = block_idx;
         }
     }
 
-    if (block_len > 0)
+    // Link up the successors now that every block has a stable address
+    for (int64_t b = 0; b < cfg.block_count; b++)
     {
-        CFGBlock block = (CFGBlock){
-            .id = cfg.block_count + 1,
-            .tac_contents = (TACSlice){ .count = block_len, .items = &tac_list->items[block_start] }
-        };
+        CFGBlock* block = &cfg.blocks[b];
+        const TACExpr last = block->tac_contents.items[block->tac_contents.count - 1];
+        CFGBlock* fallthrough = b + 1 < cfg.block_count ? &cfg.blocks[b + 1] : NULL;
+        switch (last.operation)
+        {
+        case TAC_OP_JMP:
+            assert(label_blocks[last.rhs1.integer] > -1 && "Jump to a label that is not in the list");
+            block->next[0] = &cfg.blocks[label_blocks[last.rhs1.integer]];
+            break;
+        case TAC_OP_BT:
+            assert(label_blocks[last.rhs2.integer] > -1 && "Branch to a label that is not in the list");
+            block->next[0] = fallthrough;
+            block->next[1] = &cfg.blocks[label_blocks[last.rhs2.integer]];
+            break;
+        case TAC_OP_RETURN:
+        case TAC_OP_RUNTIME_ERROR:
+            break;
+        default:
+            block->next[0] = fallthrough;
+            break;
+        }
+    }
 
-        if (cfg.block_count + 1 > cfg.block_capacity)
+    // Predecessor lists, counted first so they can share one array
+    int64_t predecessor_total = 0;
+    for (int64_t b = 0; b < cfg.block_count; b++)
+    {
+        for (int n = 0; n < 2; n++)
+        {
+            if (cfg.blocks[b].next[n]) cfg.blocks[b].next[n]->predecessor_count += 1;
+        }
+    }
+    for (int64_t b = 0; b < cfg.block_count; b++)
+    {
+        cfg.blocks[b].first_predecessor = predecessor_total;
+        predecessor_total += cfg.blocks[b].predecessor_count;
+        cfg.blocks[b].predecessor_count = 0;
+    }
+    cfg.predecessors = bh_alloc(tac_list->allocator, sizeof(int64_t) * (predecessor_total > 0 ? predecessor_total : 1));
+    for (int64_t b = 0; b < cfg.block_count; b++)
+    {
+        for (int n = 0; n < 2; n++)
         {
-            bh_realloc(tac_list->allocator, cfg.blocks, sizeof(CFGBlock) * cfg.block_capacity * 2);
-            cfg.block_capacity *= 2;
+            CFGBlock* next = cfg.blocks[b].next[n];
+            if (next) cfg.predecessors[next->first_predecessor + next->predecessor_count++] = b;
         }
+    }
 
-        cfg.blocks[cfg.block_count++] = block;
+    // Reverse postorder with an explicit stack, a block is finished once both of its successors are
+    cfg.order = bh_alloc(tac_list->allocator, sizeof(int64_t) * cfg.block_capacity);
+    int64_t* stack = bh_alloc(GPA, sizeof(int64_t) * cfg.block_capacity);
+    int8_t* visited_edges = bh_alloc(GPA, sizeof(int8_t) * cfg.block_capacity);
+    memset(visited_edges, -1, sizeof(int8_t) * cfg.block_capacity);
+    int64_t stack_count = 0;
+    int64_t finished_count = 0;
+    if (cfg.block_count > 0)
+    {
+        stack[stack_count++] = 0;
+        visited_edges[0] = 0;
+    }
+    while (stack_count > 0)
+    {
+        const int64_t b = stack[stack_count - 1];
+        if (visited_edges[b] == 2)
+        {
+            cfg.order[finished_count++] = b;
+            stack_count -= 1;
+            continue;
+        }
+        const CFGBlock* next = cfg.blocks[b].next[visited_edges[b]++];
+        if (next && visited_edges[next->id] == -1)
+        {
+            visited_edges[next->id] = 0;
+            stack[stack_count++] = next->id;
+        }
+    }
+    cfg.reachable_count = finished_count;
+    for (int64_t i = 0; i < finished_count / 2; i++)
+    {
+        const int64_t temp = cfg.order[i];
+        cfg.order[i] = cfg.order[finished_count - 1 - i];
+        cfg.order[finished_count - 1 - i] = temp;
+    }
+    for (int64_t b = 0; b < cfg.block_count; b++)
+    {
+        if (visited_edges[b] == -1) cfg.order[finished_count++] = b;
     }
 
+    bh_free(GPA, visited_edges);
+    bh_free(GPA, stack);
+    bh_free(GPA, label_blocks);
+    bh_free(GPA, is_leader);
+
     tac_list->cfg = cfg;
-}
\ No newline at end of file
+}
+
+// Which of block's predecessor slots the edge leaving predecessor through next[edge] fills. A block that
+// branches to its own fallthrough has both of its edges listed, the fallthrough first.
+int64_t cfg_predecessor_slot(const CFG* cfg, const int64_t block, const int64_t predecessor, const int64_t edge)
+{
+    const CFGBlock* b = &cfg->blocks[block];
+    const CFGBlock* p = &cfg->blocks[predecessor];
+    const int64_t skip = edge == 1 && p->next[0] == b ? 1 : 0;
+    for (int64_t slot = 0, seen = 0; slot < b->predecessor_count; slot++)
+    {
+        if (cfg->predecessors[b->first_predecessor + slot] != predecessor) continue;
+        if (seen++ == skip) return slot;
+    }
+    assert(0 && "Edge is not in the CFG");
+    return -1;
+}
+
+// The inverse of cfg_predecessor_slot, which next[] of the predecessor in slot leads to block
+int64_t cfg_predecessor_edge(const CFG* cfg, const int64_t block, const int64_t slot)
+{
+    const CFGBlock* b = &cfg->blocks[block];
+    const int64_t predecessor = cfg->predecessors[b->first_predecessor + slot];
+    if (cfg->blocks[predecessor].next[0] != b) return 1;
+    if (slot > 0 && cfg->predecessors[b->first_predecessor + slot - 1] == predecessor) return 1;
+    return 0;
+}
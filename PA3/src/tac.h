@@ -29,7 +29,7 @@ typedef struct TACSymbol
         int64_t symbol;
         int64_t integer;
         struct { bh_str data; int64_t version; } string;
-        struct { int64_t version; bh_str data; } variable;
+        struct { int32_t version; bh_atom atom; bh_str data; } variable;
         struct { int64_t class_idx; int64_t method_idx; } method;
         const CoolExpression* expression;
     };
@@ -38,7 +38,7 @@ typedef struct TACSymbol
 typedef struct TACBinding
 {
     bh_str name;
-    TACSymbol original_symbol;
+    bh_atom name_atom;
     TACSymbol symbol;
 } TACBinding;
 
@@ -62,6 +62,10 @@ typedef enum TACOp
     TAC_OP_DEFAULT,
     TAC_OP_ISVOID,
     TAC_OP_IS_CLASS,
+    TAC_OP_BOX,
+    TAC_OP_SHL, // rhs2 is the shift amount
+    TAC_OP_SHR, // Divides by 1 << rhs2, rounding toward zero like DIVIDE
+    TAC_OP_LOAD_ATTRIBUTE, // Attribute rhs2 of the object in rhs1
     TAC_OP_PHI,
     TAC_OP_CALL,
     TAC_OP_JMP,
@@ -70,7 +74,8 @@ typedef enum TACOp
     TAC_OP_COMMENT,
     TAC_OP_BT,
     TAC_OP_RUNTIME_ERROR,
-    TAC_OP_IGNORE
+    TAC_OP_IGNORE,
+    TAC_OP_STORE_ATTRIBUTE // Writes rhs2 into attribute lhs of the object in rhs1
 } TACOp;
 
 typedef struct TACExpr
@@ -107,18 +112,32 @@ typedef struct TACSlice
 
 typedef struct CFGBlock
 {
-    int16_t id;
+    int64_t id;
+    int64_t start; // Index of the first expression in the owning list
     TACSlice tac_contents;
     struct CFGBlock* next[2];
+    int64_t first_predecessor; // Index into the CFG's predecessors
+    int64_t predecessor_count;
 } CFGBlock;
 
 typedef struct CFG
 {
     CFGBlock* blocks;
-    int16_t block_count;
-    int16_t block_capacity;
+    int64_t block_count;
+    int64_t block_capacity;
+    int64_t* predecessors; // Block ids
+    int64_t* order; // Reverse postorder from the first block, the unreachable blocks go at the end
+    int64_t reachable_count;
 } CFG;
 
+// How a value is held in a temporary, variable or call slot
+typedef enum TACRepresentation
+{
+    TAC_REPRESENTATION_BOXED,
+    TAC_REPRESENTATION_INT, // Raw machine word
+    TAC_REPRESENTATION_BOOL, // Raw 0 or 1
+} TACRepresentation;
+
 typedef struct TACList
 {
     int64_t count;
@@ -130,6 +149,8 @@ typedef struct TACList
     bh_allocator allocator;
     ClassNodeList class_list;
     CFG cfg;
+    TACRepresentation* representations; // Per temporary, filled in by unbox_tac_list
+    int64_t representation_count;
 
     int64_t _curr_label;
     int64_t _curr_symbol;
@@ -138,14 +159,19 @@ typedef struct TACList
     int64_t _binding_count;
 } TACList;
 
-TACExpr* TAC_list_append(TACList* list, TACExpr expr, bool add_phi);
+TACExpr* TAC_list_append(TACList* list, TACExpr expr);
+TACExpr* TAC_list_insert_at(TACList* list, TACExpr expr, int64_t index);
+void TAC_list_insert_many(TACList* list, const int64_t* positions, const TACExpr* exprs, int64_t count);
 TACList TAC_list_init(int64_t capacity, bh_allocator allocator);
+void TAC_list_deinit(TACList list);
 TACSymbol TAC_request_symbol(TACList* list);
 TACSymbol get_bound_symbol_variable(const TACList* list, TACSymbol symbol);
 TACList tac_list_from_class_list(ClassNodeList class_list, bh_allocator allocator);
-TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TACSymbol destination, bool add_phi);
+TACSymbol tac_list_from_expression(const CoolExpression* expr, TACList* list, TACSymbol destination);
 TACList tac_list_from_method(const ClassMethod* method, bh_allocator allocator);
 bool tac_symbol_equal(TACSymbol s1, TACSymbol s2);
 void generate_cfg_for_tac_list(TACList* tac_list);
+int64_t cfg_predecessor_slot(const CFG* cfg, int64_t block, int64_t predecessor, int64_t edge);
+int64_t cfg_predecessor_edge(const CFG* cfg, int64_t block, int64_t slot);
 
 #endif //TAC_H
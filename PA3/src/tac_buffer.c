@@ -0,0 +1,144 @@
+#include "tac_buffer.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Lives in the first bytes of a free block
+typedef struct TACBufferNode
+{
+    struct TACBufferNode* next;
+} TACBufferNode;
+
+// Lists are built on one thread and freed on another, so there is one pool for all of them
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static TACBufferNode* free_blocks[TAC_BUFFER_CLASS_COUNT];
+static char* chunk_cursor = NULL;
+static char* chunk_end = NULL;
+static TACBufferStats stats;
+
+static int64_t block_bytes(const int64_t size_class)
+{
+    return (int64_t)TAC_BUFFER_MIN_BYTES << size_class;
+}
+
+static int64_t size_class_for(const int64_t bytes)
+{
+    int64_t size_class = 0;
+    while (block_bytes(size_class) < bytes) size_class++;
+    assert(size_class < TAC_BUFFER_CLASS_COUNT && "TAC list is too big for any block");
+    return size_class;
+}
+
+static void* map_region(const int64_t bytes)
+{
+    void* region = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    assert(region != MAP_FAILED);
+    return region;
+}
+
+// Whatever is left of the old chunk goes on the free lists instead of being dropped
+static void retire_chunk(void)
+{
+    while (chunk_end - chunk_cursor >= TAC_BUFFER_MIN_BYTES)
+    {
+        int64_t size_class = 0;
+        while (size_class + 1 < TAC_BUFFER_CLASS_COUNT && block_bytes(size_class + 1) <= chunk_end - chunk_cursor) size_class++;
+        TACBufferNode* node = (TACBufferNode*)chunk_cursor;
+        node->next = free_blocks[size_class];
+        free_blocks[size_class] = node;
+        chunk_cursor += block_bytes(size_class);
+    }
+}
+
+static void* take_block(const int64_t size_class)
+{
+    const int64_t bytes = block_bytes(size_class);
+    if (bytes > TAC_BUFFER_CHUNK_BYTES)
+    {
+        stats.large_blocks++;
+        return map_region(bytes);
+    }
+    if (free_blocks[size_class])
+    {
+        TACBufferNode* node = free_blocks[size_class];
+        free_blocks[size_class] = node->next;
+        stats.reused++;
+        return node;
+    }
+    if (chunk_end - chunk_cursor < bytes)
+    {
+        retire_chunk();
+        chunk_cursor = map_region(TAC_BUFFER_CHUNK_BYTES);
+        chunk_end = chunk_cursor + TAC_BUFFER_CHUNK_BYTES;
+        stats.chunks++;
+    }
+    void* block = chunk_cursor;
+    chunk_cursor += bytes;
+    return block;
+}
+
+// Hands out a block with room for at least *capacity expressions and sets *capacity to all it can hold
+TACExpr* tac_buffer_acquire(int64_t* capacity)
+{
+    const int64_t size_class = size_class_for(*capacity * (int64_t)sizeof(TACExpr));
+    const int64_t bytes = block_bytes(size_class);
+
+    pthread_mutex_lock(&pool_lock);
+    void* block = take_block(size_class);
+    stats.acquired++;
+    stats.live++;
+    stats.live_bytes += bytes;
+    if (stats.live > stats.peak_live) stats.peak_live = stats.live;
+    if (stats.live_bytes > stats.peak_live_bytes) stats.peak_live_bytes = stats.live_bytes;
+    if (bytes > stats.peak_list_bytes) stats.peak_list_bytes = bytes;
+    pthread_mutex_unlock(&pool_lock);
+
+    *capacity = bytes / (int64_t)sizeof(TACExpr);
+    return block;
+}
+
+// Moves the first count expressions into a block that holds at least *capacity, the old block is released
+TACExpr* tac_buffer_grow(TACExpr* items, const int64_t count, const int64_t old_capacity, int64_t* capacity)
+{
+    TACExpr* grown = tac_buffer_acquire(capacity);
+    memcpy(grown, items, count * sizeof(TACExpr));
+    tac_buffer_release(items, old_capacity);
+    return grown;
+}
+
+// Gives the block's pages back to the system, apart from the one holding the free list link
+void tac_buffer_release(TACExpr* items, const int64_t capacity)
+{
+    const int64_t size_class = size_class_for(capacity * (int64_t)sizeof(TACExpr));
+    const int64_t bytes = block_bytes(size_class);
+    if (bytes > TAC_BUFFER_CHUNK_BYTES)
+    {
+        munmap(items, bytes);
+    }
+    else if (bytes > TAC_BUFFER_MIN_BYTES)
+    {
+        madvise((char*)items + TAC_BUFFER_MIN_BYTES, bytes - TAC_BUFFER_MIN_BYTES, MADV_DONTNEED);
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    if (bytes <= TAC_BUFFER_CHUNK_BYTES)
+    {
+        TACBufferNode* node = (TACBufferNode*)items;
+        node->next = free_blocks[size_class];
+        free_blocks[size_class] = node;
+    }
+    stats.live--;
+    stats.live_bytes -= bytes;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+TACBufferStats tac_buffer_stats(void)
+{
+    pthread_mutex_lock(&pool_lock);
+    const TACBufferStats result = stats;
+    pthread_mutex_unlock(&pool_lock);
+    return result;
+}
@@ -0,0 +1,32 @@
+#ifndef TAC_BUFFER_H
+#define TAC_BUFFER_H
+
+#include <stdint.h>
+
+#include "tac.h"
+
+// Lists keep their expressions in power of two blocks, moving to the next size up when they outgrow one.
+// Blocks are carved out of chunks that every list on every thread shares.
+#define TAC_BUFFER_MIN_BYTES 4096
+#define TAC_BUFFER_CHUNK_BYTES (64 * 1024 * 1024) // Bigger blocks get a mapping of their own
+#define TAC_BUFFER_CLASS_COUNT 40
+
+typedef struct TACBufferStats
+{
+    int64_t chunks;
+    int64_t large_blocks; // Mapped on their own, unmapped again on release
+    int64_t acquired;
+    int64_t reused; // Acquired blocks that came off a free list
+    int64_t live;
+    int64_t peak_live;
+    int64_t live_bytes;
+    int64_t peak_live_bytes;
+    int64_t peak_list_bytes; // Largest block any one list needed
+} TACBufferStats;
+
+TACExpr* tac_buffer_acquire(int64_t* capacity);
+TACExpr* tac_buffer_grow(TACExpr* items, int64_t count, int64_t old_capacity, int64_t* capacity);
+void tac_buffer_release(TACExpr* items, int64_t capacity);
+TACBufferStats tac_buffer_stats(void);
+
+#endif //TAC_BUFFER_H
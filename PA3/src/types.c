@@ -5,6 +5,7 @@
 #include "types.h"
 
 #include <alloca.h>
+#include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -47,6 +48,80 @@ int8_t bh_str_cmp(const bh_str str1, const bh_str str2)
     return str1.len < str2.len ? -1 : 1;
 }
 
+// Open addressing with linear probing. Slots hold atoms and atom_strs maps them back, the strings are views
+// into the input so nothing gets copied.
+static bh_str* atom_strs;
+static uint32_t atom_count = 1;
+static uint32_t atom_capacity;
+static bh_atom* atom_slots;
+static uint32_t atom_slot_capacity;
+
+static uint32_t bh_str_hash(const bh_str str)
+{
+    uint32_t hash = 2166136261u;
+    for (uint64_t i = 0; i < str.len; i++)
+    {
+        hash ^= (uint8_t)str.buf[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void bh_atom_table_grow(void)
+{
+    const uint32_t slot_capacity = atom_slot_capacity > 0 ? atom_slot_capacity * 2 : 1024;
+    bh_atom* slots = bh_alloc(GPA, sizeof(bh_atom) * slot_capacity);
+    memset(slots, 0, sizeof(bh_atom) * slot_capacity);
+    for (uint32_t atom = 1; atom < atom_count; atom++)
+    {
+        uint32_t slot = bh_str_hash(atom_strs[atom]) & (slot_capacity - 1);
+        while (slots[slot] != 0) slot = (slot + 1) & (slot_capacity - 1);
+        slots[slot] = atom;
+    }
+    bh_free(GPA, atom_slots);
+    atom_slots = slots;
+    atom_slot_capacity = slot_capacity;
+}
+
+// In the same order as bh_known_atom
+static const char* known_atoms[] = { "self", "SELF_TYPE", "Object", "IO", "Int", "Bool", "String", "length" };
+
+static void bh_atom_table_init(void)
+{
+    bh_atom_table_grow();
+    for (uint32_t i = 0; i < sizeof(known_atoms) / sizeof(known_atoms[0]); i++)
+    {
+        const bh_atom atom = bh_atom_from_str(bh_str_from_cstr(known_atoms[i]));
+        assert(atom == i + 1 && "Known atoms have to be interned first");
+    }
+}
+
+bh_atom bh_atom_from_str(const bh_str str)
+{
+    if (atom_slot_capacity == 0) bh_atom_table_init();
+    if (atom_count * 2 >= atom_slot_capacity) bh_atom_table_grow();
+    uint32_t slot = bh_str_hash(str) & (atom_slot_capacity - 1);
+    while (atom_slots[slot] != 0)
+    {
+        if (bh_str_equal(atom_strs[atom_slots[slot]], str)) return atom_slots[slot];
+        slot = (slot + 1) & (atom_slot_capacity - 1);
+    }
+
+    if (atom_count >= atom_capacity)
+    {
+        atom_capacity = atom_capacity > 0 ? atom_capacity * 2 : 512;
+        atom_strs = bh_realloc(GPA, atom_strs, sizeof(bh_str) * atom_capacity);
+    }
+    atom_strs[atom_count] = str;
+    atom_slots[slot] = atom_count;
+    return atom_count++;
+}
+
+bh_str bh_atom_str(const bh_atom atom)
+{
+    return atom > 0 && atom < atom_count ? atom_strs[atom] : (bh_str){ 0 };
+}
+
 bh_str until_newline(const bh_str str)
 {
     for (int i = 0; i < str.len; i++)
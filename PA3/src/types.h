@@ -28,6 +28,25 @@ int32_t uint_from_str(const bh_str str);
 #define bh_str_eat_chars(str, amount) do { (str).buf += (amount); (str).len -= (amount); } while (0)
 #define bh_str_equal_lit(str, lit) bh_str_equal((str), bh_str_from_cstr(lit))
 
+// Interned name, two atoms are equal exactly when their strings are. 0 is never handed out.
+typedef uint32_t bh_atom;
+
+// Names the compiler looks for, interned ahead of everything else so their atoms are constants
+typedef enum bh_known_atom
+{
+    BH_ATOM_SELF = 1,
+    BH_ATOM_SELF_TYPE,
+    BH_ATOM_OBJECT,
+    BH_ATOM_IO,
+    BH_ATOM_INT,
+    BH_ATOM_BOOL,
+    BH_ATOM_STRING,
+    BH_ATOM_LENGTH,
+} bh_known_atom;
+
+bh_atom bh_atom_from_str(bh_str str);
+bh_str bh_atom_str(bh_atom atom);
+
 // Owning string buffer type, backed by an allocator
 typedef struct bh_str_buf
 {
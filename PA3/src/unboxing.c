@@ -0,0 +1,360 @@
+#include "unboxing.h"
+
+#include <assert.h>
+#include <string.h>
+
+#include "register_allocator.h"
+
+#define TAC_REPRESENTATION_UNKNOWN ((TACRepresentation)-1)
+
+TACRepresentation tac_representation_from_type(const bh_atom type_name)
+{
+    if (type_name == BH_ATOM_INT) return TAC_REPRESENTATION_INT;
+    if (type_name == BH_ATOM_BOOL) return TAC_REPRESENTATION_BOOL;
+    return TAC_REPRESENTATION_BOXED;
+}
+
+// Attribute initializers are lowered outside of any method
+const ClassMethod* tac_list_current_method(const TACList* list)
+{
+    if (list->method_idx == CONSTRUCTOR_METHOD) return NULL;
+    return &list->class_list.class_nodes[list->class_idx].methods[list->method_idx];
+}
+
+bh_atom tac_variable_type(const TACList* list, const TACSymbol variable)
+{
+    if (variable.variable.atom == BH_ATOM_SELF) return BH_ATOM_SELF_TYPE;
+
+    const ClassMethod* method = tac_list_current_method(list);
+    for (int j = 0; method && j < method->parameter_count; j++)
+    {
+        if (method->parameters[j].name_atom == variable.variable.atom) return method->parameters[j].type_atom;
+    }
+
+    const ClassNode class_node = list->class_list.class_nodes[list->class_idx];
+    for (int j = 0; j < class_node.attribute_count; j++)
+    {
+        if (class_node.attributes[j].name_atom == variable.variable.atom) return class_node.attributes[j].type_atom;
+    }
+
+    return 0;
+}
+
+// Primitive parameters are passed raw, attributes always hold objects
+TACRepresentation tac_variable_representation(const ClassMethod* method, const TACSymbol variable)
+{
+    if (variable.variable.atom == BH_ATOM_SELF) return TAC_REPRESENTATION_BOXED;
+    for (int j = 0; method && j < method->parameter_count; j++)
+    {
+        if (method->parameters[j].name_atom == variable.variable.atom)
+        {
+            return tac_representation_from_type(method->parameters[j].type_atom);
+        }
+    }
+    return TAC_REPRESENTATION_BOXED;
+}
+
+TACRepresentation tac_symbol_representation(const TACList* list, const TACSymbol symbol)
+{
+    switch (symbol.type)
+    {
+    case TAC_SYMBOL_TYPE_SYMBOL:
+        assert(list->representations && symbol.symbol < list->representation_count && "Temporary has no representation");
+        return list->representations[symbol.symbol];
+    case TAC_SYMBOL_TYPE_VARIABLE:
+        return tac_variable_representation(tac_list_current_method(list), symbol);
+    default:
+        return TAC_REPRESENTATION_BOXED;
+    }
+}
+
+static const ClassMethod* tac_call_target(const TACList* list, const TACExpr call)
+{
+    if (call.rhs1.type != TAC_SYMBOL_TYPE_METHOD) return NULL;
+    const int64_t class_idx = call.rhs1.method.class_idx < 0 ? -call.rhs1.method.class_idx - 1 : call.rhs1.method.class_idx;
+    return &list->class_list.class_nodes[class_idx].methods[call.rhs1.method.method_idx];
+}
+
+// Overrides keep the signature of the method they replace, so the static target decides the calling convention
+TACRepresentation tac_call_argument_representation(const TACList* list, const TACExpr call, const int64_t arg)
+{
+    const ClassMethod* method = tac_call_target(list, call);
+    if (!method || arg >= method->parameter_count) return TAC_REPRESENTATION_BOXED; // The receiver is always an object
+    return tac_representation_from_type(method->parameters[arg].type_atom);
+}
+
+TACRepresentation tac_call_result_representation(const TACList* list, const TACExpr call)
+{
+    const ClassMethod* method = tac_call_target(list, call);
+    if (!method) return TAC_REPRESENTATION_BOXED;
+    return tac_representation_from_type(method->return_type_atom);
+}
+
+TACRepresentation tac_return_representation(const TACList* list)
+{
+    const ClassMethod* method = tac_list_current_method(list);
+    if (!method) return TAC_REPRESENTATION_BOXED; // Attribute initializers store into the object
+    return tac_representation_from_type(method->return_type_atom);
+}
+
+// The representation the code for an expression produces before it is stored into lhs
+TACRepresentation tac_expr_result_representation(const TACList* list, const TACExpr expr)
+{
+    switch (expr.operation)
+    {
+    case TAC_OP_PLUS:
+    case TAC_OP_MINUS:
+    case TAC_OP_TIMES:
+    case TAC_OP_DIVIDE:
+    case TAC_OP_SHL:
+    case TAC_OP_SHR:
+    case TAC_OP_NEG:
+    case TAC_OP_INT:
+        return TAC_REPRESENTATION_INT;
+    case TAC_OP_NOT:
+    case TAC_OP_ISVOID:
+    case TAC_OP_BOOL:
+        return TAC_REPRESENTATION_BOOL;
+    case TAC_OP_DEFAULT:
+        return tac_representation_from_type(expr.rhs1.variable.atom);
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+        return tac_expr_is_primitive_comparison(list, expr) ? TAC_REPRESENTATION_BOOL : TAC_REPRESENTATION_BOXED;
+    case TAC_OP_ASSIGN:
+        return tac_symbol_representation(list, expr.rhs1);
+    case TAC_OP_CALL:
+        return tac_call_result_representation(list, expr);
+    default:
+        return TAC_REPRESENTATION_BOXED;
+    }
+}
+
+// Comparisons between two raw values of the same type are done inline instead of through the handlers
+bool tac_expr_is_primitive_comparison(const TACList* list, const TACExpr expr)
+{
+    if (expr.operation != TAC_OP_LT && expr.operation != TAC_OP_LTE && expr.operation != TAC_OP_EQ) return false;
+    const TACRepresentation representation = tac_symbol_representation(list, expr.rhs1);
+    return representation != TAC_REPRESENTATION_BOXED && representation == tac_symbol_representation(list, expr.rhs2);
+}
+
+static TACRepresentation tac_operand_type(const TACList* list, const TACRepresentation* types, const TACSymbol operand)
+{
+    switch (operand.type)
+    {
+    case TAC_SYMBOL_TYPE_SYMBOL:
+        return types[operand.symbol];
+    case TAC_SYMBOL_TYPE_VARIABLE:
+        return tac_representation_from_type(tac_variable_type(list, operand));
+    default:
+        return TAC_REPRESENTATION_BOXED;
+    }
+}
+
+// Type of the raw values a comparison can be done on inline, boxed if it has to go through a handler
+static TACRepresentation tac_comparison_type(const TACList* list, const TACRepresentation* types, const TACExpr expr)
+{
+    if (expr.operation != TAC_OP_LT && expr.operation != TAC_OP_LTE && expr.operation != TAC_OP_EQ) return TAC_REPRESENTATION_BOXED;
+    const TACRepresentation type = tac_operand_type(list, types, expr.rhs1);
+    if (type != TAC_REPRESENTATION_INT && type != TAC_REPRESENTATION_BOOL) return TAC_REPRESENTATION_BOXED;
+    return type == tac_operand_type(list, types, expr.rhs2) ? type : TAC_REPRESENTATION_BOXED;
+}
+
+// Static type of the value an expression defines, ignoring copies between temporaries
+static TACRepresentation tac_expr_result_type(const TACList* list, const TACExpr expr)
+{
+    switch (expr.operation)
+    {
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+        return TAC_REPRESENTATION_BOOL;
+    case TAC_OP_NEW:
+        return tac_representation_from_type(expr.rhs1.variable.atom);
+    case TAC_OP_ASSIGN:
+        if (expr.rhs1.type != TAC_SYMBOL_TYPE_VARIABLE) return TAC_REPRESENTATION_BOXED;
+        return tac_representation_from_type(tac_variable_type(list, expr.rhs1));
+    default:
+        return tac_expr_result_representation(list, expr);
+    }
+}
+
+// Reads that have to see an object. Stores into attributes box as part of the store instead.
+static bool tac_expr_operand_needs_object(const TACList* list, const TACRepresentation* types, const TACExpr expr, const int64_t operand)
+{
+    switch (expr.operation)
+    {
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+        return tac_comparison_type(list, types, expr) == TAC_REPRESENTATION_BOXED;
+    case TAC_OP_IS_CLASS:
+    case TAC_OP_LOAD_ATTRIBUTE:
+    case TAC_OP_STORE_ATTRIBUTE:
+        return true;
+    case TAC_OP_RETURN:
+        return tac_return_representation(list) == TAC_REPRESENTATION_BOXED;
+    case TAC_OP_CALL:
+        return tac_call_argument_representation(list, expr, operand) == TAC_REPRESENTATION_BOXED;
+    default:
+        return false;
+    }
+}
+
+// Operands that can be read as an object, which are the only ones that might need a box in front of them.
+// Arithmetic operands are always raw, so they aren't counted.
+static TACSymbol* tac_expr_object_operand(TACExpr* expr, const int64_t operand)
+{
+    if (expr->operation == TAC_OP_CALL) return &expr->args[operand];
+    return operand == 0 ? &expr->rhs1 : &expr->rhs2;
+}
+
+static int64_t tac_expr_object_operand_count(const TACExpr expr)
+{
+    switch (expr.operation)
+    {
+    case TAC_OP_CALL: return expr.arg_count;
+    case TAC_OP_LT:
+    case TAC_OP_LTE:
+    case TAC_OP_EQ:
+    case TAC_OP_STORE_ATTRIBUTE:
+        return 2;
+    case TAC_OP_IS_CLASS:
+    case TAC_OP_LOAD_ATTRIBUTE:
+    case TAC_OP_RETURN:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Keeps Int and Bool temporaries as raw words. A temporary is unboxed when every definition gives it
+// the same primitive type and either one of them computes the value (so boxing it would allocate anyway)
+// or nothing reads it as an object. Reads that need an object get an explicit box in front of them.
+void unbox_tac_list(TACList* list)
+{
+    const int64_t symbol_count = tac_list_symbol_count(list);
+    TACRepresentation* types = bh_alloc(GPA, sizeof(TACRepresentation) * symbol_count);
+    bool* computed = bh_alloc(GPA, sizeof(bool) * symbol_count);
+    int64_t* object_uses = bh_alloc(GPA, sizeof(int64_t) * symbol_count);
+    for (int64_t s = 0; s < symbol_count; s++)
+    {
+        types[s] = TAC_REPRESENTATION_UNKNOWN;
+        computed[s] = false;
+        object_uses[s] = 0;
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int64_t i = 0; i < list->count; i++)
+        {
+            const TACExpr expr = list->items[i];
+            const int64_t def = tac_expr_defined_symbol(expr);
+            if (def < 0) continue;
+
+            TACRepresentation type;
+            bool is_computed;
+            if (expr.operation == TAC_OP_ASSIGN && expr.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL)
+            {
+                type = types[expr.rhs1.symbol];
+                is_computed = computed[expr.rhs1.symbol];
+                if (type == TAC_REPRESENTATION_UNKNOWN) continue;
+            }
+            else
+            {
+                type = tac_expr_result_type(list, expr);
+                if (expr.operation == TAC_OP_LT || expr.operation == TAC_OP_LTE || expr.operation == TAC_OP_EQ)
+                {
+                    is_computed = tac_comparison_type(list, types, expr) != TAC_REPRESENTATION_BOXED;
+                }
+                else
+                {
+                    is_computed = expr.operation != TAC_OP_NEW && tac_expr_result_representation(list, expr) != TAC_REPRESENTATION_BOXED;
+                }
+            }
+
+            const TACRepresentation met = types[def] == TAC_REPRESENTATION_UNKNOWN || types[def] == type ? type : TAC_REPRESENTATION_BOXED;
+            if (met != types[def] || (is_computed && !computed[def])) changed = true;
+            types[def] = met;
+            computed[def] |= is_computed;
+        }
+    }
+
+    int64_t conversion_count = 0;
+    for (int64_t i = 0; i < list->count; i++)
+    {
+        TACExpr expr = list->items[i];
+        for (int64_t o = 0; o < tac_expr_object_operand_count(expr); o++)
+        {
+            const TACSymbol operand = *tac_expr_object_operand(&expr, o);
+            if (tac_comparison_type(list, types, expr) != TAC_REPRESENTATION_BOXED) conversion_count += 1;
+            if (operand.type != TAC_SYMBOL_TYPE_SYMBOL || !tac_expr_operand_needs_object(list, types, expr, o)) continue;
+            object_uses[operand.symbol] += 1;
+            conversion_count += 1;
+        }
+        if (expr.operation == TAC_OP_ASSIGN && expr.rhs1.type == TAC_SYMBOL_TYPE_SYMBOL && expr.lhs.type == TAC_SYMBOL_TYPE_VARIABLE &&
+            tac_symbol_representation(list, expr.lhs) == TAC_REPRESENTATION_BOXED)
+        {
+            object_uses[expr.rhs1.symbol] += 1;
+        }
+    }
+
+    list->representation_count = symbol_count + conversion_count;
+    list->representations = bh_alloc(list->allocator, sizeof(TACRepresentation) * list->representation_count);
+    for (int64_t s = 0; s < list->representation_count; s++)
+    {
+        const bool is_primitive = s < symbol_count && (types[s] == TAC_REPRESENTATION_INT || types[s] == TAC_REPRESENTATION_BOOL);
+        list->representations[s] = is_primitive && (computed[s] || object_uses[s] == 0) ? types[s] : TAC_REPRESENTATION_BOXED;
+    }
+
+    // Operands are checked against the expression as it was, the boxes and unboxes put in front of it
+    // have temporaries types doesn't cover
+    for (int64_t i = 0; i < list->count; i++)
+    {
+        const TACExpr original = list->items[i];
+        const int64_t operand_count = tac_expr_object_operand_count(original);
+        const TACRepresentation comparison_type = tac_comparison_type(list, types, original);
+        for (int64_t o = 0; o < operand_count; o++)
+        {
+            const TACSymbol operand = *tac_expr_object_operand(&list->items[i], o);
+
+            // Inline comparisons read both sides raw, so unbox whatever is still held as an object
+            if (comparison_type != TAC_REPRESENTATION_BOXED)
+            {
+                if (tac_symbol_representation(list, operand) != TAC_REPRESENTATION_BOXED) continue;
+                const TACSymbol raw = TAC_request_symbol(list);
+                assert(raw.symbol < list->representation_count && "Ran out of temporaries for unboxing");
+                list->representations[raw.symbol] = comparison_type;
+                TAC_list_insert_at(list, (TACExpr){
+                    .operation = TAC_OP_ASSIGN,
+                    .line_num = list->items[i].line_num,
+                    .lhs = raw,
+                    .rhs1 = operand
+                }, i);
+                i++;
+                *tac_expr_object_operand(&list->items[i], o) = raw;
+                continue;
+            }
+
+            if (operand.type != TAC_SYMBOL_TYPE_SYMBOL || !tac_expr_operand_needs_object(list, types, original, o)) continue;
+            if (list->representations[operand.symbol] == TAC_REPRESENTATION_BOXED) continue;
+
+            const TACSymbol boxed = TAC_request_symbol(list);
+            assert(boxed.symbol < list->representation_count && "Ran out of temporaries for boxing");
+            TAC_list_insert_at(list, (TACExpr){
+                .operation = TAC_OP_BOX,
+                .line_num = list->items[i].line_num,
+                .lhs = boxed,
+                .rhs1 = operand
+            }, i);
+            i++;
+            *tac_expr_object_operand(&list->items[i], o) = boxed;
+        }
+    }
+
+    bh_free(GPA, object_uses);
+    bh_free(GPA, computed);
+    bh_free(GPA, types);
+}
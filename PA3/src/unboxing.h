@@ -0,0 +1,19 @@
+#ifndef UNBOXING_H
+#define UNBOXING_H
+
+#include "tac.h"
+
+TACRepresentation tac_representation_from_type(bh_atom type_name);
+const ClassMethod* tac_list_current_method(const TACList* list);
+bh_atom tac_variable_type(const TACList* list, TACSymbol variable);
+TACRepresentation tac_variable_representation(const ClassMethod* method, TACSymbol variable);
+TACRepresentation tac_symbol_representation(const TACList* list, TACSymbol symbol);
+TACRepresentation tac_call_argument_representation(const TACList* list, TACExpr call, int64_t arg);
+TACRepresentation tac_call_result_representation(const TACList* list, TACExpr call);
+TACRepresentation tac_return_representation(const TACList* list);
+TACRepresentation tac_expr_result_representation(const TACList* list, TACExpr expr);
+bool tac_expr_is_primitive_comparison(const TACList* list, TACExpr expr);
+
+void unbox_tac_list(TACList* list);
+
+#endif //UNBOXING_H
@@ -0,0 +1,142 @@
+#include "use_def.h"
+
+#include <string.h>
+
+TACSymbol* tac_expr_operand(TACExpr* expr, const int64_t operand)
+{
+    if (operand == TAC_OPERAND_RHS1) return &expr->rhs1;
+    if (operand == TAC_OPERAND_RHS2) return &expr->rhs2;
+    return &expr->args[operand - TAC_OPERAND_ARGS];
+}
+
+int64_t tac_expr_operand_count(const TACExpr expr)
+{
+    return TAC_OPERAND_ARGS + (expr.operation == TAC_OP_CALL || expr.operation == TAC_OP_PHI ? expr.arg_count : 0);
+}
+
+static void tac_use_def_reserve_symbol(TACUseDef* use_def, const int64_t symbol)
+{
+    if (symbol < use_def->symbol_count) return;
+    int64_t capacity = use_def->symbol_count > 0 ? use_def->symbol_count : 16;
+    while (capacity <= symbol) capacity *= 2;
+    use_def->first_def = bh_realloc(use_def->allocator, use_def->first_def, capacity * sizeof(int64_t));
+    use_def->first_use = bh_realloc(use_def->allocator, use_def->first_use, capacity * sizeof(int64_t));
+    memset(&use_def->first_def[use_def->symbol_count], -1, (capacity - use_def->symbol_count) * sizeof(int64_t));
+    memset(&use_def->first_use[use_def->symbol_count], -1, (capacity - use_def->symbol_count) * sizeof(int64_t));
+    use_def->symbol_count = capacity;
+}
+
+static int64_t tac_use_def_push(TACUseDef* use_def, TACUse** entries, int64_t* count, int64_t* capacity, const TACUse entry)
+{
+    if (*count == *capacity)
+    {
+        *capacity = *capacity > 0 ? *capacity * 2 : 64;
+        *entries = bh_realloc(use_def->allocator, *entries, *capacity * sizeof(TACUse));
+    }
+    (*entries)[*count] = entry;
+    return (*count)++;
+}
+
+void tac_use_def_add_def(TACUseDef* use_def, const int64_t symbol, const int64_t expr)
+{
+    tac_use_def_reserve_symbol(use_def, symbol);
+    const TACUse def = (TACUse){ .expr = expr, .next = use_def->first_def[symbol] };
+    use_def->first_def[symbol] = tac_use_def_push(use_def, &use_def->defs, &use_def->def_count, &use_def->def_capacity, def);
+}
+
+void tac_use_def_add_use(TACUseDef* use_def, const int64_t symbol, const int64_t expr, const int64_t operand)
+{
+    tac_use_def_reserve_symbol(use_def, symbol);
+    const TACUse use = (TACUse){ .expr = expr, .operand = operand, .next = use_def->first_use[symbol] };
+    use_def->first_use[symbol] = tac_use_def_push(use_def, &use_def->uses, &use_def->use_count, &use_def->use_capacity, use);
+}
+
+TACUseDef tac_use_def_init(const TACList* list, const bh_allocator allocator)
+{
+    TACUseDef use_def = (TACUseDef){ .allocator = allocator };
+    tac_use_def_reserve_symbol(&use_def, list->_curr_symbol);
+
+    // Walk backwards so every list starts out in expression order
+    for (int64_t i = list->count - 1; i >= 0; i--)
+    {
+        TACExpr expr = list->items[i];
+        if (expr.operation == TAC_OP_NULL) continue;
+        if (expr.lhs.type == TAC_SYMBOL_TYPE_SYMBOL) tac_use_def_add_def(&use_def, expr.lhs.symbol, i);
+        for (int64_t operand = tac_expr_operand_count(expr) - 1; operand >= 0; operand--)
+        {
+            const TACSymbol* symbol = tac_expr_operand(&expr, operand);
+            if (symbol->type == TAC_SYMBOL_TYPE_SYMBOL) tac_use_def_add_use(&use_def, symbol->symbol, i, operand);
+        }
+    }
+    return use_def;
+}
+
+void tac_use_def_deinit(TACUseDef* use_def)
+{
+    bh_free(use_def->allocator, use_def->first_def);
+    bh_free(use_def->allocator, use_def->first_use);
+    bh_free(use_def->allocator, use_def->defs);
+    bh_free(use_def->allocator, use_def->uses);
+    *use_def = (TACUseDef){ 0 };
+}
+
+bool tac_use_def_is_def(const TACList* list, const TACUse* def, const int64_t symbol)
+{
+    if (def->expr >= list->count) return false;
+    const TACExpr expr = list->items[def->expr];
+    return expr.operation != TAC_OP_NULL && expr.lhs.type == TAC_SYMBOL_TYPE_SYMBOL && expr.lhs.symbol == symbol;
+}
+
+bool tac_use_def_is_use(const TACList* list, const TACUse* use, const int64_t symbol)
+{
+    if (use->expr >= list->count) return false;
+    TACExpr expr = list->items[use->expr];
+    if (expr.operation == TAC_OP_NULL || use->operand >= tac_expr_operand_count(expr)) return false;
+    const TACSymbol* operand = tac_expr_operand(&expr, use->operand);
+    return operand->type == TAC_SYMBOL_TYPE_SYMBOL && operand->symbol == symbol;
+}
+
+// The expression writing symbol if exactly one does, -1 otherwise
+int64_t tac_use_def_only_def(const TACList* list, const TACUseDef* use_def, const int64_t symbol)
+{
+    if (symbol >= use_def->symbol_count) return -1;
+    int64_t only_def = -1;
+    for (int64_t idx = use_def->first_def[symbol]; idx != -1; idx = use_def->defs[idx].next)
+    {
+        const TACUse* def = &use_def->defs[idx];
+        if (!tac_use_def_is_def(list, def, symbol) || def->expr == only_def) continue;
+        if (only_def != -1) return -1;
+        only_def = def->expr;
+    }
+    return only_def;
+}
+
+// Renames the reads of from in the expressions past after to to. Only the uses that move are visited, not
+// the whole list.
+void tac_use_def_replace_uses_after(TACUseDef* use_def, TACList* list, const int64_t from, const int64_t to, const int64_t after)
+{
+    if (from == to || from >= use_def->symbol_count) return;
+    tac_use_def_reserve_symbol(use_def, to);
+
+    int64_t* link = &use_def->first_use[from];
+    while (*link != -1)
+    {
+        const int64_t idx = *link;
+        TACUse* use = &use_def->uses[idx];
+        if (!tac_use_def_is_use(list, use, from))
+        {
+            *link = use->next; // Drop stale entries while we're here
+            continue;
+        }
+        if (use->expr <= after)
+        {
+            link = &use->next;
+            continue;
+        }
+
+        tac_expr_operand(&list->items[use->expr], use->operand)->symbol = to;
+        *link = use->next;
+        use->next = use_def->first_use[to];
+        use_def->first_use[to] = idx;
+    }
+}
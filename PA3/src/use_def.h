@@ -0,0 +1,50 @@
+#ifndef USE_DEF_H
+#define USE_DEF_H
+
+#include <stdint.h>
+
+#include "tac.h"
+
+// Operands an expression reads, args[k] is TAC_OPERAND_ARGS + k
+#define TAC_OPERAND_RHS1 0
+#define TAC_OPERAND_RHS2 1
+#define TAC_OPERAND_ARGS 2
+
+typedef struct TACUse
+{
+    int64_t expr;
+    int64_t operand;
+    int64_t next; // Next entry for the same temporary, -1 at the end
+} TACUse;
+
+// Per temporary lists of the expressions that write and read it. Passes keep it up to date by adding
+// entries for whatever they introduce. Entries are never removed, one goes stale once its expression is
+// nulled out or stops naming the temporary, so walks skip those. Indices into the list are only stable
+// until it gets compacted.
+typedef struct TACUseDef
+{
+    int64_t symbol_count;
+    int64_t* first_def; // -1 if the temporary is never written
+    int64_t* first_use; // -1 if the temporary is never read
+    TACUse* defs; // operand is unused
+    int64_t def_count;
+    int64_t def_capacity;
+    TACUse* uses;
+    int64_t use_count;
+    int64_t use_capacity;
+    bh_allocator allocator;
+} TACUseDef;
+
+TACSymbol* tac_expr_operand(TACExpr* expr, int64_t operand);
+int64_t tac_expr_operand_count(TACExpr expr);
+
+TACUseDef tac_use_def_init(const TACList* list, bh_allocator allocator);
+void tac_use_def_deinit(TACUseDef* use_def);
+void tac_use_def_add_def(TACUseDef* use_def, int64_t symbol, int64_t expr);
+void tac_use_def_add_use(TACUseDef* use_def, int64_t symbol, int64_t expr, int64_t operand);
+bool tac_use_def_is_def(const TACList* list, const TACUse* def, int64_t symbol);
+bool tac_use_def_is_use(const TACList* list, const TACUse* use, int64_t symbol);
+int64_t tac_use_def_only_def(const TACList* list, const TACUseDef* use_def, int64_t symbol);
+void tac_use_def_replace_uses_after(TACUseDef* use_def, TACList* list, int64_t from, int64_t to, int64_t after);
+
+#endif //USE_DEF_H
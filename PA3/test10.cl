@@ -0,0 +1,51 @@
+class Counter {
+    n : Int;
+    get() : Int { n };
+    next() : Int { { n <- n + 1; n; } };
+    bump(by : Int) : Int { n <- n + by };
+};
+
+class Main inherits IO {
+    counter : Counter <- new Counter;
+    total : Int;
+
+    line(x : Int) : SELF_TYPE { { out_int(x); out_string("\n"); } };
+
+    add(x : Int) : Int { total <- total + x };
+
+    main() : Object {
+        let a : Int <- 6, b : Int <- 7, c : Int, d : Int in {
+            c <- a * b + 1;
+            if a < b then d <- a * b + 1 else d <- a * b - 1 fi;
+            line(c + d + (a * b + 1));
+
+            c <- a * b;
+            a <- a + 1;
+            line(c + a * b);
+
+            line(counter.next() + counter.next() * 10);
+            line(counter.get() + counter.get());
+            c <- counter.get();
+            counter.bump(100);
+            line(c + counter.get());
+
+            c <- total + 1;
+            add(5);
+            line(c + total + 1);
+
+            let i : Int in
+                while i < 5 loop {
+                    c <- i * b + a;
+                    d <- d + i * b + a;
+                    i <- i + 1;
+                } pool;
+            line(c + d);
+
+            let s : String <- "abc", t : String <- "abc".concat("d") in {
+                line(s.length() + s.length() + t.length());
+                s <- t;
+                line(s.length() + t.length());
+            };
+        }
+    };
+};
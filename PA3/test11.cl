@@ -0,0 +1,58 @@
+class Cell {
+    value : Int;
+    get() : Int { value };
+    set(v : Int) : Int { value <- v };
+    poke() : Int { 1 };
+};
+
+class Main inherits IO {
+    limit : Int <- 4;
+    cell : Cell <- new Cell;
+    nothing : Cell;
+
+    grow() : Int { limit <- limit + 1 };
+
+    line(x : Int) : SELF_TYPE { { out_int(x); out_string("\n"); } };
+
+    main() : Object {
+        let x : Int <- 6, y : Int <- 7, zero : Int, i : Int, sum : Int in {
+            while i < 10 loop { sum <- sum + x * y + 3; i <- i + 1; } pool;
+            line(sum);
+
+            i <- 0;
+            while i < zero loop { sum <- sum + 100 / zero; i <- i + 1; } pool;
+            line(sum);
+
+            i <- 10;
+            while i < 10 loop sum <- sum + nothing.poke() pool;
+            line(sum);
+
+            i <- 0;
+            while i < 10 loop { if zero < i then sum <- sum + 100 / i else sum <- sum fi; i <- i + 1; } pool;
+            line(sum);
+
+            i <- 0;
+            while i < limit loop { sum <- sum + limit; if i < 3 then grow() else 0 fi; i <- i + 1; } pool;
+            line(sum);
+            line(limit);
+
+            i <- 0;
+            sum <- 0;
+            while i < 5 loop { sum <- sum + cell.get() * 2; cell.set(i); i <- i + 1; } pool;
+            line(sum);
+
+            i <- 0;
+            sum <- 0;
+            while i < 4 loop {
+                let j : Int <- 0 in
+                    while j < 4 loop { sum <- sum + x * i + y * j + x * y; j <- j + 1; } pool;
+                i <- i + 1;
+            } pool;
+            line(sum);
+
+            i <- 0;
+            while i < 3 loop { x <- y * 2; y <- x + i; i <- i + 1; } pool;
+            line(x + y);
+        }
+    };
+};
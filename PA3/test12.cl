@@ -0,0 +1,42 @@
+class Main inherits IO {
+    id(x : Int) : Int { x };
+
+    show(x : Int) : SELF_TYPE { { out_int(x); out_string(" "); } };
+
+    main() : Object {
+        let n7 : Int <- id(~7), n8 : Int <- id(~8), n1 : Int <- id(~1), n9 : Int <- id(~9), p7 : Int <- id(7),
+            min : Int <- id(~2147483647) - 1 in {
+            show(n7 / 2); show(n8 / 4); show(n1 / 2); show(n9 / 8); show(n7 / 8); show(p7 / 2); show(p7 / 1);
+            out_string("\n");
+            show(min / 2); show(min / 1024); show(min / 1073741824); show(~2147483647 / 65536);
+            out_string("\n");
+            show(n7 * 8); show(p7 * 16); show(n9 * 1024); show(p7 * 0); show(n7 * 1); show(65535 * id(65536));
+            out_string("\n");
+
+            let i : Int <- ~10, sum : Int, sum2 : Int in {
+                while i <= 10 loop {
+                    sum <- sum + i * 12 + i * 16;
+                    sum2 <- sum2 + (i * 8) / 4 - i / 2;
+                    i <- i + 1;
+                } pool;
+                show(sum); show(sum2); show(i);
+                out_string("\n");
+            };
+
+            let i : Int <- 0, total : Int in {
+                while i < 6 loop {
+                    let j : Int <- ~3 in
+                        while j < 3 loop { total <- total + i * j * 4 + j * i; j <- j + 1; } pool;
+                    i <- i + 1;
+                } pool;
+                show(total);
+            };
+
+            let i : Int <- 20, acc : Int in {
+                while 0 < i loop { acc <- acc + i * 5; i <- i - 3; } pool;
+                show(acc); show(i);
+            };
+            out_string("\n");
+        }
+    };
+};
@@ -0,0 +1,41 @@
+class Point {
+    x : Int;
+    y : Int;
+    x() : Int { x };
+    y() : Int { y };
+    set_x(v : Int) : SELF_TYPE { { x <- v; self; } };
+    set_y(v : Int) : SELF_TYPE { { y <- v; self; } };
+    shifted(dx : Int) : Int { { dx <- dx + x; dx * 10 + y; } };
+    shadow(v : Int) : Int { let x : Int <- v * 2 in x + y };
+    sum(p : Point) : Int { x + y + p.x() + p.y() };
+};
+
+class Counter {
+    n : Int;
+    next() : Int { { n <- n + 1; n; } };
+    pair(a : Int, b : Int) : Int { a * 10 + b };
+};
+
+class Main inherits IO {
+    counter : Counter <- new Counter;
+
+    line(x : Int) : SELF_TYPE { { out_int(x); out_string("\n"); } };
+
+    fact(n : Int) : Int { if n = 0 then 1 else n * fact(n - 1) fi };
+
+    main() : Object {
+        let p : Point <- (new Point).set_x(3).set_y(4), q : Point <- new Point, gone : Point, dx : Int <- 5 in {
+            line(p.x() * 100 + p.y());
+            line(p.shifted(dx) + dx);
+            line(p.shadow(7) + p.x());
+            line(p.sum(q.set_x(10).set_y(20)));
+            line(counter.pair(counter.next(), counter.next()));
+            line(fact(5) + fact(3));
+            q <- p;
+            p.set_x(9);
+            line(q.x());
+            line(gone.x());
+            line(0);
+        }
+    };
+};
@@ -0,0 +1,69 @@
+class Shape inherits IO {
+    name() : String { "shape" };
+    area() : Int { 0 };
+    sides() : Int { 0 };
+    describe() : SELF_TYPE { { out_string(name()); out_string(" "); out_int(area()); out_string(" "); out_int(sides()); out_string("\n"); } };
+    me() : SELF_TYPE { self };
+};
+
+class Square inherits Shape {
+    side : Int <- 3;
+    name() : String { "square" };
+    area() : Int { side * side };
+    sides() : Int { 4 };
+};
+
+class Cube inherits Square {
+    name() : String { "cube" };
+    area() : Int { 6 * side * side };
+};
+
+class Circle inherits Shape {
+    r : Int <- 2;
+    name() : String { "circle" };
+    area() : Int { 3 * r * r };
+};
+
+class Main inherits IO {
+    total(s : Shape) : Int { s.area() + s.sides() };
+
+    main() : Object {
+        let s : Shape <- new Shape, sq : Square <- new Square, c : Circle <- new Circle, shapes : Shape in {
+            s.describe();
+            sq.describe();
+            c.describe();
+            (new Cube).describe();
+
+            shapes <- sq;
+            out_int(shapes.area() + total(c) + total(new Cube) + total(new Shape));
+            out_string("\n");
+
+            sq <- new Cube;
+            out_int(sq.area());
+            out_string(" ");
+            out_int(sq@Square.area());
+            out_string(" ");
+            out_int(sq@Shape.area());
+            out_string(" ");
+            out_int(sq.sides());
+            out_string(" ");
+            out_string(sq.me().name());
+            out_string(" ");
+            out_string(c.me().type_name());
+            out_string(" ");
+            out_string(s.me().name());
+            out_string("\n");
+
+            case sq of
+                x : Cube => out_int(x.area());
+                y : Square => out_int(y.area() + 1);
+            esac;
+            out_string(" ");
+            case shapes of
+                x : Cube => out_int(x.area());
+                y : Shape => out_int(y.area() + 1);
+            esac;
+            out_string("\n");
+        }
+    };
+};
@@ -0,0 +1,38 @@
+class Counter {
+    n : Int;
+    next() : Int { { n <- n + 1; n; } };
+};
+
+class Main inherits IO {
+    counter : Counter <- new Counter;
+
+    fib(n : Int) : Int { if n < 2 then n else fib(n - 1) + fib(n - 2) fi };
+
+    digits(a : Int, b : Int, c : Int, d : Int) : Int { a * 1000 + b * 100 + c * 10 + d };
+
+    line(x : Int) : SELF_TYPE { { out_int(x); out_string("\n"); } };
+
+    main() : Object {
+        let a : Int <- 1, b : Int <- 2, c : Int <- 3, d : Int <- 4, e : Int <- 5, f : Int <- 6,
+            g : Int <- 7, h : Int <- 8, i : Int <- 9, j : Int <- 10, k : Int <- 11, l : Int <- 12,
+            m : Int <- 13, n : Int <- 14, o : Int <- 15, p : Int <- 16 in {
+            line(fib(20));
+            line(a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p);
+            line(a + fib(10) * b + fib(5) * c + fib(6) * d + e * f * g - h * i + j * k - l * m + n * o - p);
+            line(digits(counter.next(), counter.next(), counter.next(), counter.next()));
+            line((a - b) * (c - d) * (e - f) * (g - h) + (i - j) * (k - l) * (m - n) * (o - p));
+            a <- fib(a + 10);
+            b <- a + fib(b + 10);
+            c <- b - fib(c + 10);
+            line(a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p);
+            let q : Int <- 0, r : Int <- 100 in {
+                while q < 50 loop {
+                    r <- r + q * a - b + c;
+                    q <- q + 1;
+                } pool;
+                line(r + q);
+            };
+            line(digits(counter.next(), d, counter.next(), e));
+        }
+    };
+};
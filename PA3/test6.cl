@@ -0,0 +1,70 @@
+class Box {
+    value : Object;
+    set(x : Object) : Box { { value <- x; self; } };
+    get() : Object { value };
+};
+
+class Main inherits IO {
+    zero : Int;
+    no : Bool;
+
+    describe(x : Object) : String {
+        case x of
+            i : Int => "Int ";
+            b : Bool => "Bool ";
+            s : String => "String ";
+            o : Object => "Object ";
+        esac
+    };
+
+    add_boxed(x : Object, y : Int) : Int {
+        case x of i : Int => i + y; esac
+    };
+
+    flip(b : Bool) : Bool { not b };
+
+    main() : Object {
+        let i : Int <- 5, b : Bool <- true, o : Object, box : Box <- new Box, total : Int, big : Int <- 70000 in {
+            o <- i;
+            out_string(describe(o));
+            out_string(describe(b));
+            out_string(describe(i + 1));
+            out_string(describe(i < 3));
+            out_string(describe(box.set(big).get()));
+            out_string("\n");
+
+            out_int(add_boxed(box.get(), 1));
+            out_string(" ");
+            out_int(add_boxed(box.set(i * 3).get(), big));
+            out_string(" ");
+            out_int(add_boxed(o, i));
+            out_string("\n");
+
+            while total < 1000 loop total <- total + i * 7 pool;
+            out_int(total);
+            out_string(" ");
+            out_int(zero + total);
+            out_string(" ");
+            out_int(i.copy() + 1);
+            out_string(" ");
+            out_string(i.type_name().concat(b.type_name()));
+            out_string("\n");
+
+            if isvoid i then out_string("void ") else out_string("Int ") fi;
+            if isvoid o then out_string("void ") else out_string("Object ") fi;
+            if no then out_string("yes ") else out_string("no ") fi;
+            if flip(no) then out_string("yes ") else out_string("no ") fi;
+            if i = 5 then out_string("eq ") else out_string("ne ") fi;
+            if big = 70000 then out_string("eq ") else out_string("ne ") fi;
+            if b = flip(no) then out_string("eq") else out_string("ne") fi;
+            out_string("\n");
+
+            box.set(b);
+            case box.get() of
+                x : Bool => if x then out_string("true") else out_string("false") fi;
+                y : Object => out_string("other");
+            esac;
+            out_string("\n");
+        }
+    };
+};
@@ -0,0 +1,47 @@
+class Main inherits IO {
+    yes_no(b : Bool) : SELF_TYPE { if b then out_string("Y") else out_string("N") fi };
+
+    small(x : Int) : Bool { x < 10 };
+
+    main() : Object {
+        let a : Int <- 3, b : Int <- 7, c : Int <- ~5, t : Bool <- true, f : Bool, s : String <- "ab", o : Object <- self in {
+            yes_no(a < b); yes_no(b < a); yes_no(a <= a); yes_no(b <= a); yes_no(a = 3); yes_no(a = b);
+            out_string("\n");
+            yes_no(not a < b); yes_no(not not a < b); yes_no(not (b <= a)); yes_no(not a = b);
+            yes_no(c < 0); yes_no(c <= ~5); yes_no(~c = 5); yes_no(c < ~5);
+            out_string("\n");
+
+            if a < b then out_string("1") else out_string("0") fi;
+            if not a < b then out_string("1") else out_string("0") fi;
+            if b <= a then out_string("1") else out_string("0") fi;
+            if not not (b = 7) then out_string("1") else out_string("0") fi;
+            if small(a) then out_string("1") else out_string("0") fi;
+            if not small(b * 2) then out_string("1") else out_string("0") fi;
+            out_string("\n");
+
+            let lt : Bool <- a < b, eq : Bool <- a = b in {
+                yes_no(lt); yes_no(eq); yes_no(lt = eq); yes_no(not lt = eq);
+                if lt then if eq then out_string("a") else out_string("b") fi else out_string("c") fi;
+            };
+            out_string("\n");
+
+            yes_no(t = true); yes_no(f = false); yes_no(t = f); yes_no(f < t); yes_no(t <= f);
+            yes_no(s = "ab"); yes_no(s = "a".concat("b")); yes_no(s = "ba"); yes_no(s < "b"); yes_no("ab" <= s);
+            yes_no(o = self); yes_no(o = new Main); yes_no(o = o.copy());
+            out_string("\n");
+
+            let i : Int <- 0, count : Int in {
+                while i < 20 loop {
+                    if not i <= 10 then count <- count + 1 else
+                    if i = 4 then count <- count + 100 else count <- count fi fi;
+                    i <- i + 1;
+                } pool;
+                while not count <= 0 loop count <- count - 7 pool;
+                out_int(count);
+                out_string(" ");
+                out_int(i);
+            };
+            out_string("\n");
+        }
+    };
+};
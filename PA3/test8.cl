@@ -0,0 +1,82 @@
+class Node {
+    value : Int;
+    next : Node;
+    init(v : Int, n : Node) : Node { { value <- v; next <- n; self; } };
+    value() : Int { value };
+    next() : Node { next };
+    set_next(n : Node) : Node { next <- n };
+};
+
+class Main inherits IO {
+    old : Node;
+
+    build(n : Int) : Node {
+        let list : Node in {
+            while 0 < n loop { list <- (new Node).init(n, list); n <- n - 1; } pool;
+            list;
+        }
+    };
+
+    sum(list : Node) : Int {
+        let total : Int in {
+            while not isvoid list loop { total <- total + list.value(); list <- list.next(); } pool;
+            total;
+        }
+    };
+
+    length(list : Node) : Int {
+        let count : Int in {
+            while not isvoid list loop { count <- count + 1; list <- list.next(); } pool;
+            count;
+        }
+    };
+
+    churn(n : Int) : Int {
+        let kept : Int in {
+            while 0 < n loop {
+                kept <- kept + (new Node).init(n, new Node).value() - n + 1;
+                n <- n - 1;
+            } pool;
+            kept;
+        }
+    };
+
+    deep(depth : Int) : Int {
+        if depth = 0 then churn(1000) else
+            let mine : Node <- (new Node).init(depth, new Node), junk : Int <- churn(50) in
+                deep(depth - 1) + mine.value() + mine.next().value() + junk
+        fi
+    };
+
+    main() : Object {
+        let s : String <- "ab", i : Int in {
+            old <- build(1000);
+            out_int(churn(200000));
+            out_string(" ");
+            out_int(sum(old));
+            out_string("\n");
+
+            let p : Node <- old in
+                while not isvoid p loop
+                    let n : Node <- p.next() in { p.set_next((new Node).init(1, n)); p <- n; }
+                pool;
+            out_int(churn(200000));
+            out_string(" ");
+            out_int(length(old));
+            out_string(" ");
+            out_int(sum(old));
+            out_string("\n");
+
+            out_int(deep(300));
+            out_string("\n");
+
+            while i < 22 loop { s <- s.concat(s); i <- i + 1; } pool;
+            out_int(s.length());
+            out_string(" ");
+            out_string(s.substr(s.length() - 5, 5));
+            out_string(" ");
+            out_int(sum(old) + churn(10));
+            out_string("\n");
+        }
+    };
+};
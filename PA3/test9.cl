@@ -0,0 +1,45 @@
+class Main inherits IO {
+    id(x : Int) : Int { x };
+
+    line(x : Int) : SELF_TYPE { { out_int(x); out_string("\n"); } };
+
+    main() : Object {
+        let x : Int <- 3, y : Int <- 0, z : Int, big : Int <- 2147483647, flag : Bool <- true in {
+            if x < 5 then line(x * 7) else line(1 / y) fi;
+            if flag then y <- 4 else y <- 1 / z fi;
+            line(y + x);
+            if not flag then abort() else line(x - y) fi;
+
+            line(big + 1);
+            line(id(big) + 1);
+            line(65536 * 65536);
+            line(id(65536) * id(65536));
+            line(~big - 1);
+            line(~(~big - 1));
+            line(7 / ~2);
+            line(id(7) / id(~2));
+            line(~7 / 2);
+            line(id(~7) / id(2));
+
+            z <- 5;
+            while y < 100 loop { z <- 5; y <- y + z; } pool;
+            line(z * y);
+
+            let c : Int <- 10, count : Int in {
+                while count < 3 loop {
+                    if c = 10 then c <- 10 else c <- c + 1 fi;
+                    count <- count + 1;
+                } pool;
+                line(c + count);
+            };
+
+            let d : Int <- 1 in {
+                while d < 1000 loop d <- d * 3 pool;
+                line(d);
+            };
+
+            if 3 = 3 then out_string("reached") else out_string(y.type_name()) fi;
+            out_string("\n");
+        }
+    };
+};